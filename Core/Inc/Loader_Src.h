@@ -0,0 +1,43 @@
+/*
+ * Loader_Src.h
+ *
+ * Exported loader entry points and the helpers shared by their
+ * implementation files.
+ */
+#ifndef LOADER_SRC_H_
+#define LOADER_SRC_H_
+
+#include <stdint.h>
+
+#define LOADER_OK   0x1
+#define LOADER_FAIL 0x0
+
+/*Entry points called by the programming tool*/
+int Init(void);
+int Write(uint32_t Address, uint32_t Size, uint8_t* buffer);
+int WriteCompressed(uint32_t Address, uint32_t Size, uint8_t* buffer);
+int Fill(uint32_t Address, uint32_t Size, uint8_t* pattern, uint32_t patternLen);
+int SectorErase(uint32_t EraseStartAddress, uint32_t EraseEndAddress);
+int MassErase(void);
+uint32_t CheckSum(uint32_t StartAddress, uint32_t Size, uint32_t InitVal);
+uint64_t Verify(uint32_t MemoryAddr, uint32_t RAMBufferAddr, uint32_t Size, uint32_t missalignement);
+int WriteSparse(uint8_t* buffer, uint32_t Size);
+int RunBatch(uint8_t* buffer, uint32_t Size);
+int Read(uint32_t Address, uint32_t Size, uint8_t* buffer);
+int ReadSparse(uint32_t Address, uint32_t Size, uint8_t* buffer);
+int JournalOpen(uint32_t ImageId);
+uint32_t JournalResume(uint32_t Stage);
+int JournalClose(void);
+
+/*Verify() streams the flash through MDMA when set, reads the window with
+ *the CPU otherwise*/
+extern uint8_t loader_verify_mdma;
+
+/*Helpers shared by the entry points*/
+void Loader_InvalidateBuffer(uint32_t address, uint32_t size);
+void Loader_CleanBuffer(uint32_t address, uint32_t size);
+uint8_t Loader_FillRange(uint32_t Address, uint32_t Size, const uint8_t* pattern, uint32_t patternLen);
+uint32_t Loader_Compare(const uint8_t* flash, const uint8_t* ram, uint32_t size);
+uint8_t Loader_IsBlank(const uint8_t* data, uint32_t size);
+
+#endif /* LOADER_SRC_H_ */
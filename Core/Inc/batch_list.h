@@ -0,0 +1,48 @@
+/*
+ * batch_list.h
+ *
+ * Operation list executed by RunBatch(). The host writes the list into
+ * RAM, calls RunBatch() once and reads the per-operation results back.
+ * All fields are little-endian.
+ *
+ *   struct BatchHeader
+ *   struct BatchOp[OpCount]
+ *   uint8_t data[]             source data of PROGRAM and VERIFY operations
+ */
+#ifndef BATCH_LIST_H_
+#define BATCH_LIST_H_
+
+#include <stdint.h>
+
+#define BATCH_MAGIC             0x48435442  /* "BTCH" */
+
+/*Operations*/
+#define BATCH_OP_ERASE          1   /* erase the sectors covering [Address, Address + Size) */
+#define BATCH_OP_PROGRAM        2   /* program Size bytes from data + Offset */
+#define BATCH_OP_VERIFY         3   /* compare with data + Offset, Result: byte sum or fail address */
+#define BATCH_OP_CRC            4   /* Result: CRC-32 of the flash range */
+#define BATCH_OP_FILL           5   /* program the 4-byte pattern held in Offset */
+
+/*Operation status*/
+#define BATCH_STATUS_PENDING    0   /* not executed, an earlier operation failed */
+#define BATCH_STATUS_OK         1
+#define BATCH_STATUS_FAIL       2
+
+struct BatchHeader {
+    uint32_t Magic;             // BATCH_MAGIC
+    uint32_t OpCount;           // Number of operations
+    uint32_t Completed;         // out: operations executed successfully
+    uint32_t Cycles;            // out: CPU cycles for the whole batch
+};
+
+struct BatchOp {
+    uint32_t Op;                // BATCH_OP_*
+    uint32_t Address;           // Flash address
+    uint32_t Size;              // Size in bytes
+    uint32_t Offset;            // Offset in the data area, or fill pattern
+    uint32_t Status;            // out: BATCH_STATUS_*
+    uint32_t Result;            // out: operation dependent, see above
+    uint32_t Cycles;            // out: CPU cycles spent on the operation
+};
+
+#endif /* BATCH_LIST_H_ */
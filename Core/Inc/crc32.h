@@ -0,0 +1,16 @@
+/*
+ * crc32.h
+ *
+ * CRC-32 (IEEE 802.3, reflected, polynomial 0xEDB88320) as used by zlib
+ * and Python's binascii.crc32.
+ */
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <stdint.h>
+
+#define CRC32_INIT  0x00000000
+
+uint32_t Crc32_Update(uint32_t crc, const uint8_t* data, uint32_t size);
+
+#endif /* CRC32_H_ */
@@ -0,0 +1,63 @@
+/*
+ * loader_journal.h
+ *
+ * On-flash progress journal of a programming session, in the last sector
+ * of the device, so that an interrupted session can resume instead of
+ * starting over. JournalOpen() binds the journal to an image identifier
+ * chosen by the host; from then on SectorErase(), Write() and Verify()
+ * record the sectors they complete, and JournalResume() returns the first
+ * sector not yet at a given stage.
+ *
+ *   page 0                 Journal_HeaderTypeDef
+ *   page 1 + stage         one bit per sector, cleared once it is reached
+ *
+ * Bits are only ever cleared, each by a page program of the bytes that
+ * change, so the sector is erased only when a different image opens it.
+ * A restarted session redoes every stage from the returned sector on.
+ *
+ * With LOADER_JOURNAL set to 1 the sector is left out of StorageInfo.
+ * With 0 the hooks compile to nothing and the exports are not built.
+ */
+#ifndef LOADER_JOURNAL_H_
+#define LOADER_JOURNAL_H_
+
+#include "quadspi.h"
+
+#ifndef LOADER_JOURNAL
+#define LOADER_JOURNAL          0
+#endif
+#define JOURNAL_RESERVED        (LOADER_JOURNAL ? MEMORY_SECTOR_SIZE : 0)
+#define JOURNAL_ADDRESS         (MEMORY_FLASH_SIZE - MEMORY_SECTOR_SIZE)
+#define JOURNAL_SECTORS         (JOURNAL_ADDRESS / MEMORY_SECTOR_SIZE)
+#define JOURNAL_BITMAP_SIZE     (JOURNAL_SECTORS / 8 + 1)
+#define JOURNAL_MAGIC           0x4C4E524A  /* "JRNL" */
+
+/*Stages a sector goes through, in order*/
+typedef enum {
+    JOURNAL_ERASED = 0,
+    JOURNAL_PROGRAMMED,
+    JOURNAL_VERIFIED,
+    JOURNAL_STAGES
+} Journal_StageTypeDef;
+
+typedef struct {
+    uint32_t magic;                 /* JOURNAL_MAGIC */
+    uint32_t image_id;              /* chosen by the host, e.g. the image CRC-32 */
+    uint32_t sector_count;          /* JOURNAL_SECTORS */
+    uint32_t crc;                   /* CRC-32 of the fields above */
+} Journal_HeaderTypeDef;
+
+#if LOADER_JOURNAL
+/*Record [address, address + size) as done; ranges continuing the previous
+ *one of the stage complete the sectors they share with it*/
+void Journal_Progress(Journal_StageTypeDef stage, uint32_t address, uint32_t size);
+void Journal_MassErased(void);
+
+#define JOURNAL_PROGRESS(stage, address, size)  Journal_Progress((stage), (address), (size))
+#define JOURNAL_MASS_ERASED()                   Journal_MassErased()
+#else
+#define JOURNAL_PROGRESS(stage, address, size)
+#define JOURNAL_MASS_ERASED()
+#endif
+
+#endif /* LOADER_JOURNAL_H_ */
@@ -0,0 +1,35 @@
+/*
+ * loader_lean.h
+ *
+ * Register-level clock, GPIO and QUADSPI drivers of the lean loader build
+ * (LOADER_LEAN). They replace the HAL calls the loader makes with the same
+ * register sequences and keep the same state in hqspi, so with
+ * --gc-sections the HAL RCC, QSPI, MDMA and UART code drops out of the
+ * image. The lean build runs polled: pages are programmed without the
+ * interrupt-driven command queue and Verify() compares without MDMA.
+ */
+#ifndef LOADER_LEAN_H_
+#define LOADER_LEAN_H_
+
+#include "main.h"
+
+#if LOADER_LEAN
+/*HAL_Init() and SystemClock_Config(): SysTick, LDO, VOS0, PLL1 from HSE at 480 MHz*/
+void Lean_Init(void);
+
+/*HAL_QSPI_DeInit() and MX_QUADSPI_Init(): PLL2R kernel clock, pins, CR and DCR*/
+HAL_StatusTypeDef Lean_QSPI_Init(QSPI_HandleTypeDef* hqspi);
+
+HAL_StatusTypeDef Lean_QSPI_Command(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                                    uint32_t Timeout);
+HAL_StatusTypeDef Lean_QSPI_Transmit(QSPI_HandleTypeDef* hqspi, uint8_t* pData, uint32_t Timeout);
+HAL_StatusTypeDef Lean_QSPI_Receive(QSPI_HandleTypeDef* hqspi, uint8_t* pData, uint32_t Timeout);
+HAL_StatusTypeDef Lean_QSPI_AutoPolling(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                                        QSPI_AutoPollingTypeDef* cfg, uint32_t Timeout);
+HAL_StatusTypeDef Lean_QSPI_MemoryMapped(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                                         QSPI_MemoryMappedTypeDef* cfg);
+HAL_StatusTypeDef Lean_QSPI_Abort(QSPI_HandleTypeDef* hqspi);
+HAL_StatusTypeDef Lean_QSPI_SetFlashID(QSPI_HandleTypeDef* hqspi, uint32_t FlashID);
+#endif
+
+#endif /* LOADER_LEAN_H_ */
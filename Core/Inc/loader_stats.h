@@ -0,0 +1,83 @@
+/*
+ * loader_stats.h
+ *
+ * DWT cycle counter instrumentation of the loader entry points and of the
+ * QSPI phases below them. The table sits at LOADER_STATS_ADDRESS, where
+ * the host reads it after a session; it survives the repeated Init()
+ * calls of a session and is restarted by clearing its Magic. With
+ * LOADER_STATS set to 0 every hook compiles to nothing.
+ */
+#ifndef LOADER_STATS_H_
+#define LOADER_STATS_H_
+
+#include "main.h"
+
+#define LOADER_STATS            1
+#define LOADER_STATS_ADDRESS    0x2001C000  /* start of RAM_DIAG at the top of DTCM, see linker.ld */
+#define STATS_MAGIC             0x53544154  /* "STAT" */
+#define STATS_HISTOGRAM_BINS    32          /* bin n: 2^n to 2^(n+1)-1 cycles */
+
+/*Instrumented operations*/
+typedef enum {
+    STATS_INIT = 0,
+    STATS_WRITE,
+    STATS_SECTOR_ERASE,
+    STATS_MASS_ERASE,
+    STATS_CHECKSUM,
+    STATS_VERIFY,
+    STATS_WRITE_ENABLE,         /* WREN and write enable latch polling */
+    STATS_COMMAND,              /* command phase */
+    STATS_TRANSMIT,             /* data phase of a page program */
+    STATS_AUTO_POLL,            /* busy polling after program or erase */
+    STATS_ABORT,                /* HAL_QSPI_Abort() */
+    STATS_MEMORY_MAPPED,        /* memory-mapped entry */
+    STATS_COUNT
+} Stats_IdTypeDef;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t reserved;
+    uint64_t total;
+    uint32_t histogram[STATS_HISTOGRAM_BINS];
+} Stats_EntryTypeDef;
+
+typedef struct {
+    uint32_t magic;                 /* STATS_MAGIC, cleared by the host to restart */
+    uint32_t cpu_hz;                /* cycle counter frequency */
+    uint32_t entry_count;           /* STATS_COUNT */
+    uint32_t entry_size;            /* sizeof(Stats_EntryTypeDef) */
+    Stats_EntryTypeDef entry[STATS_COUNT];
+} Stats_TableTypeDef;
+
+/*Timed scope, recorded on every exit path of the enclosing block*/
+typedef struct {
+    Stats_IdTypeDef id;
+    uint32_t start;
+} Stats_ScopeTypeDef;
+
+#if LOADER_STATS
+extern Stats_TableTypeDef loader_stats;
+
+void Stats_Init(void);
+void Stats_Record(Stats_IdTypeDef id, uint32_t cycles);
+void Stats_ScopeEnd(Stats_ScopeTypeDef* scope);
+
+#define STATS_SCOPE(id)                                                     \
+    Stats_ScopeTypeDef stats_scope __attribute__((cleanup(Stats_ScopeEnd))) \
+        = { (id), DWT->CYCCNT }
+#define STATS_TIMED(id, call)                                               \
+    ({                                                                      \
+        uint32_t stats_start = DWT->CYCCNT;                                 \
+        __typeof__(call) stats_result = (call);                             \
+        Stats_Record((id), DWT->CYCCNT - stats_start);                      \
+        stats_result;                                                       \
+    })
+#else
+#define Stats_Init()
+#define STATS_SCOPE(id)
+#define STATS_TIMED(id, call)   (call)
+#endif
+
+#endif /* LOADER_STATS_H_ */
@@ -0,0 +1,32 @@
+/*
+ * loader_tcm.h
+ *
+ * Placement of the loader's hot paths in the tightly coupled memories.
+ * Functions marked LOADER_ITCM are linked at their ITCM address and
+ * loaded after the image in RAM_D1; each exported entry point calls
+ * Tcm_Init() first, which copies them in once per download. Buffers marked LOADER_DTCM are scratch in DTCM:
+ * not loaded, not cleared, and never holding data across calls. Both
+ * keep the CPU off the AXI SRAM the debugger writes buffers into. The
+ * linker scripts also move the HAL QSPI driver and the interrupt
+ * handlers to ITCM and check the layout at link time.
+ *
+ * With LOADER_TCM set to 0 the attributes compile to nothing.
+ */
+#ifndef LOADER_TCM_H_
+#define LOADER_TCM_H_
+
+#ifndef LOADER_TCM
+#define LOADER_TCM              1
+#endif
+
+#if LOADER_TCM
+#define LOADER_ITCM             __attribute__((section(".itcm_text"), noinline))
+#define LOADER_DTCM             __attribute__((section(".dtcm_bss")))
+#else
+#define LOADER_ITCM
+#define LOADER_DTCM
+#endif
+
+void Tcm_Init(void);
+
+#endif /* LOADER_TCM_H_ */
@@ -0,0 +1,68 @@
+/*
+ * loader_trace.h
+ *
+ * Ring buffer of the QSPI commands issued by the loader, with DWT cycle
+ * timestamps. It sits at LOADER_TRACE_ADDRESS in RAM_DIAG and is decoded
+ * on the host by Tools/trace_decode.py. Like the statistics table it
+ * survives the Init() calls of a session and restarts when the host
+ * clears its Magic. With LOADER_TRACE set to 0 the hooks compile to
+ * nothing.
+ */
+#ifndef LOADER_TRACE_H_
+#define LOADER_TRACE_H_
+
+#include "main.h"
+
+#define LOADER_TRACE            1
+#define LOADER_TRACE_ADDRESS    0x2001D000  /* RAM_DIAG, after the statistics table */
+#define TRACE_MAGIC             0x43525451  /* "QTRC" */
+#define TRACE_CAPACITY          512         /* entries, a power of two */
+
+/*Kind of step*/
+#define TRACE_KIND_COMMAND      0   /* command, with the data phase configured only */
+#define TRACE_KIND_TRANSMIT     1   /* data phase, write */
+#define TRACE_KIND_RECEIVE      2   /* data phase, read */
+#define TRACE_KIND_POLL         3   /* automatic status polling */
+#define TRACE_KIND_MAPPED       4   /* memory-mapped mode entry */
+#define TRACE_KIND_ABORT        5   /* HAL_QSPI_Abort(), no opcode */
+
+/*Line counts in Lines, two bits per phase: 0 none, 1, 2 or 3 for four lines*/
+#define TRACE_LINES_INSTRUCTION_Pos 0
+#define TRACE_LINES_ADDRESS_Pos     2
+#define TRACE_LINES_DATA_Pos        4
+
+typedef struct {
+    uint8_t Opcode;
+    uint8_t Kind;               /* TRACE_KIND_* */
+    uint8_t Lines;              /* TRACE_LINES_* fields */
+    uint8_t Status;             /* HAL status, 0xFF while in progress */
+    uint32_t Address;           /* 0 without an address phase */
+    uint32_t Length;            /* data bytes, 0 without a data phase */
+    uint32_t Start;             /* DWT cycles */
+    uint32_t End;
+} Trace_EntryTypeDef;
+
+typedef struct {
+    uint32_t Magic;             /* TRACE_MAGIC, cleared by the host to restart */
+    uint32_t CpuHz;             /* cycle counter frequency */
+    uint32_t Capacity;          /* TRACE_CAPACITY */
+    uint32_t Head;              /* entries written, the newest is (Head - 1) % Capacity */
+    Trace_EntryTypeDef Entry[TRACE_CAPACITY];
+} Trace_RingTypeDef;
+
+#if LOADER_TRACE
+extern Trace_RingTypeDef loader_trace;
+
+void Trace_Init(void);
+uint32_t Trace_Begin(const QSPI_CommandTypeDef* cmd, uint8_t kind);
+void Trace_End(uint32_t slot, uint8_t status);
+
+#define TRACE_BEGIN(cmd, kind)      Trace_Begin((cmd), (kind))
+#define TRACE_END(slot, status)     Trace_End((slot), (status))
+#else
+#define Trace_Init()
+#define TRACE_BEGIN(cmd, kind)      0
+#define TRACE_END(slot, status)     ((void) (slot))
+#endif
+
+#endif /* LOADER_TRACE_H_ */
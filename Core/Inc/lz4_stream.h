@@ -0,0 +1,29 @@
+/*
+ * lz4_stream.h
+ *
+ * Decoder for the compressed image stream accepted by WriteCompressed().
+ *
+ * The stream is a sequence of frames, each made of a header followed by an
+ * LZ4 block (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+ * Blocks are independent of each other, so the decoder never needs more
+ * history than one decoded block. Tools/lz4_frames.py produces the stream.
+ */
+#ifndef LZ4_STREAM_H_
+#define LZ4_STREAM_H_
+
+#include <stdint.h>
+
+#define LZ4_FRAME_MAGIC         0x46345A4C  /* "LZ4F" */
+#define LZ4_BLOCK_MAX_SIZE      0x4000      /* decoded bytes per frame */
+
+struct LZ4_FrameHeader {
+    uint32_t Magic;             // LZ4_FRAME_MAGIC
+    uint32_t RawSize;           // Decoded size, at most LZ4_BLOCK_MAX_SIZE
+    uint32_t CompressedSize;    // Size of the LZ4 block following the header
+    uint32_t Crc;               // CRC-32 of the LZ4 block
+};
+
+int32_t LZ4_DecodeBlock(const uint8_t* src, uint32_t src_size,
+                        uint8_t* dst, uint32_t dst_capacity);
+
+#endif /* LZ4_STREAM_H_ */
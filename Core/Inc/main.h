@@ -53,13 +53,21 @@ extern "C" {
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
-
+void MPU_Config(void);
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
 
 /* USER CODE BEGIN Private defines */
+#define USE_CACHE                   1   /* MPU profile with I-Cache and D-Cache enabled */
+#ifndef LOADER_LEAN
+#define LOADER_LEAN                 0   /* register-level clock and QSPI drivers, set by the Lean build */
+#endif
 
+/*MPU regions*/
+#define MPU_REGION_QSPI_BACKGROUND  MPU_REGION_NUMBER0  /* whole QSPI bank, no access */
+#define MPU_REGION_QSPI_MAPPED      MPU_REGION_NUMBER1  /* flash window, only while memory-mapped */
+#define MPU_REGION_RAM_D1           MPU_REGION_NUMBER2  /* loader image and buffers */
 /* USER CODE END Private defines */
 
 #ifdef __cplusplus
@@ -0,0 +1,50 @@
+/*
+ * microbench.h
+ *
+ * Microbenchmarks of the loader's CPU kernels: CheckSum(), the Verify()
+ * compare, blank detection and page planning, each over a range of sizes
+ * with aligned and misaligned buffers. The same code runs on the target,
+ * timed with the DWT cycle counter, and in the host simulator, timed with
+ * the monotonic clock (MICROBENCH_HOST). Results are plain records, one
+ * CSV line each, compared against a baseline by Tools/microbench_compare.py.
+ *
+ * On the target, set MICROBENCH to 1 and link the application with
+ * STM32H750XBHX_RAM.ld: main.c runs the sweep before its self test,
+ * prints the records on USART1 and keeps them in microbench_results.
+ */
+#ifndef MICROBENCH_H_
+#define MICROBENCH_H_
+
+#include <stdint.h>
+
+#ifndef MICROBENCH
+#define MICROBENCH              0           /* build the kernel benchmarks, run by main.c */
+#endif
+#define MICROBENCH_BUFFER_SIZE  0x20000     /* per buffer on the target, sizes above are skipped */
+#define MICROBENCH_MAX_RESULTS  160
+#define MICROBENCH_CSV_HEADER   "kernel,align,size,repeats,ticks,ticks_hz\n"
+
+typedef enum {
+    MICROBENCH_CHECKSUM = 0,
+    MICROBENCH_COMPARE,
+    MICROBENCH_BLANK,
+    MICROBENCH_PLAN,
+    MICROBENCH_KERNELS
+} Microbench_KernelTypeDef;
+
+typedef struct {
+    uint8_t kernel;
+    uint8_t misaligned;             /* buffers off by 1 and 3 bytes, plan off by 1 */
+    uint16_t reserved;
+    uint32_t size;
+    uint32_t repeats;
+    uint32_t ticks;                 /* fastest call, timer overhead removed */
+    uint32_t ticks_hz;              /* CPU clock on the target, 1 GHz on the host */
+} Microbench_ResultTypeDef;
+
+/*Sweep every kernel over the sizes that fit capacity bytes per buffer*/
+uint32_t Microbench_Run(uint8_t* a, uint8_t* b, uint32_t capacity,
+                        Microbench_ResultTypeDef* results, uint32_t max_results);
+int Microbench_Format(const Microbench_ResultTypeDef* result, char* line, uint32_t length);
+
+#endif /* MICROBENCH_H_ */
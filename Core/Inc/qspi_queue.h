@@ -0,0 +1,38 @@
+/*
+ * qspi_queue.h
+ *
+ * Descriptor queue executed from the QUADSPI interrupt. Producers push
+ * command, transmit and polling steps and continue while the engine
+ * starts each step from the completion callback of the previous one, or
+ * from QSPI_Queue_Wait() when the peripheral is still BUSY at that point,
+ * so that the interrupt never spins. Only the HAL QSPI API is used, so
+ * the engine runs unchanged against a simulated interrupt source.
+ */
+#ifndef QSPI_QUEUE_H_
+#define QSPI_QUEUE_H_
+
+#include "main.h"
+
+#define QSPI_QUEUE_DEPTH    8       /* descriptors, a power of two */
+
+/*Queue steps and the callback completing them*/
+typedef enum {
+    QSPI_QUEUE_CMD = 0,             /* command without data, CmdCplt */
+    QSPI_QUEUE_TX,                  /* command followed by data, TxCplt */
+    QSPI_QUEUE_POLL                 /* automatic polling, StatusMatch */
+} QSPI_QueueOpTypeDef;
+
+typedef struct {
+    QSPI_QueueOpTypeDef op;
+    QSPI_CommandTypeDef command;
+    QSPI_AutoPollingTypeDef polling;    /* QSPI_QUEUE_POLL only */
+    uint8_t* data;                      /* QSPI_QUEUE_TX only, NbData bytes */
+} QSPI_QueueDescTypeDef;
+
+uint8_t QSPI_Queue_Push(const QSPI_QueueDescTypeDef* desc);
+uint8_t QSPI_Queue_Wait(uint32_t Timeout);
+uint8_t QSPI_Queue_IsIdle(void);
+uint32_t QSPI_Queue_Completed(void);
+void QSPI_Queue_Reset(void);
+
+#endif /* QSPI_QUEUE_H_ */
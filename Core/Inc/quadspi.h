@@ -35,11 +35,75 @@ extern "C" {
 extern QSPI_HandleTypeDef hqspi;
 
 /* USER CODE BEGIN Private defines */
+/*Operating mode of the QUADSPI peripheral as tracked by the driver*/
+typedef enum {
+    QSPI_MODE_IDLE = 0,
+    QSPI_MODE_INDIRECT,
+    QSPI_MODE_AUTO_POLLING,
+    QSPI_MODE_MEMORY_MAPPED
+} QSPI_ModeTypeDef;
+
+/*Read command used by indirect reads and the memory-mapped mode*/
+typedef enum {
+    QSPI_READ_1_1_4 = 0,            /* 0x6B, quad output fast read (default) */
+    QSPI_READ_1_4_4,                /* 0xEB, quad input/output fast read */
+    QSPI_READ_1_1_4_DTR,            /* 0x6D, DTR quad output fast read */
+    QSPI_READ_1_4_4_DTR,            /* 0xED, DTR quad input/output fast read */
+    QSPI_READ_MODES
+} QSPI_ReadModeTypeDef;
+
+/*Mode transition counters*/
+typedef struct {
+    uint32_t aborts;                /* HAL_QSPI_Abort() calls issued */
+    uint32_t indirect_entries;      /* transitions into indirect mode */
+    uint32_t memory_mapped_entries; /* transitions into memory-mapped mode */
+    uint32_t skipped_transitions;   /* requests already satisfied by the current mode */
+} QSPI_ModeStatsTypeDef;
+
+extern QSPI_ModeStatsTypeDef qspi_mode_stats;
+
+/*Contiguous run of data programmed since the last discontinuity or erase*/
+typedef struct {
+    uint32_t start;                 /* first flash offset of the run */
+    uint32_t end;                   /* flash offset following the run */
+    uint32_t sum;                   /* byte sum of the data, as CheckSum() computes it */
+    uint32_t crc;                   /* CRC-32 of the data, when QSPI_PROGRAM_CRC is set */
+} QSPI_ProgramRunTypeDef;
+
+/*Page program transfer of a write, as produced by CSP_QSPI_PlanNext()*/
+typedef struct {
+    uint32_t address;               /* flash offset of the transfer */
+    uint32_t offset;                /* offset of its data in the source buffer */
+    uint32_t size;                  /* transfer size, never crossing a page boundary */
+    uint32_t end;                   /* flash offset following the whole write */
+} QSPI_PagePlanTypeDef;
+
+/*Program or erase failure reported by the flag status register*/
+typedef struct {
+    uint32_t status;                /* flag status register, QSPI_FSR_* bits */
+    uint32_t address;               /* page or sector being programmed or erased */
+    uint32_t count;                 /* failures since start-up */
+} QSPI_FlagErrorTypeDef;
+
 uint8_t CSP_QUADSPI_Init(void);
 uint8_t CSP_QSPI_EraseSector(uint32_t EraseStartAddress, uint32_t EraseEndAddress);
+uint8_t CSP_QSPI_StartErase(uint32_t address);
+uint8_t CSP_QSPI_PollBusy(uint32_t* busy);
 uint8_t CSP_QSPI_WriteMemory(uint8_t* buffer, uint32_t address, uint32_t buffer_size);
+uint8_t CSP_QSPI_WriteUntracked(uint8_t* buffer, uint32_t address, uint32_t buffer_size);
 uint8_t CSP_QSPI_EnableMemoryMappedMode(void);
+uint32_t CSP_QSPI_MapAddress(uint32_t address, uint32_t* size);
+uint8_t CSP_QSPI_EnterIndirectMode(void);
+QSPI_ModeTypeDef CSP_QSPI_GetMode(void);
+uint8_t CSP_QSPI_SetReadMode(QSPI_ReadModeTypeDef mode);
+QSPI_ReadModeTypeDef CSP_QSPI_GetReadMode(void);
 uint8_t CSP_QSPI_Erase_Chip (void);
+uint8_t CSP_QSPI_ReadMemory(uint8_t* buffer, uint32_t address, uint32_t buffer_size);
+uint8_t CSP_QSPI_IsRangeVerified(uint32_t address, const uint8_t* buffer, uint32_t size);
+void CSP_QSPI_GetProgramRun(QSPI_ProgramRunTypeDef* run);
+void CSP_QSPI_PlanInit(QSPI_PagePlanTypeDef* plan, uint32_t address, uint32_t size);
+uint8_t CSP_QSPI_PlanNext(QSPI_PagePlanTypeDef* plan);
+void CSP_QSPI_GetFlagError(QSPI_FlagErrorTypeDef* error);
 /* USER CODE END Private defines */
 
 void MX_QUADSPI_Init(void);
@@ -47,9 +111,22 @@ void MX_QUADSPI_Init(void);
 /* USER CODE BEGIN Prototypes */
 
 /*MT25QL512 memory parameters*/
-#define MEMORY_FLASH_SIZE               0x4000000 /* 512 MBits*/
+#define MEMORY_CHIP_SIZE                0x4000000 /* 512 MBits*/
+#define MEMORY_FLASH_SIZE               (MEMORY_CHIP_SIZE * QSPI_CHIPS)
 #define MEMORY_SECTOR_SIZE              0x10000  /* 64kBytes */
 #define MEMORY_PAGE_SIZE                0x100   /* 256 bytes */
+#define MEMORY_MAPPED_ADDRESS           0x90000000
+
+/*Loader options*/
+#define QSPI_WRITE_READBACK_VERIFY      1       /* read back every page right after programming */
+#define QSPI_WRITE_DIGESTS              64      /* writes whose CRC-32 Verify() can match without reading */
+#define QSPI_DCACHE_RANGE_LIMIT         0x4000  /* invalidate the whole D-Cache above this size */
+#define QSPI_PROGRAM_POLL_IT            (!LOADER_LEAN) /* program pages through the interrupt-driven command queue */
+#define QSPI_PROGRAM_CRC                1       /* CRC-32 of programmed data, computed while busy */
+#ifndef QSPI_CONCAT
+#define QSPI_CONCAT                     0       /* second chip on the BK2 pins, mapped after the first */
+#endif
+#define QSPI_CHIPS                      (QSPI_CONCAT ? 2 : 1)
 
 
 /*MT25QL512 commands */
@@ -62,9 +139,29 @@ void MX_QUADSPI_Init(void);
 #define QUAD_IN_FAST_PROG_CMD 0x32
 #define READ_CONFIGURATION_REG_CMD 0x85
 #define QUAD_OUT_FAST_READ_CMD 0x6B
+#define QUAD_INOUT_FAST_READ_CMD 0xEB
+#define DTR_QUAD_OUT_FAST_READ_CMD 0x6D
+#define DTR_QUAD_INOUT_FAST_READ_CMD 0xED
 #define DUMMY_CLOCK_CYCLES_READ_QUAD 10
 #define RESET_ENABLE_CMD 0x66
 #define RESET_EXECUTE_CMD 0x99
+#define READ_FLAG_STATUS_REG_CMD 0x70
+#define CLEAR_FLAG_STATUS_REG_CMD 0x50
+
+/*MT25QL512 flag status register*/
+#define QSPI_FSR_READY                  0x80    /* program/erase controller ready */
+#define QSPI_FSR_ERASE_ERROR            0x20
+#define QSPI_FSR_PROGRAM_ERROR          0x10
+#define QSPI_FSR_PROTECTION_ERROR       0x02
+#define QSPI_FSR_ERRORS                 (QSPI_FSR_ERASE_ERROR | QSPI_FSR_PROGRAM_ERROR \
+                                         | QSPI_FSR_PROTECTION_ERROR)
+
+/*Automatic polling intervals in QUADSPI clock cycles, scaled to the typical
+ *duration of each operation (~20 MHz clock)*/
+#define QSPI_POLL_INTERVAL_WEL          0x10    /* write enable latch, immediate */
+#define QSPI_POLL_INTERVAL_PROGRAM      0x20    /* page program, ~120 us */
+#define QSPI_POLL_INTERVAL_SECTOR_ERASE 0x2000  /* 64 KB sector erase, ~150 ms */
+#define QSPI_POLL_INTERVAL_CHIP_ERASE   0xFFFF  /* chip erase, minutes */
 
 /*MT25QL512 timeouts*/
 #define QUADSPI_MAX_ERASE_TIMEOUT 460000 /* 460s max */
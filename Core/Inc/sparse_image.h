@@ -0,0 +1,44 @@
+/*
+ * sparse_image.h
+ *
+ * Sparse image descriptor consumed by WriteSparse() and produced by
+ * Tools/sparse_pack.py or ReadSparse(). All fields are little-endian.
+ *
+ *   struct SparseHeader
+ *   struct SparseSegment[SegmentCount]   ascending, non-overlapping
+ *   uint8_t data[DataSize]               payload of the SPARSE_DATA runs
+ */
+#ifndef SPARSE_IMAGE_H_
+#define SPARSE_IMAGE_H_
+
+#include <stdint.h>
+
+#define SPARSE_MAGIC    0x53505253  /* "SPRS" */
+
+/*Segment types*/
+#define SPARSE_DATA     1           /* Value: offset of the run in the data area */
+#define SPARSE_FILL     2           /* Value: 4-byte pattern repeated over the run */
+#define SPARSE_ERASED   3           /* run of erased value, erase only */
+
+/*ReadSparse() output: erased runs are found per aligned block*/
+#define SPARSE_READ_BLOCK           0x1000
+#define SPARSE_READ_SEGMENTS(size)  ((size) / SPARSE_READ_BLOCK + 2)
+#define SPARSE_READ_BOUND(size)     (16 + SPARSE_READ_SEGMENTS(size) * 20 + (size))
+
+struct SparseHeader {
+    uint32_t Magic;                 // SPARSE_MAGIC
+    uint32_t SegmentCount;          // Number of segments
+    uint32_t DataSize;              // Size of the data area
+    uint32_t Crc;                   // CRC-32 of everything following the header
+};
+
+struct SparseSegment {
+    uint32_t Type;                  // SPARSE_DATA, SPARSE_FILL or SPARSE_ERASED
+    uint32_t Address;               // Flash offset of the run
+    uint32_t Size;                  // Size of the run in bytes
+    uint32_t Value;                 // Type dependent, see above
+    uint16_t FirstSector;           // First sector touched by the run
+    uint16_t SectorCount;           // Number of sectors touched by the run
+};
+
+#endif /* SPARSE_IMAGE_H_ */
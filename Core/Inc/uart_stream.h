@@ -0,0 +1,88 @@
+/*
+ * uart_stream.h
+ *
+ * Image download over USART1 for fixtures without a debugger. USART1
+ * receives by DMA into a circular ring that the engine polls; frames carry
+ * a CRC-32 each and the sender keeps at most UART_STREAM_WINDOW data
+ * frames unacknowledged. Sectors are erased ahead of the data, without
+ * waiting, and blocks are programmed as soon as their sectors are erased,
+ * so the link keeps running while the flash is busy. Tools/uart_stream.py
+ * is the sender; Tools/hostsim/uart_dev runs the engine on the simulator
+ * behind a pseudo-terminal.
+ *
+ * Frame, little endian:
+ *   sync (0x5A), type, seq (16 bits), length (16 bits), payload, CRC-32
+ * with the CRC over type to the end of the payload (crc32.h).
+ *
+ *   OPEN   address, size, CRC-32 of the image (3 x 32 bits)
+ *   DATA   block seq of the image, UART_STREAM_BLOCK_SIZE bytes but the last
+ *   DONE   no payload, sent once every block is acknowledged
+ *
+ * Replies carry the request type | UART_STREAM_REPLY, seq holding the
+ * blocks programmed so far and the payload a status byte, followed by the
+ * block size and window (16 bits each) for OPEN and the CRC-32 read back
+ * for DONE. Data frames are acknowledged once programmed, which is what
+ * opens the window again. A damaged or missing frame is answered by a
+ * DATA reply with UART_STREAM_RESEND and seq the block to send next, from
+ * which the sender goes back. The sectors the image touches are erased
+ * whole.
+ *
+ * Set UART_STREAM to 1 for main.c to serve downloads instead of running
+ * the throughput benchmark.
+ */
+#ifndef UART_STREAM_H_
+#define UART_STREAM_H_
+
+#include "main.h"
+
+#ifndef UART_STREAM
+#define UART_STREAM             0           /* serve image downloads on USART1 */
+#endif
+#define UART_STREAM_BAUD        3000000     /* USART1 kernel clock / 40 */
+#define UART_STREAM_BLOCK_SIZE  0x400       /* data bytes per frame, four pages */
+#define UART_STREAM_WINDOW      48          /* frames in flight, covers one 150 ms sector erase */
+#define UART_STREAM_RING_SIZE   0xF000      /* DMA ring, a window of frames within the 16-bit count */
+#define UART_STREAM_TIMEOUT     2000        /* ms without a frame that ends a session */
+
+#define UART_STREAM_SYNC        0x5A
+#define UART_STREAM_HEADER      6           /* sync, type, seq, length */
+#define UART_STREAM_TRAILER     4           /* CRC-32 */
+
+#define UART_STREAM_OPEN        0x01
+#define UART_STREAM_DATA        0x02
+#define UART_STREAM_DONE        0x03
+#define UART_STREAM_REPLY       0x80
+
+typedef enum {
+    UART_STREAM_OK = 0,
+    UART_STREAM_RESEND,                     /* frame lost or damaged, send again from seq */
+    UART_STREAM_RANGE,                      /* image outside the flash */
+    UART_STREAM_FLASH,                      /* erase or program failed */
+    UART_STREAM_MISMATCH,                   /* CRC-32 read back differs from OPEN */
+    UART_STREAM_TIMEOUT_ERROR,              /* sender went quiet mid-session */
+} UartStream_StatusTypeDef;
+
+/*Progress of the current or last session, kept for the debugger*/
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+    uint32_t crc;                           /* expected, from OPEN */
+    uint32_t blocks;                        /* data frames accepted */
+    uint32_t programmed;                    /* bytes programmed */
+    uint32_t erase_next;                    /* next sector to erase, flash offset */
+    uint32_t erases;                        /* sectors erased */
+    uint32_t resends;                       /* resend requests sent */
+    uint32_t bad_frames;                    /* CRC or length errors */
+    uint32_t overruns;                      /* receiver overruns cleared */
+    uint32_t start_tick;
+    uint32_t end_tick;
+    uint8_t status;                         /* UartStream_StatusTypeDef */
+} UartStream_SessionTypeDef;
+
+extern UartStream_SessionTypeDef uart_stream_session;
+
+/*Serve one download, from OPEN to DONE or the first error; huart must have
+ *its receive DMA linked in circular mode*/
+uint8_t UartStream_Run(UART_HandleTypeDef* huart);
+
+#endif /* UART_STREAM_H_ */
@@ -4,6 +4,7 @@
  */
 #include "Dev_Inf.h"
 #include "quadspi.h"
+#include "loader_journal.h"
 
 /* This structure contains information used by ST-LINK Utility to program and erase the device */
 #if defined (__ICCARM__)
@@ -14,13 +15,13 @@ struct StorageInfo const StorageInfo = {
     "STM32H750_QSPI_FlashLoader", 		 // Device Name + version number
     NOR_FLASH,                           // Device Type
     0x90000000,                          // Device Start Address
-    MEMORY_FLASH_SIZE,                   // Device Size in Bytes
+    MEMORY_FLASH_SIZE - JOURNAL_RESERVED, // Device Size in Bytes
     MEMORY_PAGE_SIZE,                    // Programming Page Size
     0xFF,                                // Initial Content of Erased Memory
 
     // Specify Size and Address of Sectors (view example below)
     {   {
-            (MEMORY_FLASH_SIZE / MEMORY_SECTOR_SIZE),  // Sector Numbers,
+            ((MEMORY_FLASH_SIZE - JOURNAL_RESERVED) / MEMORY_SECTOR_SIZE),  // Sector Numbers,
             (uint32_t) MEMORY_SECTOR_SIZE
         },       //Sector Size
 
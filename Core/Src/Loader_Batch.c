@@ -0,0 +1,150 @@
+/*
+ * Loader_Batch.c
+ *
+ * RunBatch() entry point: executes a RAM-resident list of operations in a
+ * single debugger call, recording status, result and timing per operation.
+ */
+#include "Loader_Src.h"
+#include "quadspi.h"
+#include "loader_tcm.h"
+#include "crc32.h"
+#include "batch_list.h"
+
+static uint8_t Batch_Execute(struct BatchOp* op, const uint8_t* data, uint32_t DataSize);
+static uint8_t Batch_Verify(struct BatchOp* op, const uint8_t* source);
+
+/**
+ * @brief   Execute an operation list, stopping at the first failure.
+ * @param   buffer : operation list, see batch_list.h
+ * @param   Size   : size of the list including its data area
+ * @retval  LOADER_OK = 1       : All operations succeeded
+ * @retval  LOADER_FAIL = 0 : Invalid list or failed operation
+ */
+int
+RunBatch(uint8_t* buffer, uint32_t Size) {
+
+    struct BatchHeader* header = (struct BatchHeader*) buffer;
+    struct BatchOp* ops = (struct BatchOp*) (buffer + sizeof(struct BatchHeader));
+    uint32_t DataSize, start, i;
+
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
+
+    Loader_InvalidateBuffer((uintptr_t) buffer, Size);
+
+    if ((Size < sizeof(struct BatchHeader)) || (header->Magic != BATCH_MAGIC)
+        || (header->OpCount > (Size - sizeof(struct BatchHeader)) / sizeof(struct BatchOp))) {
+        __set_PRIMASK(1); //disable interrupts
+        return LOADER_FAIL;
+    }
+    DataSize = Size - sizeof(struct BatchHeader) - header->OpCount * sizeof(struct BatchOp);
+
+    for (i = 0; i < header->OpCount; i++) {
+        ops[i].Status = BATCH_STATUS_PENDING;
+    }
+    header->Completed = 0;
+
+    start = DWT->CYCCNT;
+    for (i = 0; i < header->OpCount; i++) {
+        ops[i].Cycles = DWT->CYCCNT;
+        ops[i].Status = Batch_Execute(&ops[i], (uint8_t*) &ops[header->OpCount], DataSize);
+        ops[i].Cycles = DWT->CYCCNT - ops[i].Cycles;
+        if (ops[i].Status != BATCH_STATUS_OK) {
+            break;
+        }
+        header->Completed++;
+    }
+    header->Cycles = DWT->CYCCNT - start;
+
+    __set_PRIMASK(1); //disable interrupts
+    return (header->Completed == header->OpCount) ? LOADER_OK : LOADER_FAIL;
+}
+
+static uint8_t
+Batch_Execute(struct BatchOp* op, const uint8_t* data, uint32_t DataSize) {
+
+    uint32_t address = op->Address & 0x0fffffff;
+    uint32_t offset, length, window;
+
+    op->Result = 0;
+    if ((op->Size == 0) || (address >= MEMORY_FLASH_SIZE)
+        || (op->Size > MEMORY_FLASH_SIZE - address)) {
+        return BATCH_STATUS_FAIL;
+    }
+    if (((op->Op == BATCH_OP_PROGRAM) || (op->Op == BATCH_OP_VERIFY))
+        && ((op->Offset > DataSize) || (op->Size > DataSize - op->Offset))) {
+        return BATCH_STATUS_FAIL;
+    }
+
+    switch (op->Op) {
+        case BATCH_OP_ERASE:
+            if (CSP_QSPI_EraseSector(address, address + op->Size - 1) != HAL_OK) {
+                return BATCH_STATUS_FAIL;
+            }
+            break;
+
+        case BATCH_OP_PROGRAM:
+            if (CSP_QSPI_WriteMemory((uint8_t*) data + op->Offset, address, op->Size) != HAL_OK) {
+                return BATCH_STATUS_FAIL;
+            }
+            break;
+
+        case BATCH_OP_FILL:
+            if (Loader_FillRange(address, op->Size, (uint8_t*) &op->Offset, 4) != HAL_OK) {
+                return BATCH_STATUS_FAIL;
+            }
+            break;
+
+        case BATCH_OP_VERIFY:
+            return Batch_Verify(op, data + op->Offset);
+
+        case BATCH_OP_CRC:
+            op->Result = CRC32_INIT;
+            for (offset = 0; offset < op->Size; offset += length) {
+                length = op->Size - offset;
+                window = CSP_QSPI_MapAddress(address + offset, &length);
+                if (window == 0) {
+                    return BATCH_STATUS_FAIL;
+                }
+                op->Result = Crc32_Update(op->Result, (uint8_t*) (uintptr_t) window, length);
+            }
+            break;
+
+        default:
+            return BATCH_STATUS_FAIL;
+    }
+
+    return BATCH_STATUS_OK;
+}
+
+/*Compare a flash range with its source, Result is the byte sum or the fail address*/
+static uint8_t
+Batch_Verify(struct BatchOp* op, const uint8_t* source) {
+
+    uint32_t address = op->Address & 0x0fffffff;
+    const uint8_t* flash;
+    uint32_t offset, length, i;
+
+    /* Pages confirmed by readback, written from this data, need no second read */
+    if (!CSP_QSPI_IsRangeVerified(address, source, op->Size)) {
+        /* A chip's window at a time */
+        for (offset = 0; offset < op->Size; offset += length) {
+            length = op->Size - offset;
+            flash = (uint8_t*) (uintptr_t) CSP_QSPI_MapAddress(address + offset, &length);
+            if (flash == NULL) {
+                return BATCH_STATUS_FAIL;
+            }
+            i = Loader_Compare(flash, source + offset, length);
+            if (i != length) {
+                op->Result = MEMORY_MAPPED_ADDRESS + address + offset + i;
+                return BATCH_STATUS_FAIL;
+            }
+        }
+    }
+
+    for (i = 0; i < op->Size; i++) {
+        op->Result += source[i];
+    }
+
+    return BATCH_STATUS_OK;
+}
@@ -0,0 +1,203 @@
+/*
+ * Loader_Journal.c
+ *
+ * JournalOpen(), JournalResume() and JournalClose() entry points and the
+ * progress hooks of the other entry points, see loader_journal.h.
+ */
+#include "Loader_Src.h"
+#include "loader_journal.h"
+#include "loader_tcm.h"
+#include "crc32.h"
+#include <stddef.h>
+#include <string.h>
+
+#if LOADER_JOURNAL
+static uint8_t Journal_Restart(uint32_t ImageId, uint8_t erase);
+static uint8_t Journal_MarkSectors(Journal_StageTypeDef stage, uint32_t first, uint32_t last);
+
+/* Copy of the bitmaps on flash, valid while the journal is open, for as
+ * long as the loader stays in RAM */
+static uint8_t journal_bitmap[JOURNAL_STAGES][JOURNAL_BITMAP_SIZE];
+static uint32_t journal_image_id;
+static uint8_t journal_open;
+
+/* Range last recorded per stage, and the sectors recorded from it */
+static uint32_t run_start[JOURNAL_STAGES];
+static uint32_t run_end[JOURNAL_STAGES];
+
+/**
+ * @brief   Open the journal for an image, keeping its progress if it
+ *          already belongs to that image and restarting it otherwise.
+ * @param   ImageId : image identifier chosen by the host
+ * @retval  LOADER_OK = 1       : Operation succeeded
+ * @retval  LOADER_FAIL = 0 : Operation failed
+ */
+int
+JournalOpen(uint32_t ImageId) {
+
+    Journal_HeaderTypeDef header;
+    uint32_t stage;
+
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
+
+    journal_open = 0;
+    memset(run_start, 0, sizeof(run_start));
+    memset(run_end, 0, sizeof(run_end));
+
+    if (CSP_QSPI_ReadMemory((uint8_t*) &header, JOURNAL_ADDRESS, sizeof(header)) != HAL_OK) {
+        __set_PRIMASK(1); //disable interrupts
+        return LOADER_FAIL;
+    }
+
+    if ((header.magic == JOURNAL_MAGIC) && (header.image_id == ImageId)
+        && (header.sector_count == JOURNAL_SECTORS)
+        && (header.crc == Crc32_Update(CRC32_INIT, (const uint8_t*) &header, offsetof(Journal_HeaderTypeDef, crc)))) {
+        for (stage = 0; stage < JOURNAL_STAGES; stage++) {
+            if (CSP_QSPI_ReadMemory(journal_bitmap[stage],
+                                    JOURNAL_ADDRESS + (1 + stage) * MEMORY_PAGE_SIZE,
+                                    JOURNAL_BITMAP_SIZE) != HAL_OK) {
+                __set_PRIMASK(1); //disable interrupts
+                return LOADER_FAIL;
+            }
+        }
+        journal_image_id = ImageId;
+        journal_open = 1;
+    } else if (Journal_Restart(ImageId, 1) != HAL_OK) {
+        __set_PRIMASK(1); //disable interrupts
+        return LOADER_FAIL;
+    }
+
+    __set_PRIMASK(1); //disable interrupts
+    return LOADER_OK;
+}
+
+/**
+ * @brief   Find where an interrupted session resumes.
+ * @param   Stage : Journal_StageTypeDef the sectors must have reached
+ * @retval  Address of the first sector short of Stage, the end of the
+ *          device area when all have reached it, 0 if the journal is not open
+ */
+uint32_t
+JournalResume(uint32_t Stage) {
+    uint32_t sector;
+
+    if (!journal_open || (Stage >= JOURNAL_STAGES)) {
+        return 0;
+    }
+
+    for (sector = 0; sector < JOURNAL_SECTORS; sector++) {
+        if (journal_bitmap[Stage][sector / 8] & (1u << (sector % 8))) {
+            break;
+        }
+    }
+    return MEMORY_MAPPED_ADDRESS + sector * MEMORY_SECTOR_SIZE;
+}
+
+/**
+ * @brief   Close the journal once the session completed or is abandoned.
+ * @retval  LOADER_OK = 1       : Operation succeeded
+ * @retval  LOADER_FAIL = 0 : Operation failed
+ */
+int
+JournalClose(void) {
+
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
+
+    journal_open = 0;
+    if (CSP_QSPI_EraseSector(JOURNAL_ADDRESS, JOURNAL_ADDRESS) != HAL_OK) {
+        __set_PRIMASK(1); //disable interrupts
+        return LOADER_FAIL;
+    }
+
+    __set_PRIMASK(1); //disable interrupts
+    return LOADER_OK;
+}
+
+/*
+ * Sectors are recorded once fully covered. The tool hands over a sector
+ * in several Write() or Verify() calls, so a range continuing the last
+ * one of its stage is treated as part of it.
+ */
+void
+Journal_Progress(Journal_StageTypeDef stage, uint32_t address, uint32_t size) {
+    uint32_t first, end;
+
+    address &= 0x0fffffff;
+    if (!journal_open || (size == 0) || (address >= JOURNAL_ADDRESS)) {
+        return;
+    }
+    if (size > JOURNAL_ADDRESS - address) {
+        size = JOURNAL_ADDRESS - address;
+    }
+
+    if ((address != run_end[stage]) || (run_end[stage] == run_start[stage])) {
+        run_start[stage] = address;
+    }
+    run_end[stage] = address + size;
+
+    first = (run_start[stage] + MEMORY_SECTOR_SIZE - 1) / MEMORY_SECTOR_SIZE;
+    end = run_end[stage] / MEMORY_SECTOR_SIZE;
+    if (first < end) {
+        /* A mark that fails to program only makes a restart redo the sector */
+        (void) Journal_MarkSectors(stage, first, end - 1);
+    }
+}
+
+/*The chip erase took the journal with it: write it again, all erased*/
+void
+Journal_MassErased(void) {
+    if (journal_open && (Journal_Restart(journal_image_id, 0) == HAL_OK)) {
+        (void) Journal_MarkSectors(JOURNAL_ERASED, 0, JOURNAL_SECTORS - 1);
+    }
+}
+
+static uint8_t
+Journal_Restart(uint32_t ImageId, uint8_t erase) {
+    Journal_HeaderTypeDef header;
+
+    journal_open = 0;
+    if (erase && (CSP_QSPI_EraseSector(JOURNAL_ADDRESS, JOURNAL_ADDRESS) != HAL_OK)) {
+        return HAL_ERROR;
+    }
+
+    header.magic = JOURNAL_MAGIC;
+    header.image_id = ImageId;
+    header.sector_count = JOURNAL_SECTORS;
+    header.crc = Crc32_Update(CRC32_INIT, (const uint8_t*) &header, offsetof(Journal_HeaderTypeDef, crc));
+    if (CSP_QSPI_WriteUntracked((uint8_t*) &header, JOURNAL_ADDRESS, sizeof(header)) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    memset(journal_bitmap, 0xFF, sizeof(journal_bitmap));
+    journal_image_id = ImageId;
+    journal_open = 1;
+    return HAL_OK;
+}
+
+/*Clear the bits of sectors first to last, programming only the bytes that change*/
+static uint8_t
+Journal_MarkSectors(Journal_StageTypeDef stage, uint32_t first, uint32_t last) {
+    uint8_t* bitmap = journal_bitmap[stage];
+    uint32_t sector, lo = JOURNAL_BITMAP_SIZE, hi = 0;
+    uint8_t value;
+
+    for (sector = first; sector <= last; sector++) {
+        value = bitmap[sector / 8] & ~(1u << (sector % 8));
+        if (value != bitmap[sector / 8]) {
+            bitmap[sector / 8] = value;
+            if (sector / 8 < lo) {
+                lo = sector / 8;
+            }
+            hi = sector / 8;
+        }
+    }
+    if (lo > hi) {
+        return HAL_OK;
+    }
+
+    return CSP_QSPI_WriteUntracked(bitmap + lo, JOURNAL_ADDRESS + (1 + stage) * MEMORY_PAGE_SIZE + lo,
+                                   hi - lo + 1);
+}
+#endif
@@ -0,0 +1,192 @@
+/*
+ * Loader_Read.c
+ *
+ * Read() and ReadSparse() entry points: fill a RAM buffer from the flash
+ * with MDMA through the memory-mapped window, in the read command set by
+ * CSP_QSPI_SetReadMode(), instead of one debugger access per word.
+ */
+#include "Loader_Src.h"
+#include "quadspi.h"
+#include "mdma.h"
+#include "loader_tcm.h"
+#include "crc32.h"
+#include "sparse_image.h"
+#include <string.h>
+
+#define READ_USE_MDMA       (!LOADER_LEAN) /* MX_MDMA_Init() runs in Init() except in the lean build */
+#define READ_MDMA_BLOCK     0x10000 /* largest MDMA block */
+#define READ_MDMA_TIMEOUT   100     /* ms per block */
+
+static uint8_t Read_Copy(uint8_t* buffer, uint32_t Address, uint32_t Size);
+static uint8_t Read_CopyWindow(uint8_t* buffer, const uint8_t* source, uint32_t Size);
+static void Read_AddSegment(uint8_t* table, uint32_t* count, uint32_t type,
+                            uint32_t Address, uint32_t Size, uint32_t value);
+
+/**
+ * @brief   Read memory.
+ * @param   Address: flash address
+ * @param   Size   : size of data
+ * @param   buffer : RAM buffer receiving the data
+ * @retval  LOADER_OK = 1       : Operation succeeded
+ * @retval  LOADER_FAIL = 0 : Operation failed
+ */
+int
+Read(uint32_t Address, uint32_t Size, uint8_t* buffer) {
+
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
+
+    Address &= 0x0fffffff;
+    if ((Address >= MEMORY_FLASH_SIZE) || (Size > MEMORY_FLASH_SIZE - Address)
+        || (Read_Copy(buffer, Address, Size) != HAL_OK)) {
+        __set_PRIMASK(1); //disable interrupts
+        return LOADER_FAIL;
+    }
+
+    __set_PRIMASK(1); //disable interrupts
+    return LOADER_OK;
+}
+
+/**
+ * @brief   Read memory as a sparse image, erased blocks as runs without data.
+ * @param   Address: flash address
+ * @param   Size   : size of the range
+ * @param   buffer : RAM buffer of SPARSE_READ_BOUND(Size) bytes receiving the
+ *                   descriptor, see sparse_image.h; WriteSparse() takes it back
+ * @retval  LOADER_OK = 1       : Operation succeeded
+ * @retval  LOADER_FAIL = 0 : Operation failed
+ */
+int
+ReadSparse(uint32_t Address, uint32_t Size, uint8_t* buffer) {
+
+    struct SparseHeader header;
+    uint8_t* table = buffer + sizeof(header);
+    uint8_t* data;
+    uint32_t count = 0, data_size = 0, run_type = 0, run_start = 0, run_value = 0;
+    uint32_t offset, length, type;
+
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
+
+    Address &= 0x0fffffff;
+    if ((Address >= MEMORY_FLASH_SIZE) || (Size > MEMORY_FLASH_SIZE - Address)) {
+        __set_PRIMASK(1); //disable interrupts
+        return LOADER_FAIL;
+    }
+
+    /* Blocks are read behind room for the largest segment table, erased
+     * ones are dropped again, and the data moves down once at the end */
+    data = table + SPARSE_READ_SEGMENTS(Size) * sizeof(struct SparseSegment);
+    for (offset = 0; offset < Size; offset += length) {
+        length = SPARSE_READ_BLOCK - (Address + offset) % SPARSE_READ_BLOCK;
+        if (length > Size - offset) {
+            length = Size - offset;
+        }
+        if (Read_Copy(data + data_size, Address + offset, length) != HAL_OK) {
+            __set_PRIMASK(1); //disable interrupts
+            return LOADER_FAIL;
+        }
+
+        type = Loader_IsBlank(data + data_size, length) ? SPARSE_ERASED : SPARSE_DATA;
+        if (type != run_type) {
+            if (run_type) {
+                Read_AddSegment(table, &count, run_type, Address + run_start,
+                                offset - run_start, run_value);
+            }
+            run_type = type;
+            run_start = offset;
+            run_value = (type == SPARSE_DATA) ? data_size : 0;
+        }
+        if (type == SPARSE_DATA) {
+            data_size += length;
+        }
+    }
+    if (run_type) {
+        Read_AddSegment(table, &count, run_type, Address + run_start, Size - run_start, run_value);
+    }
+
+    memmove(table + count * sizeof(struct SparseSegment), data, data_size);
+
+    header.Magic = SPARSE_MAGIC;
+    header.SegmentCount = count;
+    header.DataSize = data_size;
+    header.Crc = Crc32_Update(CRC32_INIT, table, count * sizeof(struct SparseSegment) + data_size);
+    memcpy(buffer, &header, sizeof(header));
+
+    Loader_CleanBuffer((uintptr_t) buffer,
+                       sizeof(header) + count * sizeof(struct SparseSegment) + data_size);
+
+    __set_PRIMASK(1); //disable interrupts
+    return LOADER_OK;
+}
+
+/*Copy from the memory-mapped flash, through the window of each chip the range touches*/
+static uint8_t
+Read_Copy(uint8_t* buffer, uint32_t Address, uint32_t Size) {
+    uint32_t window, length;
+
+    for (; Size != 0; Size -= length) {
+        length = Size;
+        window = CSP_QSPI_MapAddress(Address, &length);
+        if ((window == 0) || (Read_CopyWindow(buffer, (uint8_t*) (uintptr_t) window, length) != HAL_OK)) {
+            return HAL_ERROR;
+        }
+        buffer += length;
+        Address += length;
+    }
+
+    return HAL_OK;
+}
+
+/*Copy out of the mapped window, MDMA for the word aligned middle part*/
+static uint8_t
+Read_CopyWindow(uint8_t* buffer, const uint8_t* source, uint32_t Size) {
+    uint32_t head = 0;
+
+#if READ_USE_MDMA
+    uint32_t length, block;
+
+    /* MDMA moves words: source and destination must share their alignment */
+    if (((uintptr_t) source % 4) == ((uintptr_t) buffer % 4)) {
+        head = (4 - (uintptr_t) buffer % 4) % 4;
+        if (head > Size) {
+            head = Size;
+        }
+        memcpy(buffer, source, head);
+
+        /* No dirty line may be written back over what MDMA stores */
+        Loader_CleanBuffer((uintptr_t) buffer, Size);
+        for (length = (Size - head) & ~3u; length; ) {
+            block = (length < READ_MDMA_BLOCK) ? length : READ_MDMA_BLOCK;
+            if ((HAL_MDMA_Start(&hmdma_mdma_channel0_sw_0, (uintptr_t) source + head,
+                                (uintptr_t) buffer + head, block, 1) != HAL_OK)
+                || (HAL_MDMA_PollForTransfer(&hmdma_mdma_channel0_sw_0, HAL_MDMA_FULL_TRANSFER,
+                                             READ_MDMA_TIMEOUT) != HAL_OK)) {
+                return HAL_ERROR;
+            }
+            head += block;
+            length -= block;
+        }
+        Loader_InvalidateBuffer((uintptr_t) buffer, Size);
+    }
+#endif
+
+    memcpy(buffer + head, source + head, Size - head);
+    Loader_CleanBuffer((uintptr_t) buffer + head, Size - head);
+    return HAL_OK;
+}
+
+/*Append a run to the segment table, with the sectors it touches*/
+static void
+Read_AddSegment(uint8_t* table, uint32_t* count, uint32_t type,
+                uint32_t Address, uint32_t Size, uint32_t value) {
+    struct SparseSegment segment;
+
+    segment.Type = type;
+    segment.Address = Address;
+    segment.Size = Size;
+    segment.Value = value;
+    segment.FirstSector = Address / MEMORY_SECTOR_SIZE;
+    segment.SectorCount = (Address + Size - 1) / MEMORY_SECTOR_SIZE - segment.FirstSector + 1;
+    memcpy(table + (*count)++ * sizeof(segment), &segment, sizeof(segment));
+}
@@ -0,0 +1,132 @@
+/*
+ * Loader_Sparse.c
+ *
+ * WriteSparse() entry point: programs an image described as runs of data,
+ * constant fill and erased value, erasing only the sectors the runs touch.
+ */
+#include "Loader_Src.h"
+#include "quadspi.h"
+#include "loader_tcm.h"
+#include "crc32.h"
+#include "sparse_image.h"
+#include <string.h>
+
+static uint8_t Sparse_CheckSegment(const struct SparseSegment* segment,
+                                   uint32_t DataSize, uint32_t previous_end);
+
+/**
+ * @brief   Program a sparse image.
+ * @param   buffer : sparse image descriptor, see sparse_image.h
+ * @param   Size   : size of the descriptor
+ * @retval  LOADER_OK = 1       : Operation succeeded
+ * @retval  LOADER_FAIL = 0 : Operation failed
+ */
+int
+WriteSparse(uint8_t* buffer, uint32_t Size) {
+
+    struct SparseHeader header;
+    struct SparseSegment segment;
+    uint8_t* segments;
+    uint8_t* data;
+    uint32_t previous_end = 0, erased_until = 0, first, last, i;
+
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
+
+    Loader_InvalidateBuffer((uintptr_t) buffer, Size);
+
+    if (Size < sizeof(header)) {
+        __set_PRIMASK(1); //disable interrupts
+        return LOADER_FAIL;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    segments = buffer + sizeof(header);
+
+    /* Validate the whole descriptor before the first erase */
+    if ((header.Magic != SPARSE_MAGIC)
+        || (header.SegmentCount > (Size - sizeof(header)) / sizeof(segment))
+        || (header.DataSize != Size - sizeof(header)
+                               - header.SegmentCount * sizeof(segment))
+        || (Crc32_Update(CRC32_INIT, segments, Size - sizeof(header)) != header.Crc)) {
+        __set_PRIMASK(1); //disable interrupts
+        return LOADER_FAIL;
+    }
+    data = segments + header.SegmentCount * sizeof(segment);
+
+    for (i = 0; i < header.SegmentCount; i++) {
+        memcpy(&segment, segments + i * sizeof(segment), sizeof(segment));
+        if (Sparse_CheckSegment(&segment, header.DataSize, previous_end) != HAL_OK) {
+            __set_PRIMASK(1); //disable interrupts
+            return LOADER_FAIL;
+        }
+        previous_end = segment.Address + segment.Size;
+    }
+
+    for (i = 0; i < header.SegmentCount; i++) {
+        memcpy(&segment, segments + i * sizeof(segment), sizeof(segment));
+
+        /* Erase the touched sectors not erased for an earlier run */
+        first = segment.FirstSector;
+        last = segment.FirstSector + segment.SectorCount - 1;
+        if (first < erased_until) {
+            first = erased_until;
+        }
+        if ((first <= last)
+            && (CSP_QSPI_EraseSector(first * MEMORY_SECTOR_SIZE,
+                                     last * MEMORY_SECTOR_SIZE) != HAL_OK)) {
+            __set_PRIMASK(1); //disable interrupts
+            return LOADER_FAIL;
+        }
+        if (last + 1 > erased_until) {
+            erased_until = last + 1;
+        }
+
+        if (((segment.Type == SPARSE_DATA)
+             && (CSP_QSPI_WriteMemory(data + segment.Value, segment.Address,
+                                      segment.Size) != HAL_OK))
+            || ((segment.Type == SPARSE_FILL)
+                && (Loader_FillRange(segment.Address, segment.Size,
+                                     (uint8_t*) &segment.Value, 4) != HAL_OK))) {
+            __set_PRIMASK(1); //disable interrupts
+            return LOADER_FAIL;
+        }
+    }
+
+    __set_PRIMASK(1); //disable interrupts
+    return LOADER_OK;
+}
+
+/*Check a segment against the device, the data area and the previous segment*/
+static uint8_t
+Sparse_CheckSegment(const struct SparseSegment* segment, uint32_t DataSize,
+                    uint32_t previous_end) {
+
+    if ((segment->Size == 0)
+        || (segment->Address < previous_end)
+        || (segment->Address >= MEMORY_FLASH_SIZE)
+        || (segment->Size > MEMORY_FLASH_SIZE - segment->Address)) {
+        return HAL_ERROR;
+    }
+
+    /* Sectors must match the run */
+    if ((segment->FirstSector != segment->Address / MEMORY_SECTOR_SIZE)
+        || (segment->FirstSector + segment->SectorCount - 1
+            != (segment->Address + segment->Size - 1) / MEMORY_SECTOR_SIZE)) {
+        return HAL_ERROR;
+    }
+
+    switch (segment->Type) {
+        case SPARSE_DATA:
+            if ((segment->Value > DataSize) || (segment->Size > DataSize - segment->Value)) {
+                return HAL_ERROR;
+            }
+            break;
+        case SPARSE_FILL:
+        case SPARSE_ERASED:
+            break;
+        default:
+            return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
@@ -1,11 +1,42 @@
+#include "Loader_Src.h"
 #include "quadspi.h"
 #include "main.h"
 #include "gpio.h"
-
-#define LOADER_OK   0x1
-#define LOADER_FAIL 0x0
+#include "mdma.h"
+#include "crc32.h"
+#include "lz4_stream.h"
+#include "loader_stats.h"
+#include "loader_trace.h"
+#include "loader_tcm.h"
+#include "loader_lean.h"
+#include "loader_journal.h"
+#include <string.h>
+
+#define VERIFY_USE_MDMA     (!LOADER_LEAN) /* stream the flash through MDMA while the CPU compares */
+#define VERIFY_CHUNK_SIZE   0x1000  /* bytes per ping-pong buffer */
+#define VERIFY_MDMA_TIMEOUT 100     /* ms per chunk */
 extern void SystemClock_Config(void);
 
+static uint32_t CheckSum_Window(uint32_t StartAddress, uint32_t Size, uint32_t InitVal);
+
+#if VERIFY_USE_MDMA
+static uint8_t Verify_Mdma(uint32_t MemoryAddr, uint32_t RAMBufferAddr, uint32_t Size,
+                           uint32_t SumStart, uint32_t SumEnd,
+                           uint32_t* Sum, uint32_t* FailAddr);
+
+/* Ping-pong buffers filled by MDMA, line aligned for cache maintenance */
+static uint8_t verify_buffer[2][VERIFY_CHUNK_SIZE] __attribute__((aligned(32)));
+#endif
+
+/* Verify() path, cleared by the benchmark in main.c to time CPU reads */
+uint8_t loader_verify_mdma = 1;
+
+/* Decoded data of one compressed frame */
+static uint8_t lz4_staging[LZ4_BLOCK_MAX_SIZE] LOADER_DTCM;
+
+/* Page image of the pattern programmed by Fill() */
+static uint8_t fill_page[MEMORY_PAGE_SIZE] LOADER_DTCM;
+
 /**
  * @brief  System initialization.
  * @param  None
@@ -17,6 +48,8 @@ Init(void) {
 
     *(uint32_t*)0xE000EDF0 = 0xA05F0000; //enable interrupts in debug
 
+    /* Hot paths run from ITCM, copied in before any of them is called */
+    Tcm_Init();
 
     SystemInit();
 
@@ -32,14 +65,44 @@ Init(void) {
 
     SCB->VTOR = 0x24000000 | 0x200;
 
+    /* Cycle counter used for operation timings */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    STATS_SCOPE(STATS_INIT);
+
+#if USE_CACHE
+    /* Drop whatever a previous session left in the caches before the
+     * freshly downloaded image and buffers are used */
+    SCB_InvalidateICache();
+    if (SCB->CCR & SCB_CCR_DC_Msk) {
+        SCB_InvalidateDCache();
+    }
+    MPU_Config();
+    SCB_EnableICache();
+    SCB_EnableDCache();
+#endif
+
     __set_PRIMASK(0); //enable interrupts
 
+#if LOADER_LEAN
+    Lean_Init();
+#else
     HAL_Init();
 
     SystemClock_Config();
+#endif
+
+    Stats_Init();
+    Trace_Init();
 
     MX_GPIO_Init();
 
+#if VERIFY_USE_MDMA
+    MX_MDMA_Init();
+#endif
+
     __HAL_RCC_QSPI_FORCE_RESET();  //completely reset peripheral
     __HAL_RCC_QSPI_RELEASE_RESET();
 
@@ -48,16 +111,11 @@ Init(void) {
         return LOADER_FAIL;
     }
 
-
     if (CSP_QSPI_EnableMemoryMappedMode() != HAL_OK) {
         __set_PRIMASK(1); //disable interrupts
         return LOADER_FAIL;
     }
 
-    /*Trigger read access before HAL_QSPI_Abort() otherwise abort functionality gets stuck*/
-    uint32_t a = *(uint32_t*) 0x90000000;
-    a++;
-
     __set_PRIMASK(1); //disable interrupts
     return LOADER_OK;
 }
@@ -73,15 +131,106 @@ Init(void) {
 int
 Write(uint32_t Address, uint32_t Size, uint8_t* buffer) {
 
+    STATS_SCOPE(STATS_WRITE);
+
+    Tcm_Init();
     __set_PRIMASK(0); //enable interrupts
 
-    if (HAL_QSPI_Abort(&hqspi) != HAL_OK) {
+    Loader_InvalidateBuffer((uintptr_t) buffer, Size);
+
+    /* Every byte is on flash before returning: the tool may never call
+     * again, and a page split across calls is programmed in two parts */
+    if (CSP_QSPI_WriteMemory((uint8_t*) buffer, (Address & (0x0fffffff)), Size) != HAL_OK) {
         __set_PRIMASK(1); //disable interrupts
         return LOADER_FAIL;
     }
+    JOURNAL_PROGRESS(JOURNAL_PROGRAMMED, Address, Size);
 
+    __set_PRIMASK(1); //disable interrupts
+    return LOADER_OK;
+}
 
-    if (CSP_QSPI_WriteMemory((uint8_t*) buffer, (Address & (0x0fffffff)), Size) != HAL_OK) {
+/**
+ * @brief   Program memory from a compressed stream.
+ * @param   Address: address of the first decoded byte
+ * @param   Size   : size of the frame stream
+ * @param   buffer : frame stream, see lz4_stream.h
+ * @retval  LOADER_OK = 1       : Operation succeeded
+ * @retval  LOADER_FAIL = 0 : Operation failed
+ */
+int
+WriteCompressed(uint32_t Address, uint32_t Size, uint8_t* buffer) {
+
+    struct LZ4_FrameHeader header;
+    uint32_t offset = 0;
+    int32_t decoded;
+
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
+
+    Loader_InvalidateBuffer((uintptr_t) buffer, Size);
+    Address &= 0x0fffffff;
+
+    while (offset < Size) {
+        if (Size - offset < sizeof(header)) {
+            __set_PRIMASK(1); //disable interrupts
+            return LOADER_FAIL;
+        }
+        memcpy(&header, buffer + offset, sizeof(header));
+        offset += sizeof(header);
+
+        /* Reject a corrupt frame before anything is programmed from it */
+        if ((header.Magic != LZ4_FRAME_MAGIC)
+            || (header.RawSize > LZ4_BLOCK_MAX_SIZE)
+            || (header.CompressedSize > Size - offset)
+            || (Crc32_Update(CRC32_INIT, buffer + offset, header.CompressedSize)
+                != header.Crc)) {
+            __set_PRIMASK(1); //disable interrupts
+            return LOADER_FAIL;
+        }
+
+        decoded = LZ4_DecodeBlock(buffer + offset, header.CompressedSize,
+                                  lz4_staging, sizeof(lz4_staging));
+        if ((decoded < 0) || ((uint32_t) decoded != header.RawSize)) {
+            __set_PRIMASK(1); //disable interrupts
+            return LOADER_FAIL;
+        }
+
+        if (CSP_QSPI_WriteMemory(lz4_staging, Address, decoded) != HAL_OK) {
+            __set_PRIMASK(1); //disable interrupts
+            return LOADER_FAIL;
+        }
+
+        Address += decoded;
+        offset += header.CompressedSize;
+    }
+
+    __set_PRIMASK(1); //disable interrupts
+    return LOADER_OK;
+}
+
+/**
+ * @brief   Program a repeating pattern without transferring the data.
+ * @param   Address    : start address
+ * @param   Size       : size of the range
+ * @param   pattern    : pattern, repeated from Address onwards
+ * @param   patternLen : pattern size, 1 to MEMORY_PAGE_SIZE bytes
+ * @retval  LOADER_OK = 1       : Operation succeeded
+ * @retval  LOADER_FAIL = 0 : Operation failed
+ */
+int
+Fill(uint32_t Address, uint32_t Size, uint8_t* pattern, uint32_t patternLen) {
+
+    if ((patternLen == 0) || (patternLen > MEMORY_PAGE_SIZE)) {
+        return LOADER_FAIL;
+    }
+
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
+
+    Loader_InvalidateBuffer((uintptr_t) pattern, patternLen);
+
+    if (Loader_FillRange(Address & 0x0fffffff, Size, pattern, patternLen) != HAL_OK) {
         __set_PRIMASK(1); //disable interrupts
         return LOADER_FAIL;
     }
@@ -100,18 +249,18 @@ Write(uint32_t Address, uint32_t Size, uint8_t* buffer) {
 int
 SectorErase(uint32_t EraseStartAddress, uint32_t EraseEndAddress) {
 
-    __set_PRIMASK(0); //enable interrupts
-
-    if (HAL_QSPI_Abort(&hqspi) != HAL_OK) {
-        __set_PRIMASK(1); //disable interrupts
-        return LOADER_FAIL;
-    }
+    STATS_SCOPE(STATS_SECTOR_ERASE);
 
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
 
     if (CSP_QSPI_EraseSector(EraseStartAddress, EraseEndAddress) != HAL_OK) {
         __set_PRIMASK(1); //disable interrupts
         return LOADER_FAIL;
     }
+    JOURNAL_PROGRESS(JOURNAL_ERASED, EraseStartAddress - EraseStartAddress % MEMORY_SECTOR_SIZE,
+                     (EraseEndAddress / MEMORY_SECTOR_SIZE - EraseStartAddress / MEMORY_SECTOR_SIZE + 1)
+                     * MEMORY_SECTOR_SIZE);
 
     __set_PRIMASK(1); //disable interrupts
     return LOADER_OK;
@@ -130,18 +279,16 @@ SectorErase(uint32_t EraseStartAddress, uint32_t EraseEndAddress) {
 int
 MassErase(void) {
 
-    __set_PRIMASK(0); //enable interrupts
-
-    if (HAL_QSPI_Abort(&hqspi) != HAL_OK) {
-        __set_PRIMASK(1); //disable interrupts
-        return LOADER_FAIL;
-    }
+    STATS_SCOPE(STATS_MASS_ERASE);
 
+    Tcm_Init();
+    __set_PRIMASK(0); //enable interrupts
 
     if (CSP_QSPI_Erase_Chip() != HAL_OK) {
         __set_PRIMASK(1); //disable interrupts
         return LOADER_FAIL;
     }
+    JOURNAL_MASS_ERASED();
 
     __set_PRIMASK(1); //disable interrupts
     return LOADER_OK;
@@ -160,6 +307,40 @@ MassErase(void) {
  */
 uint32_t
 CheckSum(uint32_t StartAddress, uint32_t Size, uint32_t InitVal) {
+    STATS_SCOPE(STATS_CHECKSUM);
+    uint32_t end, window, length, primask;
+
+    Tcm_Init();
+    if (StartAddress < MEMORY_MAPPED_ADDRESS) {
+        return CheckSum_Window(StartAddress, Size, InitVal);
+    }
+
+    /* Mapping the flash waits out running erases on tick-based timeouts.
+     * Verify() calls in with the interrupts already on and keeps them */
+    primask = __get_PRIMASK();
+    __set_PRIMASK(0); //enable interrupts
+
+    /* Flash is summed through the window of each chip the range touches */
+    end = StartAddress - StartAddress % 4 + Size;
+    while (StartAddress < end) {
+        length = end - StartAddress;
+        window = CSP_QSPI_MapAddress(StartAddress & 0x0fffffff, &length);
+        if (window == 0) {
+            __set_PRIMASK(primask);
+            return InitVal;
+        }
+        InitVal = CheckSum_Window(window, length + StartAddress % 4, InitVal);
+        StartAddress += length;
+    }
+
+    __set_PRIMASK(primask);
+    return (InitVal);
+}
+
+/*Byte sum of Size bytes from the word holding StartAddress, less the
+ *bytes in front of StartAddress*/
+LOADER_ITCM static uint32_t
+CheckSum_Window(uint32_t StartAddress, uint32_t Size, uint32_t InitVal) {
     uint8_t missalignementAddress = StartAddress % 4;
     uint8_t missalignementSize = Size;
     int cnt;
@@ -169,7 +350,7 @@ CheckSum(uint32_t StartAddress, uint32_t Size, uint32_t InitVal) {
     Size += (Size % 4 == 0) ? 0 : 4 - (Size % 4);
 
     for (cnt = 0; cnt < Size; cnt += 4) {
-        Val = *(uint32_t*) StartAddress;
+        Val = *(uint32_t*) (uintptr_t) StartAddress;
         if (missalignementAddress) {
             switch (missalignementAddress) {
                 case 1:
@@ -235,27 +416,300 @@ CheckSum(uint32_t StartAddress, uint32_t Size, uint32_t InitVal) {
 uint64_t
 Verify(uint32_t MemoryAddr, uint32_t RAMBufferAddr, uint32_t Size, uint32_t missalignement) {
 
+    STATS_SCOPE(STATS_VERIFY);
+
+    Tcm_Init();
     __set_PRIMASK(0); //enable interrupts
-    uint32_t VerifiedData = 0, InitVal = 0;
+    uint32_t VerifiedData = 0, InitVal = 0, window, length, i;
     uint64_t checksum;
     Size *= 4;
 
-    if (CSP_QSPI_EnableMemoryMappedMode() != HAL_OK) {
+    Loader_InvalidateBuffer(RAMBufferAddr, Size);
+
+    /* Pages confirmed by readback in Write() from data with the CRC-32 of
+     * the RAM buffer hold that buffer, so the checksum can be taken from
+     * RAM without touching the flash at all */
+    if (((MemoryAddr % 4) == (RAMBufferAddr % 4))
+        && CSP_QSPI_IsRangeVerified(MemoryAddr & 0x0fffffff, (const uint8_t*) (uintptr_t) RAMBufferAddr,
+                                    Size)) {
+        uint32_t SumStart = (MemoryAddr + (missalignement & 0xf)) & 0x0fffffff;
+        uint32_t SumEnd = SumStart - SumStart % 4 + Size - ((missalignement >> 16) & 0xF);
+        QSPI_ProgramRunTypeDef run;
+
+        /* Reuse the checksum taken while the pages were programmed */
+        CSP_QSPI_GetProgramRun(&run);
+        if ((run.start == SumStart) && (run.end == SumEnd)) {
+            checksum = InitVal + run.sum;
+        } else {
+            checksum = CheckSum(RAMBufferAddr + (missalignement & 0xf),
+                                Size - ((missalignement >> 16) & 0xF), InitVal);
+        }
+        JOURNAL_PROGRESS(JOURNAL_VERIFIED, MemoryAddr, Size);
+        __set_PRIMASK(1); //disable interrupts
+        return (checksum << 32);
+    }
+
+    length = Size;
+    window = CSP_QSPI_MapAddress(MemoryAddr & 0x0fffffff, &length);
+    if (window == 0) {
         __set_PRIMASK(1); //disable interrupts
         return LOADER_FAIL;
     }
 
+#if VERIFY_USE_MDMA
+    /* MDMA reads a single chip's window, offset from the flash address */
+    if (loader_verify_mdma && ((MemoryAddr % 4) == 0) && (length == Size)) {
+        uint32_t SumStart = window + (missalignement & 0xf);
+        uint32_t SumEnd = SumStart - SumStart % 4 + Size - ((missalignement >> 16) & 0xF);
+        uint32_t Sum = InitVal, FailAddr = 0;
+
+        if (Verify_Mdma(window, RAMBufferAddr, Size, SumStart, SumEnd,
+                        &Sum, &FailAddr) == HAL_OK) {
+            checksum = Sum;
+            if (FailAddr == 0) {
+                JOURNAL_PROGRESS(JOURNAL_VERIFIED, MemoryAddr, Size);
+            } else {
+                FailAddr += MemoryAddr - window;
+            }
+            __set_PRIMASK(1); //disable interrupts
+            return ((checksum << 32) + FailAddr);
+        }
+        /* MDMA failure, fall back to CPU reads */
+    }
+#endif
+
     checksum = CheckSum((uint32_t) MemoryAddr + (missalignement & 0xf),
                         Size - ((missalignement >> 16) & 0xF), InitVal);
-    while (Size > VerifiedData) {
-        if (*(uint8_t*) MemoryAddr++
-            != *((uint8_t*) RAMBufferAddr + VerifiedData)) {
+    for (VerifiedData = 0; VerifiedData < Size; VerifiedData += length) {
+        length = Size - VerifiedData;
+        window = CSP_QSPI_MapAddress((MemoryAddr + VerifiedData) & 0x0fffffff, &length);
+        if (window == 0) {
             __set_PRIMASK(1); //disable interrupts
             return ((checksum << 32) + (MemoryAddr + VerifiedData));
         }
-        VerifiedData++;
+        i = Loader_Compare((uint8_t*) (uintptr_t) window,
+                           (uint8_t*) (uintptr_t) RAMBufferAddr + VerifiedData, length);
+        if (i != length) {
+            __set_PRIMASK(1); //disable interrupts
+            return ((checksum << 32) + (MemoryAddr + VerifiedData + i));
+        }
     }
+    JOURNAL_PROGRESS(JOURNAL_VERIFIED, MemoryAddr, Size);
 
     __set_PRIMASK(1); //disable interrupts
     return (checksum << 32);
 }
+
+#if VERIFY_USE_MDMA
+/**
+ * Description :
+ * Compare flash with a RAM buffer while MDMA streams the next chunk of the
+ * memory-mapped window into the other half of a ping-pong buffer
+ * Inputs    :
+ *      MemoryAddr    : Flash address (word aligned)
+ *      RAMBufferAddr : RAM buffer address
+ *      Size          : Size (in bytes, multiple of 4)
+ *      SumStart      : First flash address included in the checksum
+ *      SumEnd        : Flash address following the checksum window
+ * outputs   :
+ *      Sum           : Checksum, accumulated over the compared chunks
+ *      FailAddr      : Address of the first mismatch, 0 if none
+ *      R0            : HAL_OK, or HAL_ERROR on MDMA failure
+ */
+static uint8_t
+Verify_Mdma(uint32_t MemoryAddr, uint32_t RAMBufferAddr, uint32_t Size,
+            uint32_t SumStart, uint32_t SumEnd, uint32_t* Sum, uint32_t* FailAddr) {
+    uint32_t offset = 0, length, next_length = 0, index = 0;
+    uint32_t chunk_start, chunk_end, i;
+    uint8_t* chunk;
+
+    length = (Size < VERIFY_CHUNK_SIZE) ? Size : VERIFY_CHUNK_SIZE;
+    if (HAL_MDMA_Start(&hmdma_mdma_channel0_sw_0, MemoryAddr,
+                       (uintptr_t) verify_buffer[0], length, 1) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    while (offset < Size) {
+        if (HAL_MDMA_PollForTransfer(&hmdma_mdma_channel0_sw_0, HAL_MDMA_FULL_TRANSFER,
+                                     VERIFY_MDMA_TIMEOUT) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        chunk = verify_buffer[index];
+        Loader_InvalidateBuffer((uintptr_t) chunk, length);
+
+        /* Start the next chunk before working on this one */
+        if (offset + length < Size) {
+            next_length = Size - (offset + length);
+            if (next_length > VERIFY_CHUNK_SIZE) {
+                next_length = VERIFY_CHUNK_SIZE;
+            }
+            if (HAL_MDMA_Start(&hmdma_mdma_channel0_sw_0, MemoryAddr + offset + length,
+                               (uintptr_t) verify_buffer[index ^ 1], next_length, 1) != HAL_OK) {
+                return HAL_ERROR;
+            }
+        }
+
+        i = Loader_Compare(chunk, (uint8_t*) (uintptr_t) RAMBufferAddr + offset, length);
+        if (i != length) {
+            if (offset + length < Size) {
+                HAL_MDMA_Abort(&hmdma_mdma_channel0_sw_0);
+            }
+            *FailAddr = MemoryAddr + offset + i;
+            return HAL_OK;
+        }
+
+        /* Part of the checksum window held by this chunk */
+        chunk_start = MemoryAddr + offset;
+        chunk_end = chunk_start + length;
+        if (chunk_start < SumStart) {
+            chunk_start = SumStart;
+        }
+        if (chunk_end > SumEnd) {
+            chunk_end = SumEnd;
+        }
+        for (i = chunk_start; i < chunk_end; i++) {
+            *Sum += chunk[i - (MemoryAddr + offset)];
+        }
+
+        offset += length;
+        length = next_length;
+        index ^= 1;
+    }
+
+    return HAL_OK;
+}
+#endif
+
+/**
+ * Description :
+ * Discard D-Cache lines covering a buffer written by the debugger
+ * Inputs    :
+ *      address       : Buffer address
+ *      size          : Size (in bytes)
+ * outputs   :
+ *     none
+ */
+void
+Loader_InvalidateBuffer(uint32_t address, uint32_t size) {
+#if USE_CACHE
+    SCB_InvalidateDCache_by_Addr((void*) (uintptr_t) address, size);
+#else
+    (void) address;
+    (void) size;
+#endif
+}
+
+/**
+ * Description :
+ * Write back D-Cache lines covering a buffer the debugger reads
+ * Inputs    :
+ *      address       : Buffer address
+ *      size          : Size (in bytes)
+ * outputs   :
+ *     none
+ */
+void
+Loader_CleanBuffer(uint32_t address, uint32_t size) {
+#if USE_CACHE
+    if (size) {
+        SCB_CleanDCache_by_Addr((uint32_t*) (uintptr_t) address, size);
+    }
+#else
+    (void) address;
+    (void) size;
+#endif
+}
+
+/**
+ * Description :
+ * Program a repeating pattern over a flash range, building the page image
+ * once per pattern phase
+ * Inputs    :
+ *      Address       : Flash offset
+ *      Size          : Size (in bytes)
+ *      pattern       : Pattern, repeated from Address onwards
+ *      patternLen    : Pattern size, 1 to MEMORY_PAGE_SIZE bytes
+ * outputs   :
+ *     R0             : HAL_OK or HAL_ERROR
+ */
+uint8_t
+Loader_FillRange(uint32_t Address, uint32_t Size, const uint8_t* pattern, uint32_t patternLen) {
+
+    QSPI_PagePlanTypeDef plan;
+    uint32_t phase, fill_phase = patternLen, i;
+
+    /* Programming the erased value leaves the flash unchanged */
+    if (Loader_IsBlank(pattern, patternLen)) {
+        return HAL_OK;
+    }
+
+    CSP_QSPI_PlanInit(&plan, Address, Size);
+    while (CSP_QSPI_PlanNext(&plan)) {
+        /* Rebuild the page image only when the pattern phase moves */
+        phase = plan.offset % patternLen;
+        if (phase != fill_phase) {
+            for (i = 0; i < MEMORY_PAGE_SIZE; i++) {
+                fill_page[i] = pattern[(phase + i) % patternLen];
+            }
+            fill_phase = phase;
+        }
+
+        if (CSP_QSPI_WriteMemory(fill_page, plan.address, plan.size) != HAL_OK) {
+            return HAL_ERROR;
+        }
+    }
+
+    return HAL_OK;
+}
+
+/**
+ * Description :
+ * Find the first difference between flash data and the RAM buffer
+ * Inputs    :
+ *      flash         : Data read from the flash
+ *      ram           : Expected data
+ *      size          : Size (in bytes)
+ * outputs   :
+ *     R0             : Offset of the first mismatch, size if equal
+ */
+LOADER_ITCM uint32_t
+Loader_Compare(const uint8_t* flash, const uint8_t* ram, uint32_t size) {
+    uint32_t i;
+
+    if (memcmp(flash, ram, size) == 0) {
+        return size;
+    }
+    for (i = 0; flash[i] == ram[i]; i++) {
+    }
+    return i;
+}
+
+/**
+ * Description :
+ * Check whether a buffer holds only the erased value, a word at a time
+ * once aligned
+ * Inputs    :
+ *      data          : Buffer
+ *      size          : Size (in bytes)
+ * outputs   :
+ *     R0             : 1 if every byte is 0xFF, 0 otherwise
+ */
+LOADER_ITCM uint8_t
+Loader_IsBlank(const uint8_t* data, uint32_t size) {
+    const uint32_t* word;
+    uint32_t all = 0xFFFFFFFF;
+
+    for (; size && ((uintptr_t) data % 4); size--) {
+        all &= 0xFFFFFF00 | *data++;
+    }
+    for (word = (const uint32_t*) data; size >= 16; size -= 16, word += 4) {
+        all &= word[0] & word[1] & word[2] & word[3];
+        if (all != 0xFFFFFFFF) {
+            return 0;
+        }
+    }
+    for (data = (const uint8_t*) word; size; size--) {
+        all &= 0xFFFFFF00 | *data++;
+    }
+    return all == 0xFFFFFFFF;
+}
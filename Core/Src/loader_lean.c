@@ -0,0 +1,406 @@
+/*
+ * loader_lean.c
+ *
+ */
+#include "loader_lean.h"
+#include "quadspi.h"
+
+#if LOADER_LEAN
+#define LEAN_CLOCK_TIMEOUT  100     /* ms for an oscillator or PLL to lock */
+#define LEAN_SYSCLK_HZ      480000000
+#define LEAN_D2CLK_HZ       240000000
+
+/*CCR functional modes, private to the HAL QSPI driver*/
+#define LEAN_FMODE_INDIRECT_WRITE   0x00000000U
+#define LEAN_FMODE_INDIRECT_READ    QUADSPI_CCR_FMODE_0
+#define LEAN_FMODE_AUTO_POLLING     QUADSPI_CCR_FMODE_1
+#define LEAN_FMODE_MEMORY_MAPPED    QUADSPI_CCR_FMODE
+
+static void Lean_SystemClockConfig(void);
+static void Lean_PinConfig(GPIO_TypeDef* port, uint32_t pin, uint32_t alternate);
+static void Lean_QSPI_Config(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                             uint32_t FunctionalMode);
+static HAL_StatusTypeDef Lean_QSPI_WaitFlag(QSPI_HandleTypeDef* hqspi, uint32_t Flag,
+                                            FlagStatus State, uint32_t Tickstart,
+                                            uint32_t Timeout);
+
+/*Spin until a condition holds, for at most LEAN_CLOCK_TIMEOUT once SysTick runs*/
+#define LEAN_WAIT(condition)                                                    \
+    do {                                                                        \
+        uint32_t tickstart = HAL_GetTick();                                     \
+        while (!(condition)) {                                                  \
+            if ((HAL_GetTick() - tickstart) > LEAN_CLOCK_TIMEOUT) {             \
+                Error_Handler();                                                \
+            }                                                                   \
+        }                                                                       \
+    } while (0)
+
+void
+Lean_Init(void) {
+
+    NVIC_SetPriorityGrouping(NVIC_PRIORITYGROUP_4);
+    HAL_MspInit();
+
+    /* 1 ms tick from the clock the system runs on now, redone below */
+    SysTick_Config(SystemCoreClock / 1000U);
+    NVIC_SetPriority(SysTick_IRQn, TICK_INT_PRIORITY);
+    uwTickPrio = TICK_INT_PRIORITY;
+
+    Lean_SystemClockConfig();
+
+    SystemCoreClock = LEAN_SYSCLK_HZ;
+    SystemD2Clock = LEAN_D2CLK_HZ;
+    SysTick_Config(SystemCoreClock / 1000U);
+    NVIC_SetPriority(SysTick_IRQn, TICK_INT_PRIORITY);
+}
+
+/*
+ * The clock tree of SystemClock_Config(): LDO supply, VOS0, HSE 24 MHz,
+ * PLL1 M2 N80 P2 Q20 R6, HCLK and every APB at half SYSCLK, 4 wait
+ * states. A PLL1 already driving SYSCLK is left as a previous Init() set it.
+ */
+static void
+Lean_SystemClockConfig(void) {
+
+    /* The supply can be set once per power cycle, as HAL_PWREx_ConfigSupply() */
+    if (READ_BIT(PWR->CR3, PWR_CR3_SCUEN) != 0U) {
+        MODIFY_REG(PWR->CR3, PWR_SUPPLY_CONFIG_MASK, PWR_LDO_SUPPLY);
+        LEAN_WAIT(__HAL_PWR_GET_FLAG(PWR_FLAG_ACTVOSRDY));
+    }
+
+    __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE0);
+    LEAN_WAIT(__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY));
+
+    if (__HAL_RCC_GET_SYSCLK_SOURCE() == RCC_SYSCLKSOURCE_STATUS_PLLCLK) {
+        return;
+    }
+
+    __HAL_RCC_HSE_CONFIG(RCC_HSE_ON);
+    LEAN_WAIT(__HAL_RCC_GET_FLAG(RCC_FLAG_HSERDY));
+
+    __HAL_RCC_PLL_DISABLE();
+    LEAN_WAIT(!__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY));
+    __HAL_RCC_PLL_CONFIG(RCC_PLLSOURCE_HSE, 2, 80, 2, 20, 6);
+    __HAL_RCC_PLLFRACN_DISABLE();
+    __HAL_RCC_PLL_VCIRANGE(RCC_PLL1VCIRANGE_3);
+    __HAL_RCC_PLL_VCORANGE(RCC_PLL1VCOWIDE);
+    __HAL_RCC_PLLCLKOUT_ENABLE(RCC_PLL1_DIVP | RCC_PLL1_DIVQ | RCC_PLL1_DIVR);
+    __HAL_RCC_PLL_ENABLE();
+    LEAN_WAIT(__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY));
+
+    /* Wait states for the final clock first, then the dividers, then the switch */
+    __HAL_FLASH_SET_LATENCY(FLASH_LATENCY_4);
+    LEAN_WAIT(__HAL_FLASH_GET_LATENCY() == FLASH_LATENCY_4);
+
+    MODIFY_REG(RCC->D1CFGR, RCC_D1CFGR_D1CPRE | RCC_D1CFGR_HPRE | RCC_D1CFGR_D1PPRE,
+               RCC_SYSCLK_DIV1 | RCC_HCLK_DIV2 | RCC_APB3_DIV2);
+    MODIFY_REG(RCC->D2CFGR, RCC_D2CFGR_D2PPRE1 | RCC_D2CFGR_D2PPRE2,
+               RCC_APB1_DIV2 | RCC_APB2_DIV2);
+    MODIFY_REG(RCC->D3CFGR, RCC_D3CFGR_D3PPRE, RCC_APB4_DIV2);
+
+    __HAL_RCC_SYSCLK_CONFIG(RCC_SYSCLKSOURCE_PLLCLK);
+    LEAN_WAIT(__HAL_RCC_GET_SYSCLK_SOURCE() == RCC_SYSCLKSOURCE_STATUS_PLLCLK);
+}
+
+static void
+Lean_PinConfig(GPIO_TypeDef* port, uint32_t pin, uint32_t alternate) {
+    uint32_t shift = pin * 4U;
+
+    /* Alternate function, push-pull, low speed, no pull, as HAL_QSPI_MspInit() */
+    MODIFY_REG(port->AFR[pin >> 3], 0xFU << (shift & 0x1FU), alternate << (shift & 0x1FU));
+    MODIFY_REG(port->OSPEEDR, GPIO_OSPEEDR_OSPEED0 << (pin * 2U), GPIO_SPEED_FREQ_LOW << (pin * 2U));
+    CLEAR_BIT(port->OTYPER, 1U << pin);
+    CLEAR_BIT(port->PUPDR, GPIO_PUPDR_PUPD0 << (pin * 2U));
+    MODIFY_REG(port->MODER, GPIO_MODER_MODE0 << (pin * 2U), (GPIO_MODE_AF_PP & 0x3U) << (pin * 2U));
+}
+
+HAL_StatusTypeDef
+Lean_QSPI_Init(QSPI_HandleTypeDef* hqspi) {
+    uint32_t tickstart;
+
+    /* PLL2R = 24 MHz / 2 * 13 / 2 = 78 MHz, the QUADSPI kernel clock */
+    __HAL_RCC_PLL2_DISABLE();
+    LEAN_WAIT(!__HAL_RCC_GET_FLAG(RCC_FLAG_PLL2RDY));
+    __HAL_RCC_PLL2_CONFIG(2, 13, 2, 2, 2);
+    __HAL_RCC_PLL2FRACN_DISABLE();
+    __HAL_RCC_PLL2_VCIRANGE(RCC_PLL2VCIRANGE_3);
+    __HAL_RCC_PLL2_VCORANGE(RCC_PLL2VCOMEDIUM);
+    __HAL_RCC_PLL2CLKOUT_ENABLE(RCC_PLL2_DIVR);
+    __HAL_RCC_PLL2_ENABLE();
+    LEAN_WAIT(__HAL_RCC_GET_FLAG(RCC_FLAG_PLL2RDY));
+    __HAL_RCC_QSPI_CONFIG(RCC_QSPICLKSOURCE_PLL2);
+
+    __HAL_RCC_QSPI_CLK_ENABLE();
+    __HAL_RCC_GPIOG_CLK_ENABLE();
+    __HAL_RCC_GPIOF_CLK_ENABLE();
+    __HAL_RCC_GPIOD_CLK_ENABLE();
+    Lean_PinConfig(GPIOG, 6, GPIO_AF10_QUADSPI);    /* BK1_NCS */
+    Lean_PinConfig(GPIOF, 6, GPIO_AF9_QUADSPI);     /* BK1_IO3 */
+    Lean_PinConfig(GPIOF, 7, GPIO_AF9_QUADSPI);     /* BK1_IO2 */
+    Lean_PinConfig(GPIOF, 10, GPIO_AF9_QUADSPI);    /* CLK */
+    Lean_PinConfig(GPIOF, 9, GPIO_AF10_QUADSPI);    /* BK1_IO1 */
+    Lean_PinConfig(GPIOD, 11, GPIO_AF9_QUADSPI);    /* BK1_IO0 */
+#if QSPI_CONCAT
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    __HAL_RCC_GPIOH_CLK_ENABLE();
+    Lean_PinConfig(GPIOC, 11, GPIO_AF9_QUADSPI);    /* BK2_NCS */
+    Lean_PinConfig(GPIOH, 2, GPIO_AF9_QUADSPI);     /* BK2_IO0 */
+    Lean_PinConfig(GPIOH, 3, GPIO_AF9_QUADSPI);     /* BK2_IO1 */
+    Lean_PinConfig(GPIOG, 9, GPIO_AF9_QUADSPI);     /* BK2_IO2 */
+    Lean_PinConfig(GPIOG, 14, GPIO_AF9_QUADSPI);    /* BK2_IO3 */
+#endif
+
+    /* Same settings as MX_QUADSPI_Init() */
+    hqspi->Instance = QUADSPI;
+    hqspi->Init.ClockPrescaler = 10;
+    hqspi->Init.FifoThreshold = 4;
+    hqspi->Init.SampleShifting = QSPI_SAMPLE_SHIFTING_NONE;
+    hqspi->Init.FlashSize = 25;
+    hqspi->Init.ChipSelectHighTime = QSPI_CS_HIGH_TIME_2_CYCLE;
+    hqspi->Init.ClockMode = QSPI_CLOCK_MODE_0;
+    hqspi->Init.FlashID = QSPI_FLASH_ID_1;
+    hqspi->Init.DualFlash = QSPI_DUALFLASH_DISABLE;
+    hqspi->Timeout = HAL_QSPI_TIMEOUT_DEFAULT_VALUE;
+    hqspi->ErrorCode = HAL_QSPI_ERROR_NONE;
+
+    __HAL_QSPI_DISABLE(hqspi);
+    MODIFY_REG(hqspi->Instance->CR, QUADSPI_CR_FTHRES,
+               (hqspi->Init.FifoThreshold - 1U) << QUADSPI_CR_FTHRES_Pos);
+
+    tickstart = HAL_GetTick();
+    if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_BUSY, RESET, tickstart, hqspi->Timeout) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    MODIFY_REG(hqspi->Instance->CR,
+               QUADSPI_CR_PRESCALER | QUADSPI_CR_SSHIFT | QUADSPI_CR_FSEL | QUADSPI_CR_DFM,
+               (hqspi->Init.ClockPrescaler << QUADSPI_CR_PRESCALER_Pos)
+               | hqspi->Init.SampleShifting | hqspi->Init.FlashID | hqspi->Init.DualFlash);
+    MODIFY_REG(hqspi->Instance->DCR, QUADSPI_DCR_FSIZE | QUADSPI_DCR_CSHT | QUADSPI_DCR_CKMODE,
+               (hqspi->Init.FlashSize << QUADSPI_DCR_FSIZE_Pos)
+               | hqspi->Init.ChipSelectHighTime | hqspi->Init.ClockMode);
+    __HAL_QSPI_ENABLE(hqspi);
+
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef
+Lean_QSPI_WaitFlag(QSPI_HandleTypeDef* hqspi, uint32_t Flag, FlagStatus State,
+                   uint32_t Tickstart, uint32_t Timeout) {
+
+    while ((__HAL_QSPI_GET_FLAG(hqspi, Flag) ? SET : RESET) != State) {
+        if ((Timeout != HAL_MAX_DELAY)
+            && (((HAL_GetTick() - Tickstart) > Timeout) || (Timeout == 0U))) {
+            hqspi->State = HAL_QSPI_STATE_ERROR;
+            hqspi->ErrorCode |= HAL_QSPI_ERROR_TIMEOUT;
+            return HAL_ERROR;
+        }
+    }
+    return HAL_OK;
+}
+
+/*CCR, AR, ABR and DLR of a command, as the HAL's QSPI_Config()*/
+static void
+Lean_QSPI_Config(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd, uint32_t FunctionalMode) {
+    uint32_t ccr = cmd->DdrMode | cmd->DdrHoldHalfCycle | cmd->SIOOMode | cmd->DataMode
+                   | (cmd->DummyCycles << QUADSPI_CCR_DCYC_Pos) | cmd->AlternateByteMode
+                   | cmd->AddressMode | cmd->InstructionMode | FunctionalMode;
+
+    if ((cmd->DataMode != QSPI_DATA_NONE) && (FunctionalMode != LEAN_FMODE_MEMORY_MAPPED)) {
+        WRITE_REG(hqspi->Instance->DLR, cmd->NbData - 1U);
+    }
+    if (cmd->InstructionMode != QSPI_INSTRUCTION_NONE) {
+        ccr |= cmd->Instruction;
+    }
+    if (cmd->AlternateByteMode != QSPI_ALTERNATE_BYTES_NONE) {
+        WRITE_REG(hqspi->Instance->ABR, cmd->AlternateBytes);
+        ccr |= cmd->AlternateBytesSize;
+    }
+
+    if (cmd->AddressMode != QSPI_ADDRESS_NONE) {
+        WRITE_REG(hqspi->Instance->CCR, ccr | cmd->AddressSize);
+        if (FunctionalMode != LEAN_FMODE_MEMORY_MAPPED) {
+            WRITE_REG(hqspi->Instance->AR, cmd->Address);
+        }
+    } else {
+        WRITE_REG(hqspi->Instance->CCR, ccr);
+        CLEAR_REG(hqspi->Instance->AR);
+    }
+}
+
+HAL_StatusTypeDef
+Lean_QSPI_Command(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd, uint32_t Timeout) {
+    uint32_t tickstart = HAL_GetTick();
+
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    hqspi->ErrorCode = HAL_QSPI_ERROR_NONE;
+    hqspi->State = HAL_QSPI_STATE_BUSY;
+
+    if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_BUSY, RESET, tickstart, Timeout) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    Lean_QSPI_Config(hqspi, cmd, LEAN_FMODE_INDIRECT_WRITE);
+
+    /* Without a data phase the command runs as soon as it is configured */
+    if (cmd->DataMode == QSPI_DATA_NONE) {
+        if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_TC, SET, tickstart, Timeout) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        __HAL_QSPI_CLEAR_FLAG(hqspi, QSPI_FLAG_TC);
+    }
+
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+Lean_QSPI_Transmit(QSPI_HandleTypeDef* hqspi, uint8_t* pData, uint32_t Timeout) {
+    uint32_t tickstart = HAL_GetTick();
+    uint32_t count = READ_REG(hqspi->Instance->DLR) + 1U;
+    __IO uint8_t* data_reg = (__IO uint8_t*) &hqspi->Instance->DR;
+
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    hqspi->State = HAL_QSPI_STATE_BUSY_INDIRECT_TX;
+
+    MODIFY_REG(hqspi->Instance->CCR, QUADSPI_CCR_FMODE, LEAN_FMODE_INDIRECT_WRITE);
+    while (count--) {
+        if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_FT, SET, tickstart, Timeout) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        *data_reg = *pData++;
+    }
+
+    if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_TC, SET, tickstart, Timeout) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    __HAL_QSPI_CLEAR_FLAG(hqspi, QSPI_FLAG_TC);
+
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+Lean_QSPI_Receive(QSPI_HandleTypeDef* hqspi, uint8_t* pData, uint32_t Timeout) {
+    uint32_t tickstart = HAL_GetTick();
+    uint32_t count = READ_REG(hqspi->Instance->DLR) + 1U;
+    uint32_t address = READ_REG(hqspi->Instance->AR);
+    __IO uint8_t* data_reg = (__IO uint8_t*) &hqspi->Instance->DR;
+
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    hqspi->State = HAL_QSPI_STATE_BUSY_INDIRECT_RX;
+
+    /* Switching to indirect read and rewriting the address starts the transfer */
+    MODIFY_REG(hqspi->Instance->CCR, QUADSPI_CCR_FMODE, LEAN_FMODE_INDIRECT_READ);
+    WRITE_REG(hqspi->Instance->AR, address);
+    while (count--) {
+        if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_FT | QSPI_FLAG_TC, SET, tickstart, Timeout) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        *pData++ = *data_reg;
+    }
+
+    if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_TC, SET, tickstart, Timeout) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    __HAL_QSPI_CLEAR_FLAG(hqspi, QSPI_FLAG_TC);
+
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+Lean_QSPI_AutoPolling(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                      QSPI_AutoPollingTypeDef* cfg, uint32_t Timeout) {
+    uint32_t tickstart = HAL_GetTick();
+
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    hqspi->ErrorCode = HAL_QSPI_ERROR_NONE;
+    hqspi->State = HAL_QSPI_STATE_BUSY_AUTO_POLLING;
+
+    if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_BUSY, RESET, tickstart, Timeout) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    WRITE_REG(hqspi->Instance->PSMAR, cfg->Match);
+    WRITE_REG(hqspi->Instance->PSMKR, cfg->Mask);
+    WRITE_REG(hqspi->Instance->PIR, cfg->Interval);
+    /* Automatic stop, or the blocking wait below never ends */
+    MODIFY_REG(hqspi->Instance->CR, QUADSPI_CR_PMM | QUADSPI_CR_APMS,
+               cfg->MatchMode | QSPI_AUTOMATIC_STOP_ENABLE);
+
+    cmd->NbData = cfg->StatusBytesSize;
+    Lean_QSPI_Config(hqspi, cmd, LEAN_FMODE_AUTO_POLLING);
+
+    if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_SM, SET, tickstart, Timeout) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    __HAL_QSPI_CLEAR_FLAG(hqspi, QSPI_FLAG_SM);
+
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+Lean_QSPI_MemoryMapped(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                       QSPI_MemoryMappedTypeDef* cfg) {
+    uint32_t tickstart = HAL_GetTick();
+
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    hqspi->ErrorCode = HAL_QSPI_ERROR_NONE;
+    hqspi->State = HAL_QSPI_STATE_BUSY_MEM_MAPPED;
+
+    if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_BUSY, RESET, tickstart, hqspi->Timeout) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    MODIFY_REG(hqspi->Instance->CR, QUADSPI_CR_TCEN, cfg->TimeOutActivation);
+    if (cfg->TimeOutActivation == QSPI_TIMEOUT_COUNTER_ENABLE) {
+        WRITE_REG(hqspi->Instance->LPTR, cfg->TimeOutPeriod);
+    }
+
+    Lean_QSPI_Config(hqspi, cmd, LEAN_FMODE_MEMORY_MAPPED);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+Lean_QSPI_SetFlashID(QSPI_HandleTypeDef* hqspi, uint32_t FlashID) {
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    hqspi->Init.FlashID = FlashID;
+    MODIFY_REG(hqspi->Instance->CR, QUADSPI_CR_FSEL, FlashID);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+Lean_QSPI_Abort(QSPI_HandleTypeDef* hqspi) {
+    uint32_t tickstart = HAL_GetTick();
+
+    if (__HAL_QSPI_GET_FLAG(hqspi, QSPI_FLAG_BUSY)) {
+        SET_BIT(hqspi->Instance->CR, QUADSPI_CR_ABORT);
+        if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_TC, SET, tickstart, hqspi->Timeout) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        __HAL_QSPI_CLEAR_FLAG(hqspi, QSPI_FLAG_TC);
+        if (Lean_QSPI_WaitFlag(hqspi, QSPI_FLAG_BUSY, RESET, tickstart, hqspi->Timeout) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        CLEAR_BIT(hqspi->Instance->CCR, QUADSPI_CCR_FMODE);
+    }
+
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return HAL_OK;
+}
+#endif
@@ -0,0 +1,48 @@
+/*
+ * loader_stats.c
+ *
+ */
+#include "loader_stats.h"
+#include <string.h>
+
+#if LOADER_STATS
+Stats_TableTypeDef loader_stats __attribute__((section(".loader_stats")));
+
+/*Clear the table unless it already holds the current session*/
+void
+Stats_Init(void) {
+    uint32_t i;
+
+    if ((loader_stats.magic != STATS_MAGIC)
+        || (loader_stats.entry_count != STATS_COUNT)) {
+        memset(&loader_stats, 0, sizeof(loader_stats));
+        for (i = 0; i < STATS_COUNT; i++) {
+            loader_stats.entry[i].min = 0xFFFFFFFF;
+        }
+        loader_stats.entry_count = STATS_COUNT;
+        loader_stats.entry_size = sizeof(Stats_EntryTypeDef);
+        loader_stats.magic = STATS_MAGIC;
+    }
+    loader_stats.cpu_hz = SystemCoreClock;
+}
+
+void
+Stats_Record(Stats_IdTypeDef id, uint32_t cycles) {
+    Stats_EntryTypeDef* entry = &loader_stats.entry[id];
+
+    entry->count++;
+    entry->total += cycles;
+    if (cycles < entry->min) {
+        entry->min = cycles;
+    }
+    if (cycles > entry->max) {
+        entry->max = cycles;
+    }
+    entry->histogram[(cycles > 1) ? (31 - __CLZ(cycles)) : 0]++;
+}
+
+void
+Stats_ScopeEnd(Stats_ScopeTypeDef* scope) {
+    Stats_Record(scope->id, DWT->CYCCNT - scope->start);
+}
+#endif
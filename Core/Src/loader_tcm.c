@@ -0,0 +1,37 @@
+/*
+ * loader_tcm.c
+ *
+ */
+#include "loader_tcm.h"
+#include "main.h"
+
+#if LOADER_TCM
+/* Defined by the linker script: load address, start and end of the ITCM code */
+extern uint32_t _siitcm;
+extern uint32_t _sitcm;
+extern uint32_t _eitcm;
+
+/* Set in the loaded image, so every download of the loader copies again */
+static uint8_t tcm_pending = 1;
+#endif
+
+/*Copy the ITCM code in, before any of it runs or an interrupt can fire.
+ *Every exported entry point calls it first: the tool may call any of them
+ *before Init(), and only the first call copies*/
+void
+Tcm_Init(void) {
+#if LOADER_TCM
+    const uint32_t* src = &_siitcm;
+    uint32_t* dst = &_sitcm;
+
+    if (!tcm_pending) {
+        return;
+    }
+    while (dst < &_eitcm) {
+        *dst++ = *src++;
+    }
+    __DSB();
+    __ISB();
+    tcm_pending = 0;
+#endif
+}
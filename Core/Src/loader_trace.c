@@ -0,0 +1,68 @@
+/*
+ * loader_trace.c
+ *
+ */
+#include "loader_trace.h"
+#include <string.h>
+
+#if LOADER_TRACE
+Trace_RingTypeDef loader_trace __attribute__((section(".loader_trace")));
+
+/*Clear the ring unless it already holds the current session*/
+void
+Trace_Init(void) {
+    if ((loader_trace.Magic != TRACE_MAGIC) || (loader_trace.Capacity != TRACE_CAPACITY)) {
+        memset(&loader_trace, 0, sizeof(loader_trace));
+        loader_trace.Capacity = TRACE_CAPACITY;
+        loader_trace.Magic = TRACE_MAGIC;
+    }
+    loader_trace.CpuHz = SystemCoreClock;
+}
+
+/*Open an entry for a step about to be issued, returns its slot*/
+uint32_t
+Trace_Begin(const QSPI_CommandTypeDef* cmd, uint8_t kind) {
+    uint32_t primask = __get_PRIMASK();
+    uint32_t slot;
+    Trace_EntryTypeDef* entry;
+
+    /* The command queue opens entries from the QUADSPI interrupt */
+    __disable_irq();
+    slot = loader_trace.Head++ % TRACE_CAPACITY;
+    __set_PRIMASK(primask);
+
+    entry = &loader_trace.Entry[slot];
+    entry->Kind = kind;
+    entry->Status = 0xFF;
+    entry->Opcode = 0;
+    entry->Lines = 0;
+    entry->Address = 0;
+    entry->Length = 0;
+    if (cmd != NULL) {
+        entry->Opcode = cmd->Instruction;
+        entry->Lines = (((cmd->InstructionMode >> QUADSPI_CCR_IMODE_Pos) & 3)
+                        << TRACE_LINES_INSTRUCTION_Pos)
+                       | (((cmd->AddressMode >> QUADSPI_CCR_ADMODE_Pos) & 3)
+                          << TRACE_LINES_ADDRESS_Pos)
+                       | (((cmd->DataMode >> QUADSPI_CCR_DMODE_Pos) & 3)
+                          << TRACE_LINES_DATA_Pos);
+        if (cmd->AddressMode != QSPI_ADDRESS_NONE) {
+            entry->Address = cmd->Address;
+        }
+        if ((cmd->DataMode != QSPI_DATA_NONE)
+            && (kind != TRACE_KIND_POLL) && (kind != TRACE_KIND_MAPPED)) {
+            entry->Length = cmd->NbData;
+        }
+    }
+    entry->End = 0;
+    entry->Start = DWT->CYCCNT;
+
+    return slot;
+}
+
+void
+Trace_End(uint32_t slot, uint8_t status) {
+    loader_trace.Entry[slot].End = DWT->CYCCNT;
+    loader_trace.Entry[slot].Status = status;
+}
+#endif
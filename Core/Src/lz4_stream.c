@@ -0,0 +1,92 @@
+/*
+ * lz4_stream.c
+ *
+ */
+#include "lz4_stream.h"
+#include <string.h>
+
+#define LZ4_MIN_MATCH   4
+
+/*Read an extended length, returns 0 when the input ends first*/
+static uint8_t
+LZ4_ReadLength(const uint8_t** ip, const uint8_t* iend, uint32_t* length) {
+    uint8_t byte;
+
+    do {
+        if (*ip >= iend) {
+            return 0;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+
+    return 1;
+}
+
+/**
+ * @brief  Decode one LZ4 block with full bounds checking.
+ * @param  src          : LZ4 block
+ * @param  src_size     : size of the block
+ * @param  dst          : output buffer
+ * @param  dst_capacity : size of the output buffer
+ * @retval decoded size, or -1 for a malformed block
+ */
+int32_t
+LZ4_DecodeBlock(const uint8_t* src, uint32_t src_size,
+                uint8_t* dst, uint32_t dst_capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_size;
+    const uint8_t* match;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_capacity;
+    uint32_t length, offset;
+    uint8_t token;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        /* Literals */
+        length = token >> 4;
+        if ((length == 15) && !LZ4_ReadLength(&ip, iend, &length)) {
+            return -1;
+        }
+        if (((uint32_t) (iend - ip) < length) || ((uint32_t) (oend - op) < length)) {
+            return -1;
+        }
+        memcpy(op, ip, length);
+        op += length;
+        ip += length;
+
+        /* The last sequence carries literals only */
+        if (ip == iend) {
+            break;
+        }
+
+        /* Match */
+        if ((iend - ip) < 2) {
+            return -1;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if ((offset == 0) || (offset > (uint32_t) (op - dst))) {
+            return -1;
+        }
+
+        length = token & 0x0F;
+        if ((length == 15) && !LZ4_ReadLength(&ip, iend, &length)) {
+            return -1;
+        }
+        length += LZ4_MIN_MATCH;
+        if ((uint32_t) (oend - op) < length) {
+            return -1;
+        }
+
+        /* Byte copy, the match may overlap the output */
+        match = op - offset;
+        while (length--) {
+            *op++ = *match++;
+        }
+    }
+
+    return (int32_t) (op - dst);
+}
@@ -24,17 +24,46 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include <stdio.h>
 #include <string.h>
-#define SECTORS_COUNT 100
+#include "microbench.h"
+#include "loader_tcm.h"
+#include "Loader_Src.h"
+#include "mdma.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
-
+/*One throughput measurement, as printed on USART1*/
+typedef struct {
+    const char* op;                 /* erase, program, indirect, mapped */
+    const char* mode;               /* bus width of the command, lines per phase */
+    uint8_t random;                 /* permuted instead of ascending order */
+    uint8_t status;                 /* BENCH_OK, BENCH_ERROR or BENCH_MISMATCH */
+    uint16_t reserved;
+    uint32_t bytes;
+    uint32_t us;                    /* total time of the timed calls */
+    uint32_t kb_per_s;
+} Bench_ResultTypeDef;
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define BENCH_REGION_SIZE   0x100000    /* per region: ascending at 0, permuted right after it */
+#define BENCH_CHUNK_SIZE    0x1000      /* sequential read transfer */
+#define BENCH_RANDOM_SIZE   MEMORY_PAGE_SIZE    /* random indirect read transfer */
+#define BENCH_LINE_SIZE     32          /* random mapped read, one D-Cache line */
+#define BENCH_RANDOM_COUNT  0x1000      /* transfers of each random read, a power of two */
+#define BENCH_STRIDE        0x9E37      /* odd: permutes any power of two count */
+#define BENCH_MAX_RESULTS   (8 + WRITE_BENCH_POINTS + 4 * QSPI_READ_MODES)
+#define BENCH_CSV_HEADER    "op,mode,access,bytes,us,mb_s,status\n"
+
+#define BENCH_OK            0
+#define BENCH_ERROR         1       /* driver call failed, the row stops there */
+#define BENCH_MISMATCH      2       /* data read back differs from the pattern */
+
+#define WRITE_BENCH_POINTS  8       /* flash offsets sampled by the write benchmark */
+#define WRITE_BENCH_SIZE    0x200   /* bytes per sample, page-unaligned at both ends */
 
 /* USER CODE END PD */
 
@@ -48,6 +77,32 @@
 /* USER CODE BEGIN PV */
 uint8_t buffer_test[MEMORY_SECTOR_SIZE];
 uint32_t var = 0;
+
+/* Throughput of every operation and read mode, also printed on USART1 */
+Bench_ResultTypeDef bench_results[BENCH_MAX_RESULTS];
+uint32_t bench_count = 0;
+static uint8_t bench_buffer[BENCH_CHUNK_SIZE] __attribute__((aligned(32)));
+
+static const char* const read_mode_names[QSPI_READ_MODES] = {
+    "1-1-4", "1-4-4", "1-1-4-dtr", "1-4-4-dtr",
+};
+
+/* Cycles of one CSP_QSPI_WriteMemory() call at the end of each flash slice,
+   0 where it failed */
+uint32_t write_offsets[WRITE_BENCH_POINTS];
+uint32_t write_cycles[WRITE_BENCH_POINTS];
+
+static const char* const write_slice_names[WRITE_BENCH_POINTS] = {
+    "slice0", "slice1", "slice2", "slice3", "slice4", "slice5", "slice6", "slice7",
+};
+
+#if MICROBENCH
+/* Kernel microbenchmark records, also printed on USART1 */
+Microbench_ResultTypeDef microbench_results[MICROBENCH_MAX_RESULTS];
+uint32_t microbench_count = 0;
+static uint8_t microbench_a[MICROBENCH_BUFFER_SIZE] __attribute__((aligned(32)));
+static uint8_t microbench_b[MICROBENCH_BUFFER_SIZE] __attribute__((aligned(32)));
+#endif
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -58,7 +113,363 @@ void SystemClock_Config(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+/*Index i of a permutation of count, a power of two*/
+static inline uint32_t
+Bench_Shuffle(uint32_t i, uint32_t count) {
+    return (i * BENCH_STRIDE) & (count - 1);
+}
+
+static void
+Bench_Record(const char* op, const char* mode, uint8_t random, uint8_t status,
+             uint32_t bytes, uint64_t cycles) {
+    Bench_ResultTypeDef* result;
+    uint32_t us;
+
+    if (bench_count == BENCH_MAX_RESULTS) {
+        return;
+    }
+
+    us = (uint32_t) (cycles / (SystemCoreClock / 1000000));
+    result = &bench_results[bench_count++];
+    result->op = op;
+    result->mode = mode;
+    result->random = random;
+    result->status = status;
+    result->reserved = 0;
+    result->bytes = bytes;
+    result->us = us;
+    result->kb_per_s = us ? (uint32_t) ((uint64_t) bytes * 1000000 / 1024 / us) : 0;
+}
+
+/*Compare a region with the pattern through indirect reads*/
+static uint8_t
+Bench_Check(uint32_t address) {
+    uint32_t offset;
+
+    for (offset = 0; offset < BENCH_REGION_SIZE; offset += BENCH_CHUNK_SIZE) {
+        if (CSP_QSPI_ReadMemory(bench_buffer, address + offset, BENCH_CHUNK_SIZE) != HAL_OK) {
+            return BENCH_ERROR;
+        }
+        if (memcmp(bench_buffer, &buffer_test[offset % MEMORY_SECTOR_SIZE], BENCH_CHUNK_SIZE) != 0) {
+            return BENCH_MISMATCH;
+        }
+    }
+    return BENCH_OK;
+}
+
+/*
+ * Erase and program both regions sector by sector: the first in ascending
+ * order, the second in a permuted order, by sector for the erase and by
+ * page for the program. Every call is timed on its own so that the 32-bit
+ * cycle counter cannot wrap within a measurement.
+ */
+static void
+BenchEraseProgram(void) {
+    const uint32_t sectors = BENCH_REGION_SIZE / MEMORY_SECTOR_SIZE;
+    const uint32_t pages = BENCH_REGION_SIZE / MEMORY_PAGE_SIZE;
+    uint64_t cycles;
+    uint32_t i, address, start;
+    uint8_t random, status;
+
+    for (random = 0; random < 2; random++) {
+        status = BENCH_OK;
+        cycles = 0;
+        for (i = 0; (i < sectors) && (status == BENCH_OK); i++) {
+            address = random * BENCH_REGION_SIZE
+                      + (random ? Bench_Shuffle(i, sectors) : i) * MEMORY_SECTOR_SIZE;
+            start = DWT->CYCCNT;
+            if (CSP_QSPI_EraseSector(address, address + MEMORY_SECTOR_SIZE - 1) != HAL_OK) {
+                status = BENCH_ERROR;
+            }
+            cycles += DWT->CYCCNT - start;
+        }
+        Bench_Record("erase", "1-1-0", random, status, BENCH_REGION_SIZE, cycles);
+    }
+
+    status = BENCH_OK;
+    cycles = 0;
+    for (i = 0; (i < sectors) && (status == BENCH_OK); i++) {
+        start = DWT->CYCCNT;
+        if (CSP_QSPI_WriteMemory(buffer_test, i * MEMORY_SECTOR_SIZE, MEMORY_SECTOR_SIZE) != HAL_OK) {
+            status = BENCH_ERROR;
+        }
+        cycles += DWT->CYCCNT - start;
+    }
+    if (status == BENCH_OK) {
+        status = Bench_Check(0);
+    }
+    Bench_Record("program", "1-1-4", 0, status, BENCH_REGION_SIZE, cycles);
+
+    status = BENCH_OK;
+    cycles = 0;
+    for (i = 0; (i < pages) && (status == BENCH_OK); i++) {
+        address = Bench_Shuffle(i, pages) * MEMORY_PAGE_SIZE;
+        start = DWT->CYCCNT;
+        if (CSP_QSPI_WriteMemory(&buffer_test[address % MEMORY_SECTOR_SIZE],
+                                 BENCH_REGION_SIZE + address, MEMORY_PAGE_SIZE) != HAL_OK) {
+            status = BENCH_ERROR;
+        }
+        cycles += DWT->CYCCNT - start;
+    }
+    if (status == BENCH_OK) {
+        status = Bench_Check(BENCH_REGION_SIZE);
+    }
+    Bench_Record("program", "1-1-4", 1, status, BENCH_REGION_SIZE, cycles);
+}
+
+/*
+ * Read the ascending region with every read command: indirect in chunks
+ * and in random pages, then memory-mapped in chunks and in random D-Cache
+ * lines. Sequential reads are compared with the pattern outside the timed
+ * part; the D-Cache is invalidated so that every mapped read reaches the
+ * flash.
+ */
+static void
+BenchReads(void) {
+    const uint32_t lines = BENCH_REGION_SIZE / BENCH_LINE_SIZE;
+    const uint32_t blocks = BENCH_REGION_SIZE / BENCH_RANDOM_SIZE;
+    uint64_t cycles;
+    uint32_t i, offset, start;
+    uint8_t mode, status;
+
+    for (mode = 0; mode < QSPI_READ_MODES; mode++) {
+        if (CSP_QSPI_SetReadMode((QSPI_ReadModeTypeDef) mode) != HAL_OK) {
+            Bench_Record("indirect", read_mode_names[mode], 0, BENCH_ERROR, 0, 0);
+            continue;
+        }
+
+        status = BENCH_OK;
+        cycles = 0;
+        for (offset = 0; (offset < BENCH_REGION_SIZE) && (status == BENCH_OK);
+             offset += BENCH_CHUNK_SIZE) {
+            start = DWT->CYCCNT;
+            if (CSP_QSPI_ReadMemory(bench_buffer, offset, BENCH_CHUNK_SIZE) != HAL_OK) {
+                status = BENCH_ERROR;
+            }
+            cycles += DWT->CYCCNT - start;
+            if ((status == BENCH_OK)
+                && (memcmp(bench_buffer, &buffer_test[offset % MEMORY_SECTOR_SIZE],
+                           BENCH_CHUNK_SIZE) != 0)) {
+                status = BENCH_MISMATCH;
+            }
+        }
+        Bench_Record("indirect", read_mode_names[mode], 0, status, BENCH_REGION_SIZE, cycles);
+
+        status = BENCH_OK;
+        cycles = 0;
+        for (i = 0; (i < BENCH_RANDOM_COUNT) && (status == BENCH_OK); i++) {
+            offset = Bench_Shuffle(i, blocks) * BENCH_RANDOM_SIZE;
+            start = DWT->CYCCNT;
+            if (CSP_QSPI_ReadMemory(bench_buffer, offset, BENCH_RANDOM_SIZE) != HAL_OK) {
+                status = BENCH_ERROR;
+            }
+            cycles += DWT->CYCCNT - start;
+        }
+        Bench_Record("indirect", read_mode_names[mode], 1, status,
+                     BENCH_RANDOM_COUNT * BENCH_RANDOM_SIZE, cycles);
+
+        if (CSP_QSPI_EnableMemoryMappedMode() != HAL_OK) {
+            Bench_Record("mapped", read_mode_names[mode], 0, BENCH_ERROR, 0, 0);
+            continue;
+        }
+
+#if USE_CACHE
+        SCB_InvalidateDCache();
+#endif
+        status = BENCH_OK;
+        cycles = 0;
+        for (offset = 0; offset < BENCH_REGION_SIZE; offset += BENCH_CHUNK_SIZE) {
+            start = DWT->CYCCNT;
+            memcpy(bench_buffer, (uint8_t*) (MEMORY_MAPPED_ADDRESS + offset), BENCH_CHUNK_SIZE);
+            cycles += DWT->CYCCNT - start;
+            if (memcmp(bench_buffer, &buffer_test[offset % MEMORY_SECTOR_SIZE],
+                       BENCH_CHUNK_SIZE) != 0) {
+                status = BENCH_MISMATCH;
+            }
+        }
+        Bench_Record("mapped", read_mode_names[mode], 0, status, BENCH_REGION_SIZE, cycles);
+
+#if USE_CACHE
+        SCB_InvalidateDCache();
+#endif
+        cycles = 0;
+        for (i = 0; i < BENCH_RANDOM_COUNT; i++) {
+            offset = Bench_Shuffle(i, lines) * BENCH_LINE_SIZE;
+            start = DWT->CYCCNT;
+            memcpy(bench_buffer, (uint8_t*) (MEMORY_MAPPED_ADDRESS + offset), BENCH_LINE_SIZE);
+            cycles += DWT->CYCCNT - start;
+        }
+        Bench_Record("mapped", read_mode_names[mode], 1, BENCH_OK,
+                     BENCH_RANDOM_COUNT * BENCH_LINE_SIZE, cycles);
+    }
+
+    (void) CSP_QSPI_SetReadMode(QSPI_READ_1_1_4);
+}
 
+/*
+ * Verify() over the ascending region, once with CPU reads of the mapped
+ * window and once through the MDMA ping-pong buffers. The QSPI driver is
+ * set up again first: it forgets the pages confirmed by readback, which
+ * Verify() would otherwise take from RAM without reading the flash.
+ */
+static void
+BenchVerify(void) {
+    static const char* const verify_mode_names[2] = { "cpu", "mdma" };
+    uint64_t cycles, result;
+    uint32_t offset, start;
+    uint8_t mdma, status;
+
+    for (mdma = 0; mdma < 2; mdma++) {
+        if (CSP_QUADSPI_Init() != HAL_OK) {
+            Bench_Record("verify", verify_mode_names[mdma], 0, BENCH_ERROR, 0, 0);
+            continue;
+        }
+        loader_verify_mdma = mdma;
+
+        status = BENCH_OK;
+        cycles = 0;
+        for (offset = 0; (offset < BENCH_REGION_SIZE) && (status == BENCH_OK);
+             offset += MEMORY_SECTOR_SIZE) {
+            start = DWT->CYCCNT;
+            result = Verify(MEMORY_MAPPED_ADDRESS + offset, (uint32_t) buffer_test,
+                            MEMORY_SECTOR_SIZE / 4, 0);
+            cycles += DWT->CYCCNT - start;
+            if ((uint32_t) result != 0) {
+                status = BENCH_MISMATCH;
+            }
+        }
+        Bench_Record("verify", verify_mode_names[mdma], 0, status, BENCH_REGION_SIZE, cycles);
+    }
+
+    /* Verify() leaves interrupts disabled, as the loader runs */
+    loader_verify_mdma = 1;
+    __enable_irq();
+}
+
+/*
+ * Compare the ascending region with the pattern through the mapped window
+ * and sum it, sector by sector, with the D-Cache off and then on: the sum
+ * reads each sector a second time, from the cache when it is on.
+ */
+static void
+BenchCache(void) {
+    static const char* const cache_mode_names[2] = { "dcache-off", "dcache-on" };
+    const uint8_t* sector;
+    uint64_t cycles;
+    uint32_t offset, start, i, sum, sums[2] = { 0, 0 };
+    uint8_t cached, status;
+
+    for (cached = 0; cached < (USE_CACHE ? 2 : 1); cached++) {
+        if (CSP_QSPI_EnableMemoryMappedMode() != HAL_OK) {
+            Bench_Record("compare", cache_mode_names[cached], 0, BENCH_ERROR, 0, 0);
+            continue;
+        }
+#if USE_CACHE
+        if (cached) {
+            SCB_EnableDCache();
+        } else {
+            SCB_DisableDCache();
+        }
+#endif
+
+        status = BENCH_OK;
+        cycles = 0;
+        sum = 0;
+        for (offset = 0; (offset < BENCH_REGION_SIZE) && (status == BENCH_OK);
+             offset += MEMORY_SECTOR_SIZE) {
+            sector = (const uint8_t*) (MEMORY_MAPPED_ADDRESS + offset);
+            start = DWT->CYCCNT;
+            if (memcmp(buffer_test, sector, MEMORY_SECTOR_SIZE) != 0) {
+                status = BENCH_MISMATCH;
+            }
+            for (i = 0; i < MEMORY_SECTOR_SIZE; i++) {
+                sum += sector[i];
+            }
+            cycles += DWT->CYCCNT - start;
+        }
+        sums[cached] = sum;
+        if ((status == BENCH_OK) && cached && (sums[1] != sums[0])) {
+            status = BENCH_MISMATCH;
+        }
+        Bench_Record("compare", cache_mode_names[cached], 0, status, BENCH_REGION_SIZE, cycles);
+    }
+
+#if USE_CACHE
+    SCB_EnableDCache();
+#endif
+}
+
+/*
+ * Program WRITE_BENCH_SIZE bytes into the last sector of each slice of the
+ * flash, past the benchmark regions: the latency must not depend on the
+ * target address. A failed erase or program records BENCH_ERROR for its
+ * slice and the others are still measured.
+ */
+static void
+WriteLatencyByOffset(void) {
+    uint32_t i, start;
+    uint8_t status;
+
+    for (i = 0; i < WRITE_BENCH_POINTS; i++) {
+        write_offsets[i] = (i + 1) * (MEMORY_FLASH_SIZE / WRITE_BENCH_POINTS)
+                           - MEMORY_SECTOR_SIZE + MEMORY_PAGE_SIZE / 2;
+        write_cycles[i] = 0;
+
+        status = BENCH_OK;
+        if (CSP_QSPI_EraseSector(write_offsets[i], write_offsets[i]) != HAL_OK) {
+            status = BENCH_ERROR;
+        } else {
+            start = DWT->CYCCNT;
+            if (CSP_QSPI_WriteMemory(buffer_test, write_offsets[i], WRITE_BENCH_SIZE) != HAL_OK) {
+                status = BENCH_ERROR;
+            } else {
+                write_cycles[i] = DWT->CYCCNT - start;
+            }
+        }
+        Bench_Record("write", write_slice_names[i], 0, status,
+                     (status == BENCH_OK) ? WRITE_BENCH_SIZE : 0, write_cycles[i]);
+    }
+}
+
+static void
+PrintBench(void) {
+    char line[80];
+    uint32_t i, mb_milli;
+    int length;
+
+    HAL_UART_Transmit(&huart1, (uint8_t*) BENCH_CSV_HEADER, strlen(BENCH_CSV_HEADER),
+                      HAL_MAX_DELAY);
+    for (i = 0; i < bench_count; i++) {
+        mb_milli = (uint32_t) ((uint64_t) bench_results[i].kb_per_s * 1000 / 1024);
+        length = snprintf(line, sizeof(line), "%s,%s,%s,%lu,%lu,%lu.%03lu,%u\n",
+                          bench_results[i].op, bench_results[i].mode,
+                          bench_results[i].random ? "random" : "sequential",
+                          (unsigned long) bench_results[i].bytes,
+                          (unsigned long) bench_results[i].us,
+                          (unsigned long) (mb_milli / 1000), (unsigned long) (mb_milli % 1000),
+                          (unsigned) bench_results[i].status);
+        HAL_UART_Transmit(&huart1, (uint8_t*) line, length, HAL_MAX_DELAY);
+    }
+}
+
+#if MICROBENCH
+static void
+RunMicrobench(void) {
+    char line[96];
+    uint32_t i;
+
+    microbench_count = Microbench_Run(microbench_a, microbench_b, sizeof(microbench_a),
+                                      microbench_results, MICROBENCH_MAX_RESULTS);
+
+    HAL_UART_Transmit(&huart1, (uint8_t*) MICROBENCH_CSV_HEADER,
+                      strlen(MICROBENCH_CSV_HEADER), HAL_MAX_DELAY);
+    for (i = 0; i < microbench_count; i++) {
+        HAL_UART_Transmit(&huart1, (uint8_t*) line,
+                          Microbench_Format(&microbench_results[i], line, sizeof(line)),
+                          HAL_MAX_DELAY);
+    }
+}
+#endif
 /* USER CODE END 0 */
 
 /**
@@ -69,7 +480,19 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+#if LOADER_LEAN
+  /* Only reachable through the vector table kept in the loader image: stop
+     here so --gc-sections drops the benchmark, USART and HAL RCC code */
+  while (1)
+  {
+  }
+#endif
+  Tcm_Init();
+#if USE_CACHE
+  MPU_Config();
+  SCB_EnableICache();
+  SCB_EnableDCache();
+#endif
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -94,42 +517,36 @@ int main(void)
   MX_QUADSPI_Init();
   /* USER CODE BEGIN 2 */
   CSP_QUADSPI_Init();
+  MX_MDMA_Init();
 
-  for (var = 0; var < MEMORY_SECTOR_SIZE; var++) {
-      buffer_test[var] = (var & 0xff);
-  }
-
-  for (var = 0; var < SECTORS_COUNT; var++) {
-
-      if (CSP_QSPI_EraseSector(var * MEMORY_SECTOR_SIZE,
-                               (var + 1) * MEMORY_SECTOR_SIZE - 1) != HAL_OK) {
-
-          while (1)
-              ;  //breakpoint - error detected
-      }
-
-      if (CSP_QSPI_WriteMemory(buffer_test, var * MEMORY_SECTOR_SIZE, sizeof(buffer_test)) != HAL_OK) {
-
-          while (1)
-              ;  //breakpoint - error detected
-      }
-
+#if UART_STREAM
+  /* Fixture build: serve image downloads on USART1, one after the other */
+  while (1)
+  {
+    (void) UartStream_Run(&huart1);
   }
+#endif
 
-  if (CSP_QSPI_EnableMemoryMappedMode() != HAL_OK) {
+#if MICROBENCH
+  RunMicrobench();
+#endif
 
-      while (1)
-          ; //breakpoint - error detected
+  for (var = 0; var < MEMORY_SECTOR_SIZE; var++) {
+      buffer_test[var] = (var & 0xff);
   }
 
-  for (var = 0; var < SECTORS_COUNT; var++) {
-      if (memcmp(buffer_test,
-                 (uint8_t*) (0x90000000 + var * MEMORY_SECTOR_SIZE),
-                 MEMORY_SECTOR_SIZE) != HAL_OK) {
-          while (1)
-              ;  //breakpoint - error detected - otherwise QSPI works properly
-      }
-  }
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  /* Erase, program and read throughput; a failed row is recorded, not fatal */
+  BenchEraseProgram();
+  BenchReads();
+  BenchVerify();
+  BenchCache();
+  WriteLatencyByOffset();
+  PrintBench();
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -203,6 +620,51 @@ void SystemClock_Config(void)
 
 /* USER CODE BEGIN 4 */
 
+/**
+  * @brief MPU Configuration
+  *        The QSPI bank is inaccessible unless the flash is memory-mapped, so
+  *        no speculative read can reach the peripheral in indirect mode. The
+  *        mapped window and RAM_D1 are write-through cacheable, which keeps
+  *        the RAM seen by the debugger coherent without cache cleaning.
+  * @retval None
+  */
+void MPU_Config(void)
+{
+  MPU_Region_InitTypeDef MPU_InitStruct = {0};
+
+  HAL_MPU_Disable();
+
+  MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+  MPU_InitStruct.Number = MPU_REGION_QSPI_BACKGROUND;
+  MPU_InitStruct.BaseAddress = MEMORY_MAPPED_ADDRESS;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_256MB;
+  MPU_InitStruct.SubRegionDisable = 0x0;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL0;
+  MPU_InitStruct.AccessPermission = MPU_REGION_NO_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /* Enabled by the QSPI driver while memory-mapped */
+  MPU_InitStruct.Enable = MPU_REGION_DISABLE;
+  MPU_InitStruct.Number = MPU_REGION_QSPI_MAPPED;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_64MB;
+  MPU_InitStruct.AccessPermission = MPU_REGION_PRIV_RO_URO;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_CACHEABLE;
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+  MPU_InitStruct.Number = MPU_REGION_RAM_D1;
+  MPU_InitStruct.BaseAddress = D1_AXISRAM_BASE;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_512KB;
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_ENABLE;
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+}
 /* USER CODE END 4 */
 
 /**
@@ -0,0 +1,153 @@
+/*
+ * microbench.c
+ *
+ */
+#include "microbench.h"
+
+#if MICROBENCH
+#include "Loader_Src.h"
+#include "quadspi.h"
+#include "main.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef MICROBENCH_HOST
+#include <time.h>
+#endif
+
+#define MICROBENCH_POINT_BYTES  0x1000000   /* small sizes repeat up to this many bytes */
+#define MICROBENCH_MIN_REPEATS  3
+#define MICROBENCH_MAX_REPEATS  1000
+#define MICROBENCH_SLACK        3           /* bytes past size used by the misaligned runs */
+
+static const uint32_t sizes[] = {
+    1, 3, 4, 15, 64, 255, 256, 0x400, 0x1000, 0x4000,
+    0x10000, 0x40000, 0x100000, 0x400000, 0x1000000, 0x4000000,
+};
+
+static const char* const kernel_names[MICROBENCH_KERNELS] = {
+    "checksum", "compare", "blank", "plan",
+};
+
+/* Keeps the kernel results alive */
+volatile uint32_t microbench_sink;
+
+static inline uint32_t
+Microbench_Ticks(void) {
+#ifdef MICROBENCH_HOST
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec);
+#else
+    return DWT->CYCCNT;
+#endif
+}
+
+static uint32_t
+Microbench_Call(uint8_t kernel, const uint8_t* a, const uint8_t* b, uint32_t size,
+                uint32_t address) {
+    QSPI_PagePlanTypeDef plan;
+    uint32_t pages = 0;
+
+    switch (kernel) {
+        case MICROBENCH_CHECKSUM:
+            return CheckSum((uintptr_t) a, size, 0);
+        case MICROBENCH_COMPARE:
+            return Loader_Compare(a, b, size);
+        case MICROBENCH_BLANK:
+            return Loader_IsBlank(a, size);
+        case MICROBENCH_PLAN:
+            CSP_QSPI_PlanInit(&plan, address, size);
+            while (CSP_QSPI_PlanNext(&plan)) {
+                pages++;
+            }
+            return pages;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Both buffers hold the erased value, so compare and blank detection run
+ * over the whole size. Each point keeps the fastest of its repeats, which
+ * filters out interrupts and cold caches.
+ */
+uint32_t
+Microbench_Run(uint8_t* a, uint8_t* b, uint32_t capacity,
+               Microbench_ResultTypeDef* results, uint32_t max_results) {
+    uint32_t count = 0, overhead = 0xFFFFFFFF, ticks_hz, repeats, best, start, elapsed;
+    uint32_t i, r;
+    uint8_t kernel, misaligned;
+
+#ifdef MICROBENCH_HOST
+    ticks_hz = 1000000000u;
+#else
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    ticks_hz = SystemCoreClock;
+#endif
+
+    memset(a, 0xFF, capacity);
+    memset(b, 0xFF, capacity);
+
+    for (r = 0; r < MICROBENCH_MAX_REPEATS; r++) {
+        start = Microbench_Ticks();
+        elapsed = Microbench_Ticks() - start;
+        if (elapsed < overhead) {
+            overhead = elapsed;
+        }
+    }
+
+    for (kernel = 0; kernel < MICROBENCH_KERNELS; kernel++) {
+        for (misaligned = 0; misaligned < 2; misaligned++) {
+            for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                if (sizes[i] > capacity - MICROBENCH_SLACK) {
+                    break;
+                }
+                if (count == max_results) {
+                    return count;
+                }
+
+                repeats = MICROBENCH_POINT_BYTES / sizes[i];
+                if (repeats < MICROBENCH_MIN_REPEATS) {
+                    repeats = MICROBENCH_MIN_REPEATS;
+                } else if (repeats > MICROBENCH_MAX_REPEATS) {
+                    repeats = MICROBENCH_MAX_REPEATS;
+                }
+
+                best = 0xFFFFFFFF;
+                for (r = 0; r < repeats; r++) {
+                    start = Microbench_Ticks();
+                    microbench_sink += Microbench_Call(kernel, a + misaligned, b + 3 * misaligned,
+                                                       sizes[i], misaligned);
+                    elapsed = Microbench_Ticks() - start;
+                    if (elapsed < best) {
+                        best = elapsed;
+                    }
+                }
+
+                results[count].kernel = kernel;
+                results[count].misaligned = misaligned;
+                results[count].reserved = 0;
+                results[count].size = sizes[i];
+                results[count].repeats = repeats;
+                results[count].ticks = (best > overhead) ? best - overhead : 0;
+                results[count].ticks_hz = ticks_hz;
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+int
+Microbench_Format(const Microbench_ResultTypeDef* result, char* line, uint32_t length) {
+    return snprintf(line, length, "%s,%u,%lu,%lu,%lu,%lu\n",
+                    kernel_names[result->kernel % MICROBENCH_KERNELS],
+                    (unsigned) result->misaligned, (unsigned long) result->size,
+                    (unsigned long) result->repeats, (unsigned long) result->ticks,
+                    (unsigned long) result->ticks_hz);
+}
+#endif
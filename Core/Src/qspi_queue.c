@@ -0,0 +1,222 @@
+/*
+ * qspi_queue.c
+ *
+ */
+#include "qspi_queue.h"
+#include "quadspi.h"
+#include "loader_trace.h"
+
+static uint8_t QSPI_Queue_Issue(QSPI_QueueDescTypeDef* desc);
+static void QSPI_Queue_Resume(void);
+static void QSPI_Queue_Cancel(void);
+static void QSPI_Queue_Advance(void);
+
+static QSPI_QueueDescTypeDef queue[QSPI_QUEUE_DEPTH];
+static volatile uint32_t queue_head = 0;    /* next descriptor to complete */
+static volatile uint32_t queue_tail = 0;    /* next free slot */
+static volatile uint32_t queue_completed = 0;
+static volatile uint8_t queue_running = 0;
+static volatile uint8_t queue_error = 0;
+static volatile uint8_t queue_deferred = 0; /* next step left to QSPI_Queue_Wait() */
+#if LOADER_TRACE
+static uint32_t queue_trace_slot;           /* trace entry of the running step */
+#endif
+
+/*Append a descriptor, starting the engine when it is idle*/
+uint8_t
+QSPI_Queue_Push(const QSPI_QueueDescTypeDef* desc) {
+    uint32_t primask;
+    uint8_t status = HAL_OK;
+
+    if (queue_error || ((queue_tail - queue_head) >= QSPI_QUEUE_DEPTH)) {
+        return HAL_ERROR;
+    }
+
+    queue[queue_tail % QSPI_QUEUE_DEPTH] = *desc;
+
+    /* The interrupt may retire the last running step meanwhile */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    queue_tail++;
+    if (!queue_running) {
+        queue_running = 1;
+        if (__HAL_QSPI_GET_FLAG(&hqspi, QSPI_FLAG_BUSY)) {
+            queue_deferred = 1;
+        } else if (QSPI_Queue_Issue(&queue[queue_head % QSPI_QUEUE_DEPTH]) != HAL_OK) {
+            queue_running = 0;
+            queue_error = 1;
+            status = HAL_ERROR;
+        }
+    }
+    __set_PRIMASK(primask);
+
+    return status;
+}
+
+/*Wait until every pushed descriptor completed, starting the steps the
+ *interrupt left behind; on failure the peripheral is back in indirect mode*/
+uint8_t
+QSPI_Queue_Wait(uint32_t Timeout) {
+
+    uint32_t tickstart = HAL_GetTick();
+
+    while (queue_running) {
+        if (queue_deferred) {
+            QSPI_Queue_Resume();
+        }
+        if (queue_error || ((HAL_GetTick() - tickstart) > Timeout)) {
+            QSPI_Queue_Cancel();
+            return HAL_ERROR;
+        }
+    }
+
+    if (queue_error) {
+        QSPI_Queue_Cancel();
+        return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
+
+uint8_t
+QSPI_Queue_IsIdle(void) {
+    return !queue_running;
+}
+
+/*Descriptors completed since start-up, for producers tracking progress*/
+uint32_t
+QSPI_Queue_Completed(void) {
+    return queue_completed;
+}
+
+/*Drop pending descriptors, the caller aborts the peripheral if needed*/
+void
+QSPI_Queue_Reset(void) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    queue_head = queue_tail;
+    queue_running = 0;
+    queue_error = 0;
+    queue_deferred = 0;
+    __set_PRIMASK(primask);
+}
+
+static uint8_t
+QSPI_Queue_Issue(QSPI_QueueDescTypeDef* desc) {
+
+    switch (desc->op) {
+        case QSPI_QUEUE_CMD:
+#if LOADER_TRACE
+            queue_trace_slot = Trace_Begin(&desc->command, TRACE_KIND_COMMAND);
+#endif
+            return HAL_QSPI_Command_IT(&hqspi, &desc->command);
+
+        case QSPI_QUEUE_TX:
+#if LOADER_TRACE
+            queue_trace_slot = Trace_Begin(&desc->command, TRACE_KIND_TRANSMIT);
+#endif
+            /* With a data phase the command only configures the transfer */
+            if (HAL_QSPI_Command_IT(&hqspi, &desc->command) != HAL_OK) {
+                return HAL_ERROR;
+            }
+            return HAL_QSPI_Transmit_IT(&hqspi, desc->data);
+
+        case QSPI_QUEUE_POLL:
+#if LOADER_TRACE
+            queue_trace_slot = Trace_Begin(&desc->command, TRACE_KIND_POLL);
+#endif
+            return HAL_QSPI_AutoPolling_IT(&hqspi, &desc->command, &desc->polling);
+
+        default:
+            return HAL_ERROR;
+    }
+}
+
+/*Start the step the interrupt deferred, once BUSY has dropped. Interrupts
+ *stay enabled while waiting for it, so the HAL's own wait ends at once*/
+static void
+QSPI_Queue_Resume(void) {
+    uint32_t primask;
+
+    if (__HAL_QSPI_GET_FLAG(&hqspi, QSPI_FLAG_BUSY)) {
+        return;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (queue_deferred) {
+        queue_deferred = 0;
+        if (QSPI_Queue_Issue(&queue[queue_head % QSPI_QUEUE_DEPTH]) != HAL_OK) {
+            queue_running = 0;
+            queue_error = 1;
+        }
+    }
+    __set_PRIMASK(primask);
+}
+
+/*Drop the queue and stop the running step, leaving the peripheral idle in
+ *indirect mode for the caller's next command*/
+static void
+QSPI_Queue_Cancel(void) {
+    QSPI_Queue_Reset();
+    (void) HAL_QSPI_Abort(&hqspi);
+    (void) CSP_QSPI_EnterIndirectMode();
+}
+
+/*Retire the running descriptor and start the next one, interrupt context.
+ *The HAL calls starting a step first wait for BUSY to drop, bounded only
+ *by HAL_GetTick(), which the lower priority SysTick cannot advance here:
+ *while BUSY is still set the step is left to QSPI_Queue_Wait() instead*/
+static void
+QSPI_Queue_Advance(void) {
+
+    if (!queue_running) {
+        return;
+    }
+
+#if LOADER_TRACE
+    Trace_End(queue_trace_slot, HAL_OK);
+#endif
+    queue_head++;
+    queue_completed++;
+
+    if (queue_head == queue_tail) {
+        queue_running = 0;
+    } else if (__HAL_QSPI_GET_FLAG(&hqspi, QSPI_FLAG_BUSY)) {
+        queue_deferred = 1;
+    } else if (QSPI_Queue_Issue(&queue[queue_head % QSPI_QUEUE_DEPTH]) != HAL_OK) {
+        queue_running = 0;
+        queue_error = 1;
+    }
+}
+
+void
+HAL_QSPI_CmdCpltCallback(QSPI_HandleTypeDef* qspiHandle) {
+    (void) qspiHandle;
+    QSPI_Queue_Advance();
+}
+
+void
+HAL_QSPI_TxCpltCallback(QSPI_HandleTypeDef* qspiHandle) {
+    (void) qspiHandle;
+    QSPI_Queue_Advance();
+}
+
+void
+HAL_QSPI_StatusMatchCallback(QSPI_HandleTypeDef* qspiHandle) {
+    (void) qspiHandle;
+    QSPI_Queue_Advance();
+}
+
+void
+HAL_QSPI_ErrorCallback(QSPI_HandleTypeDef* qspiHandle) {
+    (void) qspiHandle;
+#if LOADER_TRACE
+    if (queue_running) {
+        Trace_End(queue_trace_slot, HAL_ERROR);
+    }
+#endif
+    queue_running = 0;
+    queue_error = 1;
+}
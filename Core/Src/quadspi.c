@@ -21,13 +21,111 @@
 #include "quadspi.h"
 
 /* USER CODE BEGIN 0 */
+#include <string.h>
+#include "crc32.h"
+#include "qspi_queue.h"
+#include "loader_stats.h"
+#include "loader_trace.h"
+#include "loader_tcm.h"
+#include "loader_lean.h"
+
+/*QSPI driver behind the command paths: the HAL, or the register-level one of the lean build*/
+#if LOADER_LEAN
+#define QSPI_DRIVER(name)   Lean_QSPI_##name
+#else
+#define QSPI_DRIVER(name)   HAL_QSPI_##name
+#endif
+
 static uint8_t QSPI_WriteEnable(void);
-static uint8_t QSPI_AutoPollingMemReady(uint32_t Timeout);
+static uint8_t QSPI_AutoPollingMemReady(uint32_t Interval, uint32_t Timeout);
+static uint8_t QSPI_CheckFlagStatus(uint32_t address, uint32_t size);
 static uint8_t QSPI_Configuration(void);
 static uint8_t QSPI_ResetChip(void);
+static uint8_t QSPI_InitChip(void);
+static uint8_t QSPI_SelectChip(uint32_t chip);
+static uint8_t QSPI_UseChip(uint32_t chip);
+static void QSPI_SetBusy(uint32_t chip, uint32_t address, uint32_t size,
+                         uint32_t Interval, uint32_t Timeout);
+static uint8_t QSPI_WaitChips(void);
+static uint8_t QSPI_IssueErase(QSPI_CommandTypeDef* sCommand, uint32_t sector);
+static void QSPI_InvalidateTrackedRange(uint32_t start, uint32_t end);
+static void QSPI_MemReadyPollingConfig(QSPI_CommandTypeDef* sCommand,
+                                       QSPI_AutoPollingTypeDef* sConfig, uint32_t Interval);
+static void QSPI_UpdateProgramRun(const uint8_t* buffer, uint32_t address, uint32_t size);
+static uint8_t QSPI_ProgramMemory(uint8_t* buffer, uint32_t address, uint32_t buffer_size);
+
+static uint8_t QSPI_Command(QSPI_CommandTypeDef* sCommand, uint32_t Timeout);
+static uint8_t QSPI_Transmit(QSPI_CommandTypeDef* sCommand, uint8_t* data, uint32_t Timeout);
+static uint8_t QSPI_Receive(QSPI_CommandTypeDef* sCommand, uint8_t* data, uint32_t Timeout);
+static uint8_t QSPI_AutoPolling(QSPI_CommandTypeDef* sCommand, QSPI_AutoPollingTypeDef* sConfig,
+                                uint32_t Timeout);
+static uint8_t QSPI_MemoryMapped(QSPI_CommandTypeDef* sCommand,
+                                 QSPI_MemoryMappedTypeDef* sMemMappedCfg);
+static uint8_t QSPI_Abort(void);
+static void QSPI_ReadCommandConfig(QSPI_CommandTypeDef* sCommand);
+
+/* Contiguous run of programmed data and its checksums */
+static QSPI_ProgramRunTypeDef program_run;
+static QSPI_FlagErrorTypeDef flag_error;
+
+static void QSPI_WriteEnableConfig(QSPI_CommandTypeDef* sCommand,
+                                   QSPI_CommandTypeDef* sPollCommand,
+                                   QSPI_AutoPollingTypeDef* sConfig);
+
+#if QSPI_PROGRAM_POLL_IT
+static uint8_t QSPI_QueueProgramPage(QSPI_CommandTypeDef* sCommand, uint8_t* data);
+#endif
+
+#if QSPI_WRITE_READBACK_VERIFY
+static uint8_t QSPI_ReadbackPage(const uint8_t* buffer, uint32_t address, uint32_t size);
+static void QSPI_RecordDigest(uint32_t address, uint32_t size, uint32_t crc);
+
+/* Range [start, end) confirmed by readback since the last erase */
+static uint32_t verified_start = 0;
+static uint32_t verified_end = 0;
+static uint8_t readback_buffer[MEMORY_PAGE_SIZE] LOADER_DTCM;
+
+/*CRC-32 of the source of a QSPI_ProgramMemory() call*/
+typedef struct {
+    uint32_t start;                 /* first flash offset programmed */
+    uint32_t end;                   /* flash offset following the data */
+    uint32_t crc;
+} QSPI_DigestTypeDef;
+
+/* Last writes, oldest overwritten first, none overlapping another */
+static QSPI_DigestTypeDef write_digests[QSPI_WRITE_DIGESTS];
+static uint32_t write_digest_next = 0;
+#endif
+
+static QSPI_ModeTypeDef qspi_mode = QSPI_MODE_IDLE;
+static QSPI_ReadModeTypeDef read_mode = QSPI_READ_1_1_4;
+
+/*Erase left running in a chip, waited for before the chip is used again*/
+typedef struct {
+    uint8_t busy;
+    uint32_t address;               /* flash offset of the sector or chip being erased */
+    uint32_t size;
+    uint32_t interval;              /* automatic polling interval matching the operation */
+    uint32_t timeout;
+} QSPI_ChipStateTypeDef;
+
+static QSPI_ChipStateTypeDef chip_state[QSPI_CHIPS];
+#if QSPI_CONCAT
+static uint32_t chip_selected = 0;  /* chip behind the FSEL bit, in every mode */
+#endif
+
+#if USE_CACHE
+static void QSPI_MarkCacheStale(uint32_t start, uint32_t end);
+static void QSPI_SetMappedRegion(uint32_t enable);
+
+/* Flash range [start, end) changed since the D-Cache last saw it */
+static uint32_t stale_start = 0;
+static uint32_t stale_end = 0;
+#endif
 /* USER CODE END 0 */
 
 QSPI_HandleTypeDef hqspi;
+QSPI_ModeStatsTypeDef qspi_mode_stats;
 
 /* QUADSPI init function */
 void MX_QUADSPI_Init(void)
@@ -133,6 +231,29 @@ void HAL_QSPI_MspInit(QSPI_HandleTypeDef* qspiHandle)
     HAL_NVIC_SetPriority(QUADSPI_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(QUADSPI_IRQn);
   /* USER CODE BEGIN QUADSPI_MspInit 1 */
+#if QSPI_CONCAT
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    __HAL_RCC_GPIOH_CLK_ENABLE();
+    /**Second chip, selected by the FSEL bit
+    PC11     ------> QUADSPI_BK2_NCS
+    PH2     ------> QUADSPI_BK2_IO0
+    PH3     ------> QUADSPI_BK2_IO1
+    PG9     ------> QUADSPI_BK2_IO2
+    PG14     ------> QUADSPI_BK2_IO3
+    */
+    GPIO_InitStruct.Pin = GPIO_PIN_11;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate = GPIO_AF9_QUADSPI;
+    HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+
+    GPIO_InitStruct.Pin = GPIO_PIN_2|GPIO_PIN_3;
+    HAL_GPIO_Init(GPIOH, &GPIO_InitStruct);
+
+    GPIO_InitStruct.Pin = GPIO_PIN_9|GPIO_PIN_14;
+    HAL_GPIO_Init(GPIOG, &GPIO_InitStruct);
+#endif
 
   /* USER CODE END QUADSPI_MspInit 1 */
   }
@@ -166,6 +287,13 @@ void HAL_QSPI_MspDeInit(QSPI_HandleTypeDef* qspiHandle)
     /* QUADSPI interrupt Deinit */
     HAL_NVIC_DisableIRQ(QUADSPI_IRQn);
   /* USER CODE BEGIN QUADSPI_MspDeInit 1 */
+#if QSPI_CONCAT
+    HAL_GPIO_DeInit(GPIOC, GPIO_PIN_11);
+
+    HAL_GPIO_DeInit(GPIOH, GPIO_PIN_2|GPIO_PIN_3);
+
+    HAL_GPIO_DeInit(GPIOG, GPIO_PIN_9|GPIO_PIN_14);
+#endif
 
   /* USER CODE END QUADSPI_MspDeInit 1 */
   }
@@ -173,16 +301,102 @@ void HAL_QSPI_MspDeInit(QSPI_HandleTypeDef* qspiHandle)
 
 /* USER CODE BEGIN 1 */
 
+/*Command paths, each step recorded in the command trace*/
+static uint8_t
+QSPI_Command(QSPI_CommandTypeDef* sCommand, uint32_t Timeout) {
+    uint32_t slot = TRACE_BEGIN(sCommand, TRACE_KIND_COMMAND);
+    uint8_t status = QSPI_DRIVER(Command)(&hqspi, sCommand, Timeout);
+
+    TRACE_END(slot, status);
+    return status;
+}
+
+static uint8_t
+QSPI_Transmit(QSPI_CommandTypeDef* sCommand, uint8_t* data, uint32_t Timeout) {
+    uint32_t slot = TRACE_BEGIN(sCommand, TRACE_KIND_TRANSMIT);
+    uint8_t status = QSPI_DRIVER(Transmit)(&hqspi, data, Timeout);
+
+    TRACE_END(slot, status);
+    return status;
+}
+
+static uint8_t
+QSPI_Receive(QSPI_CommandTypeDef* sCommand, uint8_t* data, uint32_t Timeout) {
+    uint32_t slot = TRACE_BEGIN(sCommand, TRACE_KIND_RECEIVE);
+    uint8_t status = QSPI_DRIVER(Receive)(&hqspi, data, Timeout);
+
+    TRACE_END(slot, status);
+    return status;
+}
+
+static uint8_t
+QSPI_AutoPolling(QSPI_CommandTypeDef* sCommand, QSPI_AutoPollingTypeDef* sConfig,
+                 uint32_t Timeout) {
+    uint32_t slot = TRACE_BEGIN(sCommand, TRACE_KIND_POLL);
+    uint8_t status = QSPI_DRIVER(AutoPolling)(&hqspi, sCommand, sConfig, Timeout);
+
+    TRACE_END(slot, status);
+    return status;
+}
+
+static uint8_t
+QSPI_MemoryMapped(QSPI_CommandTypeDef* sCommand, QSPI_MemoryMappedTypeDef* sMemMappedCfg) {
+    uint32_t slot = TRACE_BEGIN(sCommand, TRACE_KIND_MAPPED);
+    uint8_t status = QSPI_DRIVER(MemoryMapped)(&hqspi, sCommand, sMemMappedCfg);
+
+    TRACE_END(slot, status);
+    return status;
+}
+
+static uint8_t
+QSPI_Abort(void) {
+    uint32_t slot = TRACE_BEGIN(NULL, TRACE_KIND_ABORT);
+    uint8_t status = QSPI_DRIVER(Abort)(&hqspi);
+
+    TRACE_END(slot, status);
+    return status;
+}
+
 /* QUADSPI init function */
 uint8_t
 CSP_QUADSPI_Init(void) {
+    uint32_t chip;
+
     //prepare QSPI peripheral for ST-Link Utility operations
+#if LOADER_LEAN
+    if (Lean_QSPI_Init(&hqspi) != HAL_OK) {
+        return HAL_ERROR;
+    }
+#else
 	hqspi.Instance = QUADSPI;
     if (HAL_QSPI_DeInit(&hqspi) != HAL_OK) {
         return HAL_ERROR;
     }
 
     MX_QUADSPI_Init();
+#endif
+    qspi_mode = QSPI_MODE_IDLE;
+#if QSPI_CONCAT
+    chip_selected = 0;
+#endif
+    /* The reset of each chip ends whatever it was still doing */
+    memset(chip_state, 0, sizeof(chip_state));
+
+    /* A reset leaves the flash contents alone: the range confirmed by
+     * readback and the program run stay valid until an erase or program */
+
+    for (chip = 0; chip < QSPI_CHIPS; chip++) {
+        if ((QSPI_SelectChip(chip) != HAL_OK) || (QSPI_InitChip() != HAL_OK)) {
+            return HAL_ERROR;
+        }
+    }
+
+    return HAL_OK;
+}
+
+/*Reset the selected chip and set it up for quad transfers*/
+static uint8_t
+QSPI_InitChip(void) {
 
     if (QSPI_ResetChip() != HAL_OK) {
         return HAL_ERROR;
@@ -190,10 +404,14 @@ CSP_QUADSPI_Init(void) {
 
     HAL_Delay(1);
 
-    if (QSPI_AutoPollingMemReady(HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+    if (QSPI_AutoPollingMemReady(QSPI_POLL_INTERVAL_PROGRAM,
+                                 HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
         return HAL_ERROR;
     }
 
+    /* Clear error flags a previous session left set */
+    (void) QSPI_CheckFlagStatus(0, 0);
+
     if (QSPI_WriteEnable() != HAL_OK) {
 
         return HAL_ERROR;
@@ -203,7 +421,8 @@ CSP_QUADSPI_Init(void) {
         return HAL_ERROR;
     }
 
-    if (QSPI_AutoPollingMemReady(HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+    if (QSPI_AutoPollingMemReady(QSPI_POLL_INTERVAL_PROGRAM,
+                                 HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
         return HAL_ERROR;
     }
 
@@ -214,12 +433,16 @@ CSP_QUADSPI_Init(void) {
 uint8_t
 CSP_QSPI_Erase_Chip(void) {
     QSPI_CommandTypeDef sCommand;
+    uint32_t chip;
 
-
-    if (QSPI_WriteEnable() != HAL_OK) {
+    if (CSP_QSPI_EnterIndirectMode() != HAL_OK) {
         return HAL_ERROR;
     }
 
+    QSPI_InvalidateTrackedRange(0, MEMORY_FLASH_SIZE);
+#if USE_CACHE
+    QSPI_MarkCacheStale(0, MEMORY_FLASH_SIZE);
+#endif
 
     /* Erasing Sequence --------------------------------- */
     sCommand.Instruction = CHIP_ERASE_CMD;
@@ -234,90 +457,291 @@ CSP_QSPI_Erase_Chip(void) {
     sCommand.DataMode = QSPI_DATA_NONE;
     sCommand.DummyCycles = 0;
 
+    /* Every chip erases at the same time */
+    for (chip = 0; chip < QSPI_CHIPS; chip++) {
+        if (QSPI_UseChip(chip) != HAL_OK) {
+            return HAL_ERROR;
+        }
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-        != HAL_OK) {
-        return HAL_ERROR;
+        if (QSPI_WriteEnable() != HAL_OK) {
+            return HAL_ERROR;
+        }
+
+        if (STATS_TIMED(STATS_COMMAND,
+                        QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE))
+            != HAL_OK) {
+            return HAL_ERROR;
+        }
+        QSPI_SetBusy(chip, chip * MEMORY_CHIP_SIZE, MEMORY_CHIP_SIZE,
+                     QSPI_POLL_INTERVAL_CHIP_ERASE, QUADSPI_MAX_ERASE_TIMEOUT);
     }
 
-    if (QSPI_AutoPollingMemReady(QUADSPI_MAX_ERASE_TIMEOUT) != HAL_OK) {
+    return QSPI_WaitChips();
+}
+
+static uint8_t
+QSPI_AutoPollingMemReady(uint32_t Interval, uint32_t Timeout) {
+
+    QSPI_CommandTypeDef sCommand;
+    QSPI_AutoPollingTypeDef sConfig;
+    STATS_SCOPE(STATS_AUTO_POLL);
+
+    /* Configure automatic polling mode to wait for memory ready ------ */
+    QSPI_MemReadyPollingConfig(&sCommand, &sConfig, Interval);
+
+    qspi_mode = QSPI_MODE_AUTO_POLLING;
+    if (QSPI_AutoPolling(&sCommand, &sConfig, Timeout) != HAL_OK) {
         return HAL_ERROR;
     }
-
+    qspi_mode = QSPI_MODE_INDIRECT;
 
     return HAL_OK;
 }
 
+/*Poll the flag status register until the program/erase controller is ready*/
+static void
+QSPI_MemReadyPollingConfig(QSPI_CommandTypeDef* sCommand, QSPI_AutoPollingTypeDef* sConfig,
+                           uint32_t Interval) {
+
+    sCommand->InstructionMode = QSPI_INSTRUCTION_1_LINE;
+    sCommand->Instruction = READ_FLAG_STATUS_REG_CMD;
+    sCommand->AddressMode = QSPI_ADDRESS_NONE;
+    sCommand->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    sCommand->DataMode = QSPI_DATA_1_LINE;
+    sCommand->DummyCycles = 0;
+    sCommand->DdrMode = QSPI_DDR_MODE_DISABLE;
+    sCommand->DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+    sCommand->SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+
+    sConfig->Match = QSPI_FSR_READY;
+    sConfig->Mask = QSPI_FSR_READY;
+    sConfig->MatchMode = QSPI_MATCH_MODE_AND;
+    sConfig->StatusBytesSize = 1;
+    sConfig->Interval = Interval;
+    sConfig->AutomaticStop = QSPI_AUTOMATIC_STOP_ENABLE;
+}
+
+/*Report and clear the error flags left by the program or erase just completed*/
 static uint8_t
-QSPI_AutoPollingMemReady(uint32_t Timeout) {
+QSPI_CheckFlagStatus(uint32_t address, uint32_t size) {
 
     QSPI_CommandTypeDef sCommand;
-    QSPI_AutoPollingTypeDef sConfig;
+    uint8_t status;
 
-    /* Configure automatic polling mode to wait for memory ready ------ */
     sCommand.InstructionMode = QSPI_INSTRUCTION_1_LINE;
-    sCommand.Instruction = READ_STATUS_REG_CMD;
+    sCommand.Instruction = READ_FLAG_STATUS_REG_CMD;
     sCommand.AddressMode = QSPI_ADDRESS_NONE;
     sCommand.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
     sCommand.DataMode = QSPI_DATA_1_LINE;
+    sCommand.NbData = 1;
     sCommand.DummyCycles = 0;
     sCommand.DdrMode = QSPI_DDR_MODE_DISABLE;
     sCommand.DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
     sCommand.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
 
-    sConfig.Match = 0x0000;
-    sConfig.Mask = 0x0101;
-    sConfig.MatchMode = QSPI_MATCH_MODE_AND;
-    sConfig.StatusBytesSize = 2;
-    sConfig.Interval = 0x10;
-    sConfig.AutomaticStop = QSPI_AUTOMATIC_STOP_ENABLE;
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+        != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    if (QSPI_Receive(&sCommand, &status, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    if ((status & QSPI_FSR_ERRORS) == 0) {
+        return HAL_OK;
+    }
+
+    flag_error.status = status;
+    flag_error.address = address;
+    flag_error.count++;
+    QSPI_InvalidateTrackedRange(address, address + size);
 
-    if (HAL_QSPI_AutoPolling(&hqspi, &sCommand, &sConfig, Timeout) != HAL_OK) {
+    /* The flags stay set until cleared and would fail every later operation */
+    sCommand.Instruction = CLEAR_FLAG_STATUS_REG_CMD;
+    sCommand.DataMode = QSPI_DATA_NONE;
+    (void) QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE);
+
+    return HAL_ERROR;
+}
+
+/*Last program or erase failure reported by the flag status register*/
+void
+CSP_QSPI_GetFlagError(QSPI_FlagErrorTypeDef* error) {
+    *error = flag_error;
+}
+
+/*Route the commands and the memory-mapped window to a chip*/
+static uint8_t
+QSPI_SelectChip(uint32_t chip) {
+#if QSPI_CONCAT
+    if (chip == chip_selected) {
+        return HAL_OK;
+    }
+
+    /* FSEL only changes with the peripheral idle */
+    if (CSP_QSPI_EnterIndirectMode() != HAL_OK) {
         return HAL_ERROR;
     }
 
+    if (QSPI_DRIVER(SetFlashID)(&hqspi, chip ? QSPI_FLASH_ID_2 : QSPI_FLASH_ID_1) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    chip_selected = chip;
+
+#if USE_CACHE
+    /* Lines of the window still hold the other chip */
+    QSPI_MarkCacheStale(0, MEMORY_CHIP_SIZE);
+#endif
+#else
+    (void) chip;
+#endif
     return HAL_OK;
 }
 
+/*Select a chip, first completing the erase it was left running*/
+static uint8_t
+QSPI_UseChip(uint32_t chip) {
+    QSPI_ChipStateTypeDef* state = &chip_state[chip];
+
+    if (QSPI_SelectChip(chip) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    if (!state->busy) {
+        return HAL_OK;
+    }
+
+    if ((CSP_QSPI_EnterIndirectMode() != HAL_OK)
+        || (QSPI_AutoPollingMemReady(state->interval, state->timeout) != HAL_OK)) {
+        return HAL_ERROR;
+    }
+    state->busy = 0;
+
+    return QSPI_CheckFlagStatus(state->address, state->size);
+}
+
+/*Record the erase just started in the selected chip*/
+static void
+QSPI_SetBusy(uint32_t chip, uint32_t address, uint32_t size,
+             uint32_t Interval, uint32_t Timeout) {
+    chip_state[chip].busy = 1;
+    chip_state[chip].address = address;
+    chip_state[chip].size = size;
+    chip_state[chip].interval = Interval;
+    chip_state[chip].timeout = Timeout;
+}
+
+/*Wait for the erases still running, reporting the first one that failed*/
+static uint8_t
+QSPI_WaitChips(void) {
+    uint8_t status = HAL_OK;
+    uint32_t chip;
+
+    for (chip = 0; chip < QSPI_CHIPS; chip++) {
+        if (chip_state[chip].busy && (QSPI_UseChip(chip) != HAL_OK)) {
+            status = HAL_ERROR;
+        }
+    }
+
+    return status;
+}
+
+#if QSPI_PROGRAM_POLL_IT
+/*Queue the WREN, program and busy polling steps of one page*/
+LOADER_ITCM static uint8_t
+QSPI_QueueProgramPage(QSPI_CommandTypeDef* sCommand, uint8_t* data) {
+
+    QSPI_QueueDescTypeDef desc;
+
+    QSPI_WriteEnableConfig(&desc.command, NULL, NULL);
+    desc.op = QSPI_QUEUE_CMD;
+    if (QSPI_Queue_Push(&desc) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    QSPI_WriteEnableConfig(NULL, &desc.command, &desc.polling);
+    desc.op = QSPI_QUEUE_POLL;
+    if (QSPI_Queue_Push(&desc) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    desc.command = *sCommand;
+    desc.data = data;
+    desc.op = QSPI_QUEUE_TX;
+    if (QSPI_Queue_Push(&desc) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    QSPI_MemReadyPollingConfig(&desc.command, &desc.polling, QSPI_POLL_INTERVAL_PROGRAM);
+    desc.op = QSPI_QUEUE_POLL;
+    return QSPI_Queue_Push(&desc);
+}
+#endif
+
 static uint8_t
 QSPI_WriteEnable(void) {
     QSPI_CommandTypeDef sCommand;
+    QSPI_CommandTypeDef sPollCommand;
     QSPI_AutoPollingTypeDef sConfig;
+    STATS_SCOPE(STATS_WRITE_ENABLE);
 
-    /* Enable write operations ------------------------------------------ */
-    sCommand.InstructionMode = QSPI_INSTRUCTION_1_LINE;
-    sCommand.Instruction = WRITE_ENABLE_CMD;
-    sCommand.AddressMode = QSPI_ADDRESS_NONE;
-    sCommand.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
-    sCommand.DataMode = QSPI_DATA_NONE;
-    sCommand.DummyCycles = 0;
-    sCommand.DdrMode = QSPI_DDR_MODE_DISABLE;
-    sCommand.DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
-    sCommand.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+    QSPI_WriteEnableConfig(&sCommand, &sPollCommand, &sConfig);
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    /* Enable write operations ------------------------------------------ */
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
 
     /* Configure automatic polling mode to wait for write enabling ---- */
-    sConfig.Match = 0x0202;
-    sConfig.Mask = 0x0202;
-    sConfig.MatchMode = QSPI_MATCH_MODE_AND;
-    sConfig.StatusBytesSize = 2;
-    sConfig.Interval = 0x10;
-    sConfig.AutomaticStop = QSPI_AUTOMATIC_STOP_ENABLE;
-
-    sCommand.Instruction = READ_STATUS_REG_CMD;
-    sCommand.DataMode = QSPI_DATA_1_LINE;
-    if (HAL_QSPI_AutoPolling(&hqspi, &sCommand, &sConfig,
-                             HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+    if (QSPI_AutoPolling(&sPollCommand, &sConfig,
+                         HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
         return HAL_ERROR;
     }
 
     return HAL_OK;
 }
 
+/*WREN command and the polling for the write enable latch, either may be NULL*/
+static void
+QSPI_WriteEnableConfig(QSPI_CommandTypeDef* sCommand, QSPI_CommandTypeDef* sPollCommand,
+                       QSPI_AutoPollingTypeDef* sConfig) {
+
+    if (sCommand != NULL) {
+        sCommand->InstructionMode = QSPI_INSTRUCTION_1_LINE;
+        sCommand->Instruction = WRITE_ENABLE_CMD;
+        sCommand->AddressMode = QSPI_ADDRESS_NONE;
+        sCommand->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+        sCommand->DataMode = QSPI_DATA_NONE;
+        sCommand->DummyCycles = 0;
+        sCommand->DdrMode = QSPI_DDR_MODE_DISABLE;
+        sCommand->DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+        sCommand->SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+    }
+
+    if (sPollCommand != NULL) {
+        sPollCommand->InstructionMode = QSPI_INSTRUCTION_1_LINE;
+        sPollCommand->Instruction = READ_STATUS_REG_CMD;
+        sPollCommand->AddressMode = QSPI_ADDRESS_NONE;
+        sPollCommand->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+        sPollCommand->DataMode = QSPI_DATA_1_LINE;
+        sPollCommand->DummyCycles = 0;
+        sPollCommand->DdrMode = QSPI_DDR_MODE_DISABLE;
+        sPollCommand->DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+        sPollCommand->SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+    }
+
+    if (sConfig != NULL) {
+        sConfig->Match = 0x0202;
+        sConfig->Mask = 0x0202;
+        sConfig->MatchMode = QSPI_MATCH_MODE_AND;
+        sConfig->StatusBytesSize = 2;
+        sConfig->Interval = QSPI_POLL_INTERVAL_WEL;
+        sConfig->AutomaticStop = QSPI_AUTOMATIC_STOP_ENABLE;
+    }
+}
+
 /*Enable quad mode and set dummy cycles count*/
 static uint8_t
 QSPI_Configuration(void) {
@@ -338,7 +762,7 @@ QSPI_Configuration(void) {
     sCommand.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
     sCommand.NbData = 0;
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
@@ -356,14 +780,14 @@ QSPI_Configuration(void) {
     sCommand.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
     sCommand.NbData = 2;
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
 
 
-    if (HAL_QSPI_Receive(&hqspi, (uint8_t*)(&reg),
-                         HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+    if (QSPI_Receive(&sCommand, (uint8_t*)(&reg),
+                     HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
         return HAL_ERROR;
     }
 
@@ -383,13 +807,13 @@ QSPI_Configuration(void) {
     sCommand.Instruction = WRITE_VOL_CFG_REG_CMD;
 
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
 
-    if (HAL_QSPI_Transmit(&hqspi, (uint8_t*)(&reg),
-                          HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+    if (QSPI_Transmit(&sCommand, (uint8_t*)(&reg),
+                      HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
         return HAL_ERROR;
     }
     return HAL_OK;
@@ -399,10 +823,27 @@ uint8_t
 CSP_QSPI_EraseSector(uint32_t EraseStartAddress, uint32_t EraseEndAddress) {
 
     QSPI_CommandTypeDef sCommand;
+    uint32_t sector[QSPI_CHIPS], chip, last;
+    uint8_t issued;
+
+    if (CSP_QSPI_EnterIndirectMode() != HAL_OK) {
+        return HAL_ERROR;
+    }
 
     EraseStartAddress = EraseStartAddress
                         - EraseStartAddress % MEMORY_SECTOR_SIZE;
 
+    QSPI_InvalidateTrackedRange(EraseStartAddress & 0x0FFFFFFF,
+                                 (EraseEndAddress & 0x0FFFFFFF)
+                                 - (EraseEndAddress % MEMORY_SECTOR_SIZE)
+                                 + MEMORY_SECTOR_SIZE);
+#if USE_CACHE
+    QSPI_MarkCacheStale(EraseStartAddress & 0x0FFFFFFF,
+                        (EraseEndAddress & 0x0FFFFFFF)
+                        - (EraseEndAddress % MEMORY_SECTOR_SIZE)
+                        + MEMORY_SECTOR_SIZE);
+#endif
+
     /* Erasing Sequence -------------------------------------------------- */
     sCommand.InstructionMode = QSPI_INSTRUCTION_1_LINE;
     sCommand.AddressSize = QSPI_ADDRESS_32_BITS;
@@ -416,49 +857,202 @@ CSP_QSPI_EraseSector(uint32_t EraseStartAddress, uint32_t EraseEndAddress) {
     sCommand.DataMode = QSPI_DATA_NONE;
     sCommand.DummyCycles = 0;
 
-    while (EraseEndAddress >= EraseStartAddress) {
-        sCommand.Address = (EraseStartAddress & 0x0FFFFFFF);
+    /* Each chip takes the sectors of the range it holds, one at a time:
+     * while one chip erases, the others are polled or given their next */
+    EraseStartAddress &= 0x0FFFFFFF;
+    last = (EraseEndAddress & 0x0FFFFFFF) - (EraseEndAddress % MEMORY_SECTOR_SIZE);
+    for (chip = 0; chip < QSPI_CHIPS; chip++) {
+        sector[chip] = (EraseStartAddress > chip * MEMORY_CHIP_SIZE)
+                       ? EraseStartAddress : chip * MEMORY_CHIP_SIZE;
+    }
 
-        if (QSPI_WriteEnable() != HAL_OK) {
-            return HAL_ERROR;
+    do {
+        issued = 0;
+        for (chip = 0; chip < QSPI_CHIPS; chip++) {
+            if ((sector[chip] > last) || (sector[chip] >= (chip + 1) * MEMORY_CHIP_SIZE)) {
+                continue;
+            }
+
+            /* Stop at the first sector that failed to erase */
+            if (QSPI_IssueErase(&sCommand, sector[chip]) != HAL_OK) {
+                return HAL_ERROR;
+            }
+            sector[chip] += MEMORY_SECTOR_SIZE;
+            issued = 1;
         }
+    } while (issued);
 
-        if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
-            != HAL_OK) {
+    return QSPI_WaitChips();
+}
+
+/*Start erasing a sector once its chip has completed its previous erase*/
+static uint8_t
+QSPI_IssueErase(QSPI_CommandTypeDef* sCommand, uint32_t sector) {
+    uint32_t chip = sector / MEMORY_CHIP_SIZE;
+
+    if (QSPI_UseChip(chip) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    if (QSPI_WriteEnable() != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    sCommand->Address = sector % MEMORY_CHIP_SIZE;
+    if (STATS_TIMED(STATS_COMMAND,
+                    QSPI_Command(sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE))
+        != HAL_OK) {
+        return HAL_ERROR;
+    }
+    QSPI_SetBusy(chip, sector, MEMORY_SECTOR_SIZE,
+                 QSPI_POLL_INTERVAL_SECTOR_ERASE, HAL_QPSI_TIMEOUT_DEFAULT_VALUE);
+
+    return HAL_OK;
+}
+
+/*
+ * Erase the sector holding address without waiting for it: the next
+ * command to that chip completes the erase first, and CSP_QSPI_PollBusy()
+ * tells when it has. For callers that keep working while the flash is busy.
+ */
+uint8_t
+CSP_QSPI_StartErase(uint32_t address) {
+
+    QSPI_CommandTypeDef sCommand;
+
+    address &= 0x0FFFFFFF;
+    address -= address % MEMORY_SECTOR_SIZE;
+    if (address >= MEMORY_FLASH_SIZE) {
+        return HAL_ERROR;
+    }
+
+    if (CSP_QSPI_EnterIndirectMode() != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    QSPI_InvalidateTrackedRange(address, address + MEMORY_SECTOR_SIZE);
+#if USE_CACHE
+    QSPI_MarkCacheStale(address, address + MEMORY_SECTOR_SIZE);
+#endif
+
+    sCommand.InstructionMode = QSPI_INSTRUCTION_1_LINE;
+    sCommand.AddressSize = QSPI_ADDRESS_32_BITS;
+    sCommand.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    sCommand.DdrMode = QSPI_DDR_MODE_DISABLE;
+    sCommand.DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+    sCommand.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+    sCommand.Instruction = SECTOR_ERASE_CMD;
+    sCommand.AddressMode = QSPI_ADDRESS_1_LINE;
+    sCommand.DataMode = QSPI_DATA_NONE;
+    sCommand.DummyCycles = 0;
+
+    return QSPI_IssueErase(&sCommand, address);
+}
+
+/*
+ * Complete the erases that have finished, reading each busy chip's flag
+ * status once instead of polling it to the end. busy gets one bit per chip
+ * still erasing; HAL_ERROR reports a finished erase that failed.
+ */
+uint8_t
+CSP_QSPI_PollBusy(uint32_t* busy) {
+
+    QSPI_CommandTypeDef sCommand;
+    uint8_t status = HAL_OK, flags;
+    uint32_t chip;
+
+    *busy = 0;
+    for (chip = 0; chip < QSPI_CHIPS; chip++) {
+        if (!chip_state[chip].busy) {
+            continue;
+        }
+
+        if ((QSPI_SelectChip(chip) != HAL_OK) || (CSP_QSPI_EnterIndirectMode() != HAL_OK)) {
             return HAL_ERROR;
         }
-        EraseStartAddress += MEMORY_SECTOR_SIZE;
 
-        if (QSPI_AutoPollingMemReady(HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+        sCommand.InstructionMode = QSPI_INSTRUCTION_1_LINE;
+        sCommand.Instruction = READ_FLAG_STATUS_REG_CMD;
+        sCommand.AddressMode = QSPI_ADDRESS_NONE;
+        sCommand.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+        sCommand.DataMode = QSPI_DATA_1_LINE;
+        sCommand.NbData = 1;
+        sCommand.DummyCycles = 0;
+        sCommand.DdrMode = QSPI_DDR_MODE_DISABLE;
+        sCommand.DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+        sCommand.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+
+        if ((QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK)
+            || (QSPI_Receive(&sCommand, &flags, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK)) {
             return HAL_ERROR;
         }
+
+        if ((flags & QSPI_FSR_READY) == 0) {
+            *busy |= 1u << chip;
+            continue;
+        }
+
+        chip_state[chip].busy = 0;
+        if (QSPI_CheckFlagStatus(chip_state[chip].address, chip_state[chip].size) != HAL_OK) {
+            status = HAL_ERROR;
+        }
     }
 
-    return HAL_OK;
+    return status;
 }
 
 uint8_t
 CSP_QSPI_WriteMemory(uint8_t* buffer, uint32_t address, uint32_t buffer_size) {
+    return QSPI_ProgramMemory(buffer, address, buffer_size);
+}
 
-    QSPI_CommandTypeDef sCommand;
-    uint32_t end_addr, current_size, current_addr;
+/*Program bookkeeping data outside the image, keeping the tracked program
+ *run, readback range and write digests of the image as they are*/
+uint8_t
+CSP_QSPI_WriteUntracked(uint8_t* buffer, uint32_t address, uint32_t buffer_size) {
+    QSPI_ProgramRunTypeDef run;
+#if QSPI_WRITE_READBACK_VERIFY
+    QSPI_DigestTypeDef digest;
+    uint32_t start, end, next;
+#endif
+    uint8_t status;
+
+    run = program_run;
+#if QSPI_WRITE_READBACK_VERIFY
+    start = verified_start;
+    end = verified_end;
+    next = write_digest_next;
+    digest = write_digests[next];
+#endif
+    status = QSPI_ProgramMemory(buffer, address, buffer_size);
+    program_run = run;
+#if QSPI_WRITE_READBACK_VERIFY
+    verified_start = start;
+    verified_end = end;
+    write_digests[next] = digest;
+    write_digest_next = next;
+#endif
+    QSPI_InvalidateTrackedRange(address, address + buffer_size);
+
+    return status;
+}
 
-    /* Calculation of the size between the write address and the end of the page */
-    current_addr = 0;
+LOADER_ITCM static uint8_t
+QSPI_ProgramMemory(uint8_t* buffer, uint32_t address, uint32_t buffer_size) {
 
-    while (current_addr <= address) {
-        current_addr += MEMORY_PAGE_SIZE;
-    }
-    current_size = current_addr - address;
+    QSPI_CommandTypeDef sCommand;
+    QSPI_PagePlanTypeDef plan;
+#if QSPI_WRITE_READBACK_VERIFY
+    uint32_t crc = CRC32_INIT;
+#endif
 
-    /* Check if the size of the data is less than the remaining place in the page */
-    if (current_size > buffer_size) {
-        current_size = buffer_size;
+    if (CSP_QSPI_EnterIndirectMode() != HAL_OK) {
+        return HAL_ERROR;
     }
 
-    /* Initialize the adress variables */
-    current_addr = address;
-    end_addr = address + buffer_size;
+#if USE_CACHE
+    QSPI_MarkCacheStale(address, address + buffer_size);
+#endif
 
     sCommand.InstructionMode = QSPI_INSTRUCTION_1_LINE;
     sCommand.AddressSize = QSPI_ADDRESS_32_BITS;
@@ -469,52 +1063,277 @@ CSP_QSPI_WriteMemory(uint8_t* buffer, uint32_t address, uint32_t buffer_size) {
     sCommand.Instruction = QUAD_IN_FAST_PROG_CMD;
     sCommand.AddressMode = QSPI_ADDRESS_1_LINE;
     sCommand.DataMode = QSPI_DATA_4_LINES;
-    sCommand.NbData = buffer_size;
-    sCommand.Address = address;
     sCommand.DummyCycles = 0;
 
     /* Perform the write page by page */
-    do {
-        sCommand.Address = current_addr;
-        sCommand.NbData = current_size;
+    CSP_QSPI_PlanInit(&plan, address, buffer_size);
+    while (CSP_QSPI_PlanNext(&plan)) {
+        /* Pages never cross a chip boundary */
+        if (QSPI_UseChip(plan.address / MEMORY_CHIP_SIZE) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        sCommand.Address = plan.address % MEMORY_CHIP_SIZE;
+        sCommand.NbData = plan.size;
+
+#if QSPI_PROGRAM_POLL_IT
+        /* WREN, program and busy polling run from the QUADSPI interrupt,
+         * the page is accounted for meanwhile */
+        qspi_mode = QSPI_MODE_AUTO_POLLING;
+        if (QSPI_QueueProgramPage(&sCommand, buffer + plan.offset) != HAL_OK) {
+            return HAL_ERROR;
+        }
+
+        QSPI_UpdateProgramRun(buffer + plan.offset, plan.address, plan.size);
 
-        if (current_size == 0) {
-            return HAL_OK;
+        if (STATS_TIMED(STATS_AUTO_POLL, QSPI_Queue_Wait(HAL_QPSI_TIMEOUT_DEFAULT_VALUE))
+            != HAL_OK) {
+            return HAL_ERROR;
         }
+        qspi_mode = QSPI_MODE_INDIRECT;
 
+        if (QSPI_CheckFlagStatus(plan.address, plan.size) != HAL_OK) {
+            return HAL_ERROR;
+        }
+#else
         /* Enable write operations */
         if (QSPI_WriteEnable() != HAL_OK) {
             return HAL_ERROR;
         }
 
         /* Configure the command */
-        if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+        if (STATS_TIMED(STATS_COMMAND,
+                        QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE))
             != HAL_OK) {
             return HAL_ERROR;
         }
 
         /* Transmission of the data */
-        if (HAL_QSPI_Transmit(&hqspi, buffer, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+        if (STATS_TIMED(STATS_TRANSMIT,
+                        QSPI_Transmit(&sCommand, buffer + plan.offset,
+                                      HAL_QPSI_TIMEOUT_DEFAULT_VALUE)) != HAL_OK) {
             return HAL_ERROR;
         }
 
         /* Configure automatic polling mode to wait for end of program */
-        if (QSPI_AutoPollingMemReady(HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+        if (QSPI_AutoPollingMemReady(QSPI_POLL_INTERVAL_PROGRAM,
+                                     HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+            return HAL_ERROR;
+        }
+
+        QSPI_UpdateProgramRun(buffer + plan.offset, plan.address, plan.size);
+
+        if (QSPI_CheckFlagStatus(plan.address, plan.size) != HAL_OK) {
+            return HAL_ERROR;
+        }
+#endif
+
+#if QSPI_WRITE_READBACK_VERIFY
+        /* Read the page back while the source data is still at hand */
+        if (QSPI_ReadbackPage(buffer + plan.offset, plan.address, plan.size) != HAL_OK) {
             return HAL_ERROR;
         }
+        crc = Crc32_Update(crc, buffer + plan.offset, plan.size);
+#endif
+    }
+
+#if QSPI_WRITE_READBACK_VERIFY
+    QSPI_RecordDigest(address, buffer_size, crc);
+#endif
+    return HAL_OK;
+
+}
+
+/*Start splitting [address, address + size) into page program transfers*/
+void
+CSP_QSPI_PlanInit(QSPI_PagePlanTypeDef* plan, uint32_t address, uint32_t size) {
+    plan->address = address;
+    plan->offset = 0;
+    plan->size = 0;
+    plan->end = address + size;
+}
+
+/*Advance to the next transfer, returns 0 once the range is covered*/
+uint8_t
+CSP_QSPI_PlanNext(QSPI_PagePlanTypeDef* plan) {
+    plan->address += plan->size;
+    plan->offset += plan->size;
+
+    if (plan->address >= plan->end) {
+        plan->size = 0;
+        return 0;
+    }
+
+    /* Up to the page boundary, only the head and tail are shorter */
+    plan->size = MEMORY_PAGE_SIZE - (plan->address % MEMORY_PAGE_SIZE);
+    if (plan->size > plan->end - plan->address) {
+        plan->size = plan->end - plan->address;
+    }
+    return 1;
+}
+
+
+uint8_t
+CSP_QSPI_ReadMemory(uint8_t* buffer, uint32_t address, uint32_t buffer_size) {
+
+    QSPI_CommandTypeDef sCommand;
+    uint32_t length;
+
+    if (buffer_size == 0) {
+        return HAL_OK;
+    }
+
+    if (CSP_QSPI_EnterIndirectMode() != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    /* Indirect read with the same command as the memory-mapped mode */
+    QSPI_ReadCommandConfig(&sCommand);
+
+    /* One read per chip the range touches */
+    for (; buffer_size != 0; buffer_size -= length) {
+        length = MEMORY_CHIP_SIZE - address % MEMORY_CHIP_SIZE;
+        if (length > buffer_size) {
+            length = buffer_size;
+        }
+        if (QSPI_UseChip(address / MEMORY_CHIP_SIZE) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        sCommand.NbData = length;
+        sCommand.Address = address % MEMORY_CHIP_SIZE;
+
+        if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+            != HAL_OK) {
+            return HAL_ERROR;
+        }
+
+        if (QSPI_Receive(&sCommand, buffer, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        buffer += length;
+        address += length;
+    }
+
+    return HAL_OK;
+}
+
+/*Check whether a range holds buffer without reading it: confirmed by
+ *readback since it was last erased, and programmed in one write from data
+ *with the CRC-32 of buffer*/
+uint8_t
+CSP_QSPI_IsRangeVerified(uint32_t address, const uint8_t* buffer, uint32_t size) {
+#if QSPI_WRITE_READBACK_VERIFY
+    uint32_t i;
+
+    if ((size == 0) || (address < verified_start) || (address + size > verified_end)) {
+        return 0;
+    }
+
+    for (i = 0; i < QSPI_WRITE_DIGESTS; i++) {
+        if ((write_digests[i].start == address) && (write_digests[i].end == address + size)) {
+            return write_digests[i].crc == Crc32_Update(CRC32_INIT, buffer, size);
+        }
+    }
+#endif
+    return 0;
+}
+
+#if QSPI_WRITE_READBACK_VERIFY
+static uint8_t
+QSPI_ReadbackPage(const uint8_t* buffer, uint32_t address, uint32_t size) {
+
+    if (CSP_QSPI_ReadMemory(readback_buffer, address, size) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    if (memcmp(readback_buffer, buffer, size) != 0) {
+        QSPI_InvalidateTrackedRange(address, address + size);
+        return HAL_ERROR;
+    }
 
-        /* Update the address and size variables for next page programming */
-        current_addr += current_size;
-        buffer += current_size;
-        current_size =
-            ((current_addr + MEMORY_PAGE_SIZE) > end_addr) ?
-            (end_addr - current_addr) : MEMORY_PAGE_SIZE;
-    } while (current_addr <= end_addr);
+    /* Extend the confirmed range, or restart it on a discontinuity */
+    if ((address <= verified_end) && (address + size >= verified_start)
+        && (verified_end != verified_start)) {
+        if (address < verified_start) {
+            verified_start = address;
+        }
+        if (address + size > verified_end) {
+            verified_end = address + size;
+        }
+    } else {
+        verified_start = address;
+        verified_end = address + size;
+    }
 
     return HAL_OK;
+}
+
+/*Keep the CRC-32 of a write, replacing those of the writes it overlaps*/
+static void
+QSPI_RecordDigest(uint32_t address, uint32_t size, uint32_t crc) {
+    uint32_t i;
+
+    for (i = 0; i < QSPI_WRITE_DIGESTS; i++) {
+        if ((address < write_digests[i].end) && (address + size > write_digests[i].start)) {
+            write_digests[i].start = 0;
+            write_digests[i].end = 0;
+        }
+    }
+
+    write_digests[write_digest_next].start = address;
+    write_digests[write_digest_next].end = address + size;
+    write_digests[write_digest_next].crc = crc;
+    write_digest_next = (write_digest_next + 1) % QSPI_WRITE_DIGESTS;
+}
+#endif
+
+/*Get the current run of contiguously programmed data*/
+void
+CSP_QSPI_GetProgramRun(QSPI_ProgramRunTypeDef* run) {
+    *run = program_run;
+}
+
+/*Account for a programmed page, restarting the run on a discontinuity*/
+LOADER_ITCM static void
+QSPI_UpdateProgramRun(const uint8_t* buffer, uint32_t address, uint32_t size) {
+    uint32_t i;
 
+    if ((program_run.end != address) || (program_run.end == program_run.start)) {
+        program_run.start = address;
+        program_run.end = address;
+        program_run.sum = 0;
+        program_run.crc = CRC32_INIT;
+    }
+
+    for (i = 0; i < size; i++) {
+        program_run.sum += buffer[i];
+    }
+#if QSPI_PROGRAM_CRC
+    program_run.crc = Crc32_Update(program_run.crc, buffer, size);
+#endif
+    program_run.end += size;
 }
 
+static void
+QSPI_InvalidateTrackedRange(uint32_t start, uint32_t end) {
+#if QSPI_WRITE_READBACK_VERIFY
+    uint32_t i;
+
+    if ((start < verified_end) && (end > verified_start)) {
+        verified_start = 0;
+        verified_end = 0;
+    }
+    for (i = 0; i < QSPI_WRITE_DIGESTS; i++) {
+        if ((start < write_digests[i].end) && (end > write_digests[i].start)) {
+            write_digests[i].start = 0;
+            write_digests[i].end = 0;
+        }
+    }
+#endif
+    if ((start < program_run.end) && (end > program_run.start)) {
+        program_run.start = 0;
+        program_run.end = 0;
+    }
+}
 
 uint8_t
 CSP_QSPI_EnableMemoryMappedMode(void) {
@@ -522,29 +1341,204 @@ CSP_QSPI_EnableMemoryMappedMode(void) {
     QSPI_CommandTypeDef sCommand;
     QSPI_MemoryMappedTypeDef sMemMappedCfg;
 
+    if (qspi_mode == QSPI_MODE_MEMORY_MAPPED) {
+        qspi_mode_stats.skipped_transitions++;
+        return HAL_OK;
+    }
+
+    STATS_SCOPE(STATS_MEMORY_MAPPED);
+
+    if (CSP_QSPI_EnterIndirectMode() != HAL_OK) {
+        return HAL_ERROR;
+    }
+
     /* Enable Memory-Mapped mode-------------------------------------------------- */
 
-    sCommand.InstructionMode = QSPI_INSTRUCTION_1_LINE;
-    sCommand.AddressSize = QSPI_ADDRESS_32_BITS;
-    sCommand.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
-    sCommand.DdrMode = QSPI_DDR_MODE_DISABLE;
-    sCommand.DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
-    sCommand.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
-    sCommand.AddressMode = QSPI_ADDRESS_1_LINE;
-    sCommand.DataMode = QSPI_DATA_4_LINES;
+    QSPI_ReadCommandConfig(&sCommand);
     sCommand.NbData = 0;
     sCommand.Address = 0;
-    sCommand.Instruction = QUAD_OUT_FAST_READ_CMD;
-    sCommand.DummyCycles = DUMMY_CLOCK_CYCLES_READ_QUAD-2;
 
     sMemMappedCfg.TimeOutActivation = QSPI_TIMEOUT_COUNTER_DISABLE;
 
-    if (HAL_QSPI_MemoryMapped(&hqspi, &sCommand, &sMemMappedCfg) != HAL_OK) {
+    if (QSPI_MemoryMapped(&sCommand, &sMemMappedCfg) != HAL_OK) {
         return HAL_ERROR;
     }
+
+#if USE_CACHE
+    /* Lines cached before a program or erase no longer match the flash */
+    if (stale_end != stale_start) {
+        if ((stale_end - stale_start) > QSPI_DCACHE_RANGE_LIMIT) {
+            SCB_InvalidateDCache();
+        } else {
+            SCB_InvalidateDCache_by_Addr((void*) (uintptr_t) (MEMORY_MAPPED_ADDRESS + stale_start),
+                                         stale_end - stale_start);
+        }
+        stale_start = 0;
+        stale_end = 0;
+    }
+    QSPI_SetMappedRegion(1);
+#endif
+
+    /*Trigger read access before HAL_QSPI_Abort() otherwise abort functionality gets stuck*/
+    (void) *(__IO uint32_t*) MEMORY_MAPPED_ADDRESS;
+
+    qspi_mode = QSPI_MODE_MEMORY_MAPPED;
+    qspi_mode_stats.memory_mapped_entries++;
     return HAL_OK;
 }
 
+/*
+ * Map the chip holding a flash offset and return the CPU address of the
+ * offset in the window, 0 on failure. The window shows one chip at a
+ * time, so size is cut back to the end of that chip.
+ */
+uint32_t
+CSP_QSPI_MapAddress(uint32_t address, uint32_t* size) {
+    uint32_t offset = address % MEMORY_CHIP_SIZE;
+
+    if ((QSPI_UseChip(address / MEMORY_CHIP_SIZE) != HAL_OK)
+        || (CSP_QSPI_EnableMemoryMappedMode() != HAL_OK)) {
+        return 0;
+    }
+
+    if (*size > MEMORY_CHIP_SIZE - offset) {
+        *size = MEMORY_CHIP_SIZE - offset;
+    }
+    return MEMORY_MAPPED_ADDRESS + offset;
+}
+
+/*Leave memory-mapped or any unfinished mode, only aborting when required*/
+uint8_t
+CSP_QSPI_EnterIndirectMode(void) {
+
+    if ((qspi_mode == QSPI_MODE_INDIRECT) && (hqspi.State == HAL_QSPI_STATE_READY)) {
+        qspi_mode_stats.skipped_transitions++;
+        return HAL_OK;
+    }
+
+#if USE_CACHE
+    if (qspi_mode == QSPI_MODE_MEMORY_MAPPED) {
+        QSPI_SetMappedRegion(0);
+    }
+#endif
+
+    if ((qspi_mode != QSPI_MODE_IDLE) || (hqspi.State != HAL_QSPI_STATE_READY)) {
+        qspi_mode_stats.aborts++;
+        if (STATS_TIMED(STATS_ABORT, QSPI_Abort()) != HAL_OK) {
+            return HAL_ERROR;
+        }
+    }
+
+    qspi_mode = QSPI_MODE_INDIRECT;
+    qspi_mode_stats.indirect_entries++;
+    return HAL_OK;
+}
+
+QSPI_ModeTypeDef
+CSP_QSPI_GetMode(void) {
+    return qspi_mode;
+}
+
+/*Select the read command; a mapped window is left so the next mapping uses it*/
+uint8_t
+CSP_QSPI_SetReadMode(QSPI_ReadModeTypeDef mode) {
+
+    if (mode >= QSPI_READ_MODES) {
+        return HAL_ERROR;
+    }
+
+    if (mode == read_mode) {
+        return HAL_OK;
+    }
+
+    if ((qspi_mode == QSPI_MODE_MEMORY_MAPPED) && (CSP_QSPI_EnterIndirectMode() != HAL_OK)) {
+        return HAL_ERROR;
+    }
+
+    read_mode = mode;
+    return HAL_OK;
+}
+
+QSPI_ReadModeTypeDef
+CSP_QSPI_GetReadMode(void) {
+    return read_mode;
+}
+
+/*
+ * Read command of the selected mode. 1-4-4 also sends the address on four
+ * lines; DTR samples address and data on both clock edges. The dummy cycles
+ * set in the volatile configuration register apply to every fast read.
+ */
+static void
+QSPI_ReadCommandConfig(QSPI_CommandTypeDef* sCommand) {
+    static const uint8_t instructions[QSPI_READ_MODES] = {
+        QUAD_OUT_FAST_READ_CMD, QUAD_INOUT_FAST_READ_CMD,
+        DTR_QUAD_OUT_FAST_READ_CMD, DTR_QUAD_INOUT_FAST_READ_CMD,
+    };
+
+    sCommand->InstructionMode = QSPI_INSTRUCTION_1_LINE;
+    sCommand->Instruction = instructions[read_mode];
+    sCommand->AddressSize = QSPI_ADDRESS_32_BITS;
+    sCommand->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    sCommand->DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+    sCommand->SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+    sCommand->DataMode = QSPI_DATA_4_LINES;
+    sCommand->DummyCycles = DUMMY_CLOCK_CYCLES_READ_QUAD-2;
+
+    if ((read_mode == QSPI_READ_1_4_4) || (read_mode == QSPI_READ_1_4_4_DTR)) {
+        sCommand->AddressMode = QSPI_ADDRESS_4_LINES;
+    } else {
+        sCommand->AddressMode = QSPI_ADDRESS_1_LINE;
+    }
+
+    if ((read_mode == QSPI_READ_1_1_4_DTR) || (read_mode == QSPI_READ_1_4_4_DTR)) {
+        sCommand->DdrMode = QSPI_DDR_MODE_ENABLE;
+    } else {
+        sCommand->DdrMode = QSPI_DDR_MODE_DISABLE;
+    }
+}
+
+#if USE_CACHE
+static void
+QSPI_MarkCacheStale(uint32_t start, uint32_t end) {
+#if QSPI_CONCAT
+    /* The chips share the window: fold the range onto it */
+    if (end - start > MEMORY_CHIP_SIZE - start % MEMORY_CHIP_SIZE) {
+        start = 0;
+        end = MEMORY_CHIP_SIZE;
+    } else {
+        end -= start - start % MEMORY_CHIP_SIZE;
+        start %= MEMORY_CHIP_SIZE;
+    }
+#endif
+    if (stale_end == stale_start) {
+        stale_start = start;
+        stale_end = end;
+        return;
+    }
+    if (start < stale_start) {
+        stale_start = start;
+    }
+    if (end > stale_end) {
+        stale_end = end;
+    }
+}
+
+/*Open or close the cacheable MPU window over the mapped flash*/
+static void
+QSPI_SetMappedRegion(uint32_t enable) {
+    __DMB();
+    MPU->RNR = MPU_REGION_QSPI_MAPPED;
+    if (enable) {
+        MPU->RASR |= MPU_RASR_ENABLE_Msk;
+    } else {
+        MPU->RASR &= ~MPU_RASR_ENABLE_Msk;
+    }
+    __DSB();
+    __ISB();
+}
+#endif
+
 static uint8_t
 QSPI_ResetChip() {
     QSPI_CommandTypeDef sCommand;
@@ -562,7 +1556,7 @@ QSPI_ResetChip() {
     sCommand.DataMode = QSPI_DATA_NONE;
     sCommand.DummyCycles = 0;
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
@@ -582,7 +1576,7 @@ QSPI_ResetChip() {
     sCommand.DataMode = QSPI_DATA_NONE;
     sCommand.DummyCycles = 0;
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
@@ -600,7 +1594,7 @@ QSPI_ResetChip() {
     sCommand.DataMode = QSPI_DATA_NONE;
     sCommand.DummyCycles = 0;
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
@@ -620,7 +1614,7 @@ QSPI_ResetChip() {
     sCommand.DataMode = QSPI_DATA_NONE;
     sCommand.DummyCycles = 0;
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
@@ -638,7 +1632,7 @@ QSPI_ResetChip() {
     sCommand.DataMode = QSPI_DATA_NONE;
     sCommand.DummyCycles = 0;
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
@@ -658,7 +1652,7 @@ QSPI_ResetChip() {
     sCommand.DataMode = QSPI_DATA_NONE;
     sCommand.DummyCycles = 0;
 
-    if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
+    if (QSPI_Command(&sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE)
         != HAL_OK) {
         return HAL_ERROR;
     }
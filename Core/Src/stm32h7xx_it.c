@@ -214,7 +214,10 @@ void SysTick_Handler(void)
 void QUADSPI_IRQHandler(void)
 {
   /* USER CODE BEGIN QUADSPI_IRQn 0 */
-
+#if LOADER_LEAN
+  /* The lean build polls and never enables this interrupt */
+  return;
+#endif
   /* USER CODE END QUADSPI_IRQn 0 */
   HAL_QSPI_IRQHandler(&hqspi);
   /* USER CODE BEGIN QUADSPI_IRQn 1 */
@@ -0,0 +1,421 @@
+/*
+ * uart_stream.c
+ *
+ */
+#include "uart_stream.h"
+
+#if UART_STREAM
+#include "quadspi.h"
+#include "crc32.h"
+#include <string.h>
+
+#define UART_STREAM_FRAME_MAX   (UART_STREAM_HEADER + UART_STREAM_BLOCK_SIZE + UART_STREAM_TRAILER)
+#define UART_STREAM_SLOTS       (UART_STREAM_WINDOW + 1)    /* the spare one takes control frames */
+#define UART_STREAM_TX_TIMEOUT  100         /* ms for one reply */
+
+#if (UART_STREAM_RING_SIZE < UART_STREAM_WINDOW * UART_STREAM_FRAME_MAX) \
+    || (UART_STREAM_RING_SIZE > 0xFFFF)
+#error "UART_STREAM_RING_SIZE must hold a window of frames and fit the DMA count"
+#endif
+#if (UART_STREAM_RING_SIZE % 32) || (UART_STREAM_BLOCK_SIZE % MEMORY_PAGE_SIZE)
+#error "UART_STREAM_RING_SIZE must be D-Cache lines, UART_STREAM_BLOCK_SIZE pages"
+#endif
+
+typedef struct {
+    uint8_t type;
+    uint16_t seq;
+    uint16_t length;
+    uint8_t* data;
+} UartStream_FrameTypeDef;
+
+UartStream_SessionTypeDef uart_stream_session;
+
+/* In SRAM1/2 (.dma_buffer): the application's .bss is in DTCM, which DMA1
+ * cannot reach, and the two would not fit beside the stack there */
+static uint8_t ring[UART_STREAM_RING_SIZE] __attribute__((section(".dma_buffer"), aligned(32)));
+static uint8_t slots[UART_STREAM_SLOTS][UART_STREAM_BLOCK_SIZE]
+    __attribute__((section(".dma_buffer"), aligned(32)));
+static uint16_t slot_length[UART_STREAM_SLOTS];
+static uint32_t queue_first, queue_count;   /* blocks received, not programmed yet */
+static uint32_t tail;                       /* ring offset of the next byte to parse */
+static uint8_t resend_pending;              /* resend requested, waiting for its block */
+static uint8_t active;
+static UART_HandleTypeDef* uart;
+
+static inline uint32_t
+UartStream_Get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t
+UartStream_Get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void
+UartStream_Put16(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+}
+
+static inline void
+UartStream_Put32(uint8_t* p, uint32_t value) {
+    UartStream_Put16(p, value);
+    UartStream_Put16(p + 2, value >> 16);
+}
+
+static inline uint8_t
+Ring_Byte(uint32_t offset) {
+    return ring[(tail + offset) % UART_STREAM_RING_SIZE];
+}
+
+/*Copy or checksum size bytes from offset past the tail, across the wrap*/
+static uint32_t
+Ring_Read(uint8_t* dest, uint32_t offset, uint32_t size, uint32_t crc) {
+    uint32_t start = (tail + offset) % UART_STREAM_RING_SIZE;
+    uint32_t first = UART_STREAM_RING_SIZE - start;
+
+    if (first > size) {
+        first = size;
+    }
+    if (dest != NULL) {
+        memcpy(dest, &ring[start], first);
+        memcpy(dest + first, ring, size - first);
+        return crc;
+    }
+    crc = Crc32_Update(crc, &ring[start], first);
+    return Crc32_Update(crc, ring, size - first);
+}
+
+static inline void
+Ring_Skip(uint32_t size) {
+    tail = (tail + size) % UART_STREAM_RING_SIZE;
+}
+
+/*Bytes the DMA has written past the tail, fetched from RAM rather than the D-Cache*/
+static uint32_t
+Ring_Available(void) {
+    uint32_t head, count;
+
+    head = (UART_STREAM_RING_SIZE - __HAL_DMA_GET_COUNTER(uart->hdmarx)) % UART_STREAM_RING_SIZE;
+    count = (head + UART_STREAM_RING_SIZE - tail) % UART_STREAM_RING_SIZE;
+
+#if USE_CACHE
+    if (head >= tail) {
+        SCB_InvalidateDCache_by_Addr(&ring[tail], count);
+    } else {
+        SCB_InvalidateDCache_by_Addr(&ring[tail], UART_STREAM_RING_SIZE - tail);
+        SCB_InvalidateDCache_by_Addr(ring, head);
+    }
+#endif
+    return count;
+}
+
+static void
+UartStream_Reply(uint8_t type, uint8_t status, uint32_t seq,
+                 const uint8_t* extra, uint32_t extra_size) {
+    uint8_t frame[UART_STREAM_HEADER + 1 + 4 + UART_STREAM_TRAILER];
+    uint32_t length = 1 + extra_size;
+
+    frame[0] = UART_STREAM_SYNC;
+    frame[1] = type | UART_STREAM_REPLY;
+    UartStream_Put16(&frame[2], seq);
+    UartStream_Put16(&frame[4], length);
+    frame[UART_STREAM_HEADER] = status;
+    if (extra_size > 0) {
+        memcpy(&frame[UART_STREAM_HEADER + 1], extra, extra_size);
+    }
+    UartStream_Put32(&frame[UART_STREAM_HEADER + length],
+                     Crc32_Update(CRC32_INIT, &frame[1], UART_STREAM_HEADER - 1 + length));
+
+    (void) HAL_UART_Transmit(uart, frame, UART_STREAM_HEADER + length + UART_STREAM_TRAILER,
+                             UART_STREAM_TX_TIMEOUT);
+}
+
+/*Blocks programmed, the base of the sender's window*/
+static inline uint32_t
+UartStream_Acked(void) {
+    return (uart_stream_session.programmed + UART_STREAM_BLOCK_SIZE - 1) / UART_STREAM_BLOCK_SIZE;
+}
+
+/*Ask for the block expected next, once per loss*/
+static void
+UartStream_Resend(void) {
+    if (active && !resend_pending) {
+        resend_pending = 1;
+        uart_stream_session.resends++;
+        UartStream_Reply(UART_STREAM_DATA, UART_STREAM_RESEND, uart_stream_session.blocks, NULL, 0);
+    }
+}
+
+/*
+ * Take the next complete frame off the ring. Bytes before a sync are
+ * dropped; a frame that fails its length or CRC loses its sync byte so
+ * that the search starts again inside it. A data frame stays in the ring
+ * while every slot is taken, which is the sender's window running out.
+ */
+static uint8_t
+UartStream_NextFrame(UartStream_FrameTypeDef* frame) {
+    uint8_t header[UART_STREAM_HEADER], trailer[UART_STREAM_TRAILER];
+    uint32_t available, crc;
+
+    available = Ring_Available();
+    while (1) {
+        while ((available > 0) && (Ring_Byte(0) != UART_STREAM_SYNC)) {
+            Ring_Skip(1);
+            available--;
+        }
+        if (available < UART_STREAM_HEADER) {
+            return 0;
+        }
+
+        (void) Ring_Read(header, 0, UART_STREAM_HEADER, 0);
+        frame->type = header[1];
+        frame->seq = UartStream_Get16(&header[2]);
+        frame->length = UartStream_Get16(&header[4]);
+
+        if (frame->length > UART_STREAM_BLOCK_SIZE) {
+            uart_stream_session.bad_frames++;
+            Ring_Skip(1);
+            available--;
+            UartStream_Resend();
+            continue;
+        }
+        if (available < UART_STREAM_HEADER + frame->length + UART_STREAM_TRAILER) {
+            return 0;
+        }
+
+        crc = Ring_Read(NULL, 1, UART_STREAM_HEADER - 1 + frame->length, CRC32_INIT);
+        (void) Ring_Read(trailer, UART_STREAM_HEADER + frame->length, UART_STREAM_TRAILER, 0);
+        if (crc != UartStream_Get32(trailer)) {
+            uart_stream_session.bad_frames++;
+            Ring_Skip(1);
+            available--;
+            UartStream_Resend();
+            continue;
+        }
+
+        if ((frame->type == UART_STREAM_DATA) && (queue_count == UART_STREAM_WINDOW)) {
+            return 0;
+        }
+
+        frame->data = slots[(queue_first + queue_count) % UART_STREAM_SLOTS];
+        (void) Ring_Read(frame->data, UART_STREAM_HEADER, frame->length, 0);
+        Ring_Skip(UART_STREAM_HEADER + frame->length + UART_STREAM_TRAILER);
+        return 1;
+    }
+}
+
+static void
+UartStream_Open(const UartStream_FrameTypeDef* frame) {
+    UartStream_SessionTypeDef* session = &uart_stream_session;
+    uint32_t address, size, crc;
+    uint8_t extra[4];
+
+    if (frame->length != 12) {
+        return;
+    }
+    address = UartStream_Get32(frame->data) & 0x0FFFFFFF;
+    size = UartStream_Get32(frame->data + 4);
+    crc = UartStream_Get32(frame->data + 8);
+
+    /* A repeated OPEN lost its reply */
+    if (!active || (address != session->address) || (size != session->size)
+        || (crc != session->crc) || (session->blocks != 0)) {
+        memset(session, 0, sizeof(*session));
+        session->address = address;
+        session->size = size;
+        session->crc = crc;
+        session->erase_next = address - address % MEMORY_SECTOR_SIZE;
+        session->start_tick = HAL_GetTick();
+        queue_first = 0;
+        queue_count = 0;
+        resend_pending = 0;
+        active = (size > 0) && (address < MEMORY_FLASH_SIZE)
+                 && (size <= MEMORY_FLASH_SIZE - address);
+        session->status = active ? UART_STREAM_OK : UART_STREAM_RANGE;
+    }
+
+    UartStream_Put16(&extra[0], UART_STREAM_BLOCK_SIZE);
+    UartStream_Put16(&extra[2], UART_STREAM_WINDOW);
+    UartStream_Reply(UART_STREAM_OPEN, session->status, UartStream_Acked(), extra, sizeof(extra));
+}
+
+static void
+UartStream_Data(const UartStream_FrameTypeDef* frame) {
+    UartStream_SessionTypeDef* session = &uart_stream_session;
+    uint32_t offset = session->blocks * UART_STREAM_BLOCK_SIZE;
+    int16_t ahead = (int16_t) (frame->seq - (uint16_t) session->blocks);
+
+    if (!active) {
+        return;
+    }
+
+    /* Behind: a duplicate after a lost acknowledgement */
+    if (ahead < 0) {
+        UartStream_Reply(UART_STREAM_DATA, UART_STREAM_OK, UartStream_Acked(), NULL, 0);
+        return;
+    }
+
+    if ((ahead > 0) || (offset >= session->size)
+        || (frame->length != ((session->size - offset < UART_STREAM_BLOCK_SIZE)
+                              ? session->size - offset : UART_STREAM_BLOCK_SIZE))) {
+        UartStream_Resend();
+        return;
+    }
+
+    slot_length[(queue_first + queue_count) % UART_STREAM_SLOTS] = frame->length;
+    queue_count++;
+    session->blocks++;
+    resend_pending = 0;
+}
+
+/*
+ * Advance the flash side without waiting for it: complete the erase that
+ * has finished, program the queued blocks whose sectors are erased, then
+ * start erasing the next sector of the image once the receiver has caught
+ * up.
+ */
+static uint8_t
+UartStream_Flash(void) {
+    UartStream_SessionTypeDef* session = &uart_stream_session;
+    uint32_t busy, erased, address, length, end = session->address + session->size;
+
+    if (CSP_QSPI_PollBusy(&busy) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    erased = busy ? session->erase_next - MEMORY_SECTOR_SIZE : session->erase_next;
+
+    while (queue_count > 0) {
+        address = session->address + session->programmed;
+        length = slot_length[queue_first];
+        if ((address + length > erased)
+            || (busy & ((1u << (address / MEMORY_CHIP_SIZE))
+                        | (1u << ((address + length - 1) / MEMORY_CHIP_SIZE))))) {
+            break;
+        }
+
+        if (CSP_QSPI_WriteMemory(slots[queue_first], address, length) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        session->programmed += length;
+        queue_first = (queue_first + 1) % UART_STREAM_SLOTS;
+        queue_count--;
+
+        /* Block by block, so that the window reopens while the rest programs */
+        UartStream_Reply(UART_STREAM_DATA, UART_STREAM_OK, UartStream_Acked(), NULL, 0);
+    }
+
+    /* An erase holds the chip for a sector's worth of frames: start it with
+     * the queue drained and nothing whole left in the ring, unless the next
+     * block is already waiting for it */
+    address = session->address + session->programmed;
+    if (!busy && (session->erase_next < end)
+        && ((queue_count == 0) ? (Ring_Available() < UART_STREAM_FRAME_MAX)
+                               : (address + slot_length[queue_first] > erased))) {
+        if (CSP_QSPI_StartErase(session->erase_next) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        session->erase_next += MEMORY_SECTOR_SIZE;
+        session->erases++;
+    }
+
+    return HAL_OK;
+}
+
+/*Program what is left and compare the CRC-32 of the image read back*/
+static uint8_t
+UartStream_Finish(uint32_t* crc) {
+    UartStream_SessionTypeDef* session = &uart_stream_session;
+    uint32_t offset, length, start = HAL_GetTick();
+
+    while (queue_count > 0) {
+        if ((UartStream_Flash() != HAL_OK) || (HAL_GetTick() - start > UART_STREAM_TIMEOUT)) {
+            return UART_STREAM_FLASH;
+        }
+    }
+
+    /* The queue is empty: its first slot holds the readback */
+    *crc = CRC32_INIT;
+    for (offset = 0; offset < session->size; offset += length) {
+        length = session->size - offset;
+        if (length > UART_STREAM_BLOCK_SIZE) {
+            length = UART_STREAM_BLOCK_SIZE;
+        }
+        if (CSP_QSPI_ReadMemory(slots[0], session->address + offset, length) != HAL_OK) {
+            return UART_STREAM_FLASH;
+        }
+        *crc = Crc32_Update(*crc, slots[0], length);
+    }
+
+    return (*crc == session->crc) ? UART_STREAM_OK : UART_STREAM_MISMATCH;
+}
+
+/*
+ * The USART interrupt stays off: the engine polls the DMA counter and
+ * clears overruns itself, where the HAL error handler would abort the
+ * circular reception.
+ */
+uint8_t
+UartStream_Run(UART_HandleTypeDef* huart) {
+    UartStream_SessionTypeDef* session = &uart_stream_session;
+    UartStream_FrameTypeDef frame;
+    uint32_t tick, last_frame = 0, crc = 0;
+    uint8_t extra[4];
+
+    uart = huart;
+    tail = 0;
+    active = 0;
+    if (HAL_UART_Receive_DMA(huart, ring, UART_STREAM_RING_SIZE) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    while (1) {
+        tick = HAL_GetTick();
+        if (__HAL_UART_GET_FLAG(huart, UART_FLAG_ORE)) {
+            __HAL_UART_CLEAR_OREFLAG(huart);
+            session->overruns++;
+        }
+
+        while (UartStream_NextFrame(&frame)) {
+            last_frame = tick;
+            if (frame.type == UART_STREAM_OPEN) {
+                UartStream_Open(&frame);
+            } else if (frame.type == UART_STREAM_DATA) {
+                UartStream_Data(&frame);
+            } else if ((frame.type == UART_STREAM_DONE) && active) {
+                if (session->blocks * UART_STREAM_BLOCK_SIZE < session->size) {
+                    UartStream_Resend();
+                    continue;
+                }
+                session->status = UartStream_Finish(&crc);
+                session->end_tick = HAL_GetTick();
+                UartStream_Put32(extra, crc);
+                UartStream_Reply(UART_STREAM_DONE, session->status, UartStream_Acked(),
+                                 extra, sizeof(extra));
+                active = 0;
+                (void) HAL_UART_DMAStop(huart);
+                return (session->status == UART_STREAM_OK) ? HAL_OK : HAL_ERROR;
+            }
+        }
+
+        if (!active) {
+            continue;
+        }
+
+        if (UartStream_Flash() != HAL_OK) {
+            session->status = UART_STREAM_FLASH;
+        } else if (tick - last_frame > UART_STREAM_TIMEOUT) {
+            session->status = UART_STREAM_TIMEOUT_ERROR;
+        } else {
+            continue;
+        }
+
+        session->end_tick = HAL_GetTick();
+        UartStream_Reply(UART_STREAM_DATA, session->status, UartStream_Acked(), NULL, 0);
+        active = 0;
+        (void) HAL_UART_DMAStop(huart);
+        return HAL_ERROR;
+    }
+}
+#endif
@@ -21,7 +21,9 @@
 #include "usart.h"
 
 /* USER CODE BEGIN 0 */
-
+#if UART_STREAM
+DMA_HandleTypeDef hdma_usart1_rx;
+#endif
 /* USER CODE END 0 */
 
 UART_HandleTypeDef huart1;
@@ -39,7 +41,7 @@ void MX_USART1_UART_Init(void)
 
   /* USER CODE END USART1_Init 1 */
   huart1.Instance = USART1;
-  huart1.Init.BaudRate = 9600;
+  huart1.Init.BaudRate = 921600;
   huart1.Init.WordLength = UART_WORDLENGTH_8B;
   huart1.Init.StopBits = UART_STOPBITS_1;
   huart1.Init.Parity = UART_PARITY_NONE;
@@ -66,7 +68,19 @@ void MX_USART1_UART_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN USART1_Init 2 */
-
+#if UART_STREAM
+  /* Downloads run at UART_STREAM_BAUD; the 8-byte receive FIFO covers the
+     DMA request latency at that rate */
+  huart1.Init.BaudRate = UART_STREAM_BAUD;
+  if (HAL_UART_Init(&huart1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if (HAL_UARTEx_EnableFifoMode(&huart1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+#endif
   /* USER CODE END USART1_Init 2 */
 
 }
@@ -107,7 +121,31 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
   /* USER CODE BEGIN USART1_MspInit 1 */
+#if UART_STREAM
+    /* USART1_RX into the circular ring of uart_stream.c; interrupts stay
+       disabled, the engine polls the transfer count. The ring sits in
+       SRAM1/2, kept clocked while the CPU runs */
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    __HAL_RCC_D2SRAM1_CLK_ENABLE();
+    __HAL_RCC_D2SRAM2_CLK_ENABLE();
+
+    hdma_usart1_rx.Instance = DMA1_Stream0;
+    hdma_usart1_rx.Init.Request = DMA_REQUEST_USART1_RX;
+    hdma_usart1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_usart1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart1_rx.Init.Mode = DMA_CIRCULAR;
+    hdma_usart1_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    hdma_usart1_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(&hdma_usart1_rx) != HAL_OK)
+    {
+      Error_Handler();
+    }
 
+    __HAL_LINKDMA(uartHandle,hdmarx,hdma_usart1_rx);
+#endif
   /* USER CODE END USART1_MspInit 1 */
   }
 }
@@ -130,7 +168,9 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     HAL_GPIO_DeInit(GPIOB, GPIO_PIN_6|GPIO_PIN_7);
 
   /* USER CODE BEGIN USART1_MspDeInit 1 */
-
+#if UART_STREAM
+    HAL_DMA_DeInit(uartHandle->hdmarx);
+#endif
   /* USER CODE END USART1_MspDeInit 1 */
   }
 }
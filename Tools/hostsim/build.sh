@@ -0,0 +1,50 @@
+#!/bin/sh
+# Build the host simulator: the loader sources from Core/Src, unchanged,
+# against the HAL headers, with sim_cmsis.h standing in for the Cortex-M
+# intrinsics and without the ITCM/DTCM placement. -no-pie keeps the
+# loader's statics below 4 GB, since it passes buffer addresses around
+# as uint32_t. The vendor headers are system includes: their casts
+# between uint32_t and pointers only warn on a 64-bit host.
+#
+#   Tools/hostsim/build.sh [output directory] [extra gcc flags]
+#
+# Produces sim (erase/write/verify throughput), replay (programmer
+# session replay), microbench (CPU kernels, CSV), uart_dev (USART1
+# download engine behind a pseudo-terminal) and check (flash contents
+# after the image formats, run by check.sh).
+
+set -e
+cd "$(dirname "$0")/../.."
+
+OUT=${1:-Tools/hostsim}
+[ $# -gt 0 ] && shift
+
+LOADER="quadspi.c Loader_Src.c Loader_Batch.c Loader_Sparse.c Loader_Read.c
+        Loader_Journal.c qspi_queue.c loader_stats.c loader_trace.c gpio.c mdma.c
+        crc32.c lz4_stream.c microbench.c loader_tcm.c uart_stream.c"
+
+SRC=""
+for f in $LOADER; do
+    SRC="$SRC Core/Src/$f"
+done
+
+for main in sim replay microbench uart_dev check; do
+    src=Tools/hostsim/$main.c
+    flags=""
+    [ $main = sim ] && src=Tools/hostsim/sim_main.c
+    [ $main = microbench ] && src=Tools/hostsim/microbench_main.c \
+        && flags="-DMICROBENCH=1 -DMICROBENCH_HOST"
+    [ $main = uart_dev ] && flags="-DUART_STREAM=1"
+    ${CC:-gcc} -std=gnu11 -O2 -g -no-pie -fno-pie -fno-strict-aliasing \
+        -Wall \
+        -include Tools/hostsim/sim_cmsis.h \
+        -DUSE_HAL_DRIVER -DSTM32H750xx -DUSE_PWR_LDO_SUPPLY -D_GNU_SOURCE -DLOADER_TCM=0 \
+        -ICore/Inc -ITools/hostsim \
+        -isystem Drivers/STM32H7xx_HAL_Driver/Inc \
+        -isystem Drivers/CMSIS/Device/ST/STM32H7xx/Include \
+        -isystem Drivers/CMSIS/Include \
+        $flags "$@" \
+        $SRC \
+        Tools/hostsim/sim_hal.c Tools/hostsim/sim_uart.c Tools/hostsim/mt25ql512.c $src \
+        -o "$OUT/$main"
+done
@@ -0,0 +1,991 @@
+/*
+ * check.c
+ *
+ * Runs the loader exports that take a whole image per call against the
+ * simulator and compares the flash model with what they should have
+ * programmed, byte for byte, including the corrupt inputs they have to
+ * refuse. Tools/hostsim/check.sh makes the inputs with the tools in
+ * Tools/ and runs every case.
+ *
+ *   check lz4 image.bin frames.lz4f    WriteCompressed() of lz4_frames.py output
+ *   check fill                         Fill() patterns over unaligned ranges
+ *   check sparse image.bin image.sprs address
+ *                                      WriteSparse() of sparse_pack.py output,
+ *                                      packed for the image at flash offset address
+ *   check batch                        RunBatch() results, timing and stop on error
+ *   check write                        Write() programs each buffer before returning
+ *   check timeout                      a page program outlasting the queue timeout
+ *   check verify                       Verify() of written ranges in a later session
+ *   check journal                      JournalResume() after an interrupted session,
+ *                                      built with LOADER_JOURNAL=1
+ *
+ * Prints one line per case and exits non-zero if any of them failed.
+ */
+#include "Loader_Src.h"
+#include "sim.h"
+#include "crc32.h"
+#include "batch_list.h"
+#include "quadspi.h"
+#include "lz4_stream.h"
+#include "sparse_image.h"
+#include "loader_journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK_ADDRESS       0x00120123u /* inside a sector, off the page grid */
+#define CHECK_AREA          0x00100000u /* flash reset to erased around CHECK_ADDRESS */
+#define CHECK_FRAME_MAX     0x200       /* crafted LZ4 frames */
+
+typedef struct {
+    uint8_t* data;
+    uint32_t size;
+} Check_File;
+
+static uint8_t* storage;
+static uint8_t* ram = (uint8_t*) (uintptr_t) SIM_RAM_ADDRESS;
+static uint32_t failures;
+
+static int Check_Lz4(int argc, char** argv);
+static int Check_Fill(int argc, char** argv);
+static int Check_Sparse(int argc, char** argv);
+static int Check_Batch(int argc, char** argv);
+static int Check_Write(int argc, char** argv);
+static int Check_Timeout(int argc, char** argv);
+static int Check_Verify(int argc, char** argv);
+#if LOADER_JOURNAL
+static int Check_Journal(int argc, char** argv);
+#endif
+static void Check_Reset(void);
+static void Check_Result(const char* name, const char* reason);
+static const char* Check_Flash(uint32_t address, const uint8_t* expected, uint32_t size);
+static const char* Check_Erased(uint32_t address, uint32_t size);
+static Check_File Check_Load(const char* path);
+static uint32_t Lz4_Frame(uint8_t* frame, const uint8_t* block, uint32_t size, uint32_t raw_size);
+static const char* Lz4_Rejected(uint32_t size, uint32_t programmed, const uint8_t* image);
+#if LOADER_JOURNAL
+static const char* Journal_Session(const uint8_t* data, uint32_t address, uint32_t erase_size,
+                                   uint32_t write_size, uint32_t verify_size);
+static const char* Journal_Resumes(uint32_t erased, uint32_t programmed, uint32_t verified);
+#endif
+static const char* Fill_Range(uint32_t address, uint32_t size, const uint8_t* pattern,
+                              uint32_t pattern_len);
+static uint32_t Batch_List(const struct BatchOp* ops, uint32_t count,
+                           const uint8_t* data, uint32_t data_size);
+static const char* Batch_Results(const struct BatchOp* expected, uint32_t count,
+                                 uint32_t completed);
+static const char* Batch_Flash(const uint8_t* data, uint32_t fill);
+static const char* Write_Buffers(const uint8_t* data, uint32_t size, uint32_t chunk);
+static void Sparse_Seal(uint32_t size);
+static const char* Sparse_Rejected(uint32_t size, const uint8_t* background);
+
+static const struct {
+    const char* name;
+    int args;
+    int (*run)(int argc, char** argv);
+} cases[] = {
+    { "lz4",    2, Check_Lz4 },
+    { "fill",   0, Check_Fill },
+    { "sparse", 3, Check_Sparse },
+    { "batch",  0, Check_Batch },
+    { "write",  0, Check_Write },
+    { "timeout", 0, Check_Timeout },
+    { "verify", 0, Check_Verify },
+#if LOADER_JOURNAL
+    { "journal", 0, Check_Journal },
+#endif
+};
+
+int
+main(int argc, char** argv) {
+    uint32_t i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if ((argc == cases[i].args + 2) && !strcmp(argv[1], cases[i].name)) {
+            Sim_Init(&flash_timing_typical);
+            storage = Sim_FlashStorage();
+            return cases[i].run(argc - 2, argv + 2);
+        }
+    }
+
+    fprintf(stderr, "usage: %s lz4 image.bin frames.lz4f | fill"
+            " | sparse image.bin image.sprs address | batch | write | timeout | verify"
+            " | journal\n", argv[0]);
+    return 2;
+}
+
+/*
+ * WriteCompressed(): the stream made by lz4_frames.py must reproduce the
+ * image. A frame with a broken header, CRC or block must be refused
+ * before anything is programmed from it; the frames in front of it stay
+ * programmed. Matches overlapping their own output are legal LZ4 (run
+ * length encoding) and have to decode.
+ */
+static int
+Check_Lz4(int argc, char** argv) {
+    static const uint8_t overlap[] = { 0x1F, 'A', 0x01, 0x00, 0xFF, 0x10,
+                                       0x50, 'B', 'C', 'D', 'E', 'F' };
+    static const struct {
+        const char* name;
+        uint8_t block[8];
+        uint32_t size;
+        uint32_t raw_size;
+    } malformed[] = {
+        { "truncated literals",      { 0x50, 'A', 'B', 'C' },             4, 5 },
+        { "truncated match offset",  { 0x14, 'A', 0x01 },                 3, 9 },
+        { "truncated match length",  { 0x1F, 'A', 0x01, 0x00, 0xFF },     5, 0x115 },
+        { "match before the block",  { 0x10, 'A', 0x02, 0x00 },           4, 5 },
+        { "zero match offset",       { 0x10, 'A', 0x00, 0x00 },           4, 5 },
+    };
+    Check_File image = Check_Load(argv[0]);
+    Check_File stream = Check_Load(argv[1]);
+    struct LZ4_FrameHeader header, second;
+    uint8_t expected[sizeof(overlap) + 0x120], block[CHECK_FRAME_MAX];
+    uint32_t i, size;
+
+    (void) argc;
+    if (stream.size > SIM_RAM_SIZE) {
+        fprintf(stderr, "check: %s does not fit the RAM buffer\n", argv[1]);
+        return 2;
+    }
+    memcpy(&header, stream.data, sizeof(header));
+    memcpy(&second, stream.data + sizeof(header) + header.CompressedSize, sizeof(second));
+    if ((header.Magic != LZ4_FRAME_MAGIC) || (image.size <= header.RawSize)) {
+        fprintf(stderr, "check: %s needs at least two frames\n", argv[1]);
+        return 2;
+    }
+
+    Check_Reset();
+    memcpy(ram, stream.data, stream.size);
+    Check_Result("lz4 image",
+                 (WriteCompressed(SIM_WINDOW_ADDRESS + CHECK_ADDRESS, stream.size, ram) != LOADER_OK)
+                 ? "refused" : Check_Flash(CHECK_ADDRESS, image.data, image.size));
+
+    /* Corrupt headers and blocks of the lz4_frames.py stream */
+    memcpy(ram, stream.data, stream.size);
+    ((struct LZ4_FrameHeader*) ram)->Magic ^= 1;
+    Check_Result("lz4 bad magic", Lz4_Rejected(stream.size, 0, image.data));
+
+    memcpy(ram, stream.data, stream.size);
+    ram[sizeof(header) + header.CompressedSize / 2] ^= 0x40;
+    Check_Result("lz4 bad crc", Lz4_Rejected(stream.size, 0, image.data));
+
+    memcpy(ram, stream.data, stream.size);
+    ((struct LZ4_FrameHeader*) ram)->RawSize = LZ4_BLOCK_MAX_SIZE + 1;
+    Check_Result("lz4 raw size too large", Lz4_Rejected(stream.size, 0, image.data));
+
+    memcpy(ram, stream.data, stream.size);
+    ((struct LZ4_FrameHeader*) ram)->RawSize = header.RawSize - 1;
+    Check_Result("lz4 raw size mismatch", Lz4_Rejected(stream.size, 0, image.data));
+
+    memcpy(ram, stream.data, stream.size);
+    ((struct LZ4_FrameHeader*) ram)->CompressedSize = stream.size;
+    Check_Result("lz4 block past the stream", Lz4_Rejected(stream.size, 0, image.data));
+
+    size = 2 * sizeof(header) + header.CompressedSize + second.CompressedSize - 1;
+    memcpy(ram, stream.data, size);
+    Check_Result("lz4 truncated second frame", Lz4_Rejected(size, header.RawSize, image.data));
+
+    size = 2 * sizeof(header) + header.CompressedSize - 1;
+    Check_Result("lz4 truncated header", Lz4_Rejected(size, header.RawSize, image.data));
+
+    /* Blocks with a valid CRC that the decoder has to refuse */
+    for (i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        char name[64];
+
+        size = Lz4_Frame(ram, malformed[i].block, malformed[i].size, malformed[i].raw_size);
+        snprintf(name, sizeof(name), "lz4 %s", malformed[i].name);
+        Check_Result(name, Lz4_Rejected(size, 0, image.data));
+    }
+
+    /* A run longer than a block: the match has to stop at the capacity */
+    memcpy(block, overlap, 4);
+    memset(block + 4, 0xFF, LZ4_BLOCK_MAX_SIZE / 255 + 1);
+    block[5 + LZ4_BLOCK_MAX_SIZE / 255] = 0x00;
+    size = Lz4_Frame(ram, block, LZ4_BLOCK_MAX_SIZE / 255 + 6, LZ4_BLOCK_MAX_SIZE);
+    Check_Result("lz4 match past the block", Lz4_Rejected(size, 0, image.data));
+
+    /* 'A', a match of 290 bytes at offset 1, then "BCDEF" */
+    memset(expected, 'A', 291);
+    memcpy(expected + 291, "BCDEF", 5);
+    Check_Reset();
+    size = Lz4_Frame(ram, overlap, sizeof(overlap), 296);
+    Check_Result("lz4 overlapping match",
+                 (WriteCompressed(SIM_WINDOW_ADDRESS + CHECK_ADDRESS, size, ram) != LOADER_OK)
+                 ? "refused" : Check_Flash(CHECK_ADDRESS, expected, 296));
+
+    free(image.data);
+    free(stream.data);
+    return failures != 0;
+}
+
+/*
+ * Fill(): ranges starting and ending off the page grid, crossing sector
+ * boundaries, with patterns that do and do not divide the page size. A
+ * pattern of erased bytes must leave the flash alone, so it runs over
+ * programmed data without a single program command.
+ */
+static int
+Check_Fill(int argc, char** argv) {
+    static const uint8_t pattern7[] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD };
+    static const uint8_t pattern3[] = { 0x00, 0xFF, 0x5A };
+    static const uint8_t blank[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    uint8_t page[MEMORY_PAGE_SIZE], *background;
+    uint32_t i, programs;
+
+    (void) argc;
+    (void) argv;
+    for (i = 0; i < sizeof(page); i++) {
+        page[i] = i * 13 + 1;
+    }
+
+    Check_Result("fill unaligned start and end",
+                 Fill_Range(CHECK_ADDRESS, 0x3E5, pattern7, sizeof(pattern7)));
+    Check_Result("fill inside one page", Fill_Range(CHECK_ADDRESS, 0x11, pattern3, sizeof(pattern3)));
+    Check_Result("fill one byte pattern", Fill_Range(CHECK_ADDRESS + 0xDD, 0x1000, pattern3 + 2, 1));
+    Check_Result("fill page sized pattern", Fill_Range(CHECK_ADDRESS, 0x1234, page, sizeof(page)));
+    Check_Result("fill across sectors",
+                 Fill_Range(0x0012FF37, 2 * MEMORY_SECTOR_SIZE + 0x155, pattern3, sizeof(pattern3)));
+    Check_Result("fill half blank pattern", Fill_Range(CHECK_ADDRESS, 0x801, pattern3, 2));
+
+    /* Over programmed data: any program command would show in the stats */
+    background = malloc(CHECK_AREA);
+    for (i = 0; i < CHECK_AREA; i++) {
+        background[i] = i * 7;
+    }
+    Check_Reset();
+    memcpy(storage + (CHECK_ADDRESS & ~(CHECK_AREA - 1)), background, CHECK_AREA);
+    memcpy(ram, blank, sizeof(blank));
+    programs = Sim_FlashStats().programs;
+    Check_Result("fill blank pattern",
+                 (Fill(SIM_WINDOW_ADDRESS + CHECK_ADDRESS, 0x20000, ram, sizeof(blank)) != LOADER_OK)
+                 ? "refused"
+                 : (Sim_FlashStats().programs != programs)
+                 ? "programmed"
+                 : memcmp(storage + (CHECK_ADDRESS & ~(CHECK_AREA - 1)), background, CHECK_AREA)
+                 ? "flash changed" : NULL);
+    free(background);
+
+    Check_Reset();
+    Check_Result("fill empty pattern",
+                 (Fill(SIM_WINDOW_ADDRESS + CHECK_ADDRESS, 0x100, ram, 0) != LOADER_FAIL)
+                 ? "accepted" : Check_Flash(CHECK_ADDRESS, page, 0));
+    Check_Result("fill pattern above a page",
+                 (Fill(SIM_WINDOW_ADDRESS + CHECK_ADDRESS, 0x200, ram, MEMORY_PAGE_SIZE + 1) != LOADER_FAIL)
+                 ? "accepted" : Check_Flash(CHECK_ADDRESS, page, 0));
+
+    return failures != 0;
+}
+
+/*
+ * WriteSparse(): over programmed data, the descriptor made by
+ * sparse_pack.py must leave the image in the flash, the rest of the
+ * sectors it touches erased and every other sector alone. A descriptor
+ * failing validation must be refused before the first erase.
+ */
+static int
+Check_Sparse(int argc, char** argv) {
+    Check_File image = Check_Load(argv[0]);
+    Check_File sparse = Check_Load(argv[1]);
+    uint32_t address = strtoul(argv[2], NULL, 0);
+    uint32_t base = CHECK_ADDRESS & ~(CHECK_AREA - 1);
+    uint32_t first = address & ~(MEMORY_SECTOR_SIZE - 1);
+    uint32_t end = (address + image.size + MEMORY_SECTOR_SIZE - 1) & ~(MEMORY_SECTOR_SIZE - 1);
+    struct SparseSegment* segments = (struct SparseSegment*) (ram + sizeof(struct SparseHeader));
+    struct SparseHeader header;
+    uint8_t* background = malloc(CHECK_AREA);
+    uint8_t* expected = malloc(CHECK_AREA);
+    uint32_t i, last;
+
+    (void) argc;
+    memcpy(&header, sparse.data, sizeof(header));
+    if ((sparse.size > SIM_RAM_SIZE) || (header.Magic != SPARSE_MAGIC) || (header.SegmentCount < 2)
+        || (address < base) || (end > base + CHECK_AREA)) {
+        fprintf(stderr, "check: %s is not a descriptor of two or more runs inside the area\n",
+                argv[1]);
+        return 2;
+    }
+    last = header.SegmentCount - 1;
+
+    for (i = 0; i < CHECK_AREA; i++) {
+        background[i] = i * 7 + 3;
+    }
+    memcpy(expected, background, CHECK_AREA);
+    memset(expected + first - base, 0xFF, end - first);
+    memcpy(expected + address - base, image.data, image.size);
+
+    Check_Reset();
+    memcpy(storage + base, background, CHECK_AREA);
+    memcpy(ram, sparse.data, sparse.size);
+    Check_Result("sparse image",
+                 (WriteSparse(ram, sparse.size) != LOADER_OK)
+                 ? "refused"
+                 : memcmp(storage + base, expected, CHECK_AREA)
+                 ? "flash differs from the image" : NULL);
+
+    memcpy(ram, sparse.data, sparse.size);
+    ((struct SparseHeader*) ram)->Crc ^= 1;
+    Check_Result("sparse bad header crc", Sparse_Rejected(sparse.size, background));
+
+    memcpy(ram, sparse.data, sparse.size);
+    ram[sparse.size - 1] ^= 0x10;
+    Check_Result("sparse bad data crc", Sparse_Rejected(sparse.size, background));
+
+    memcpy(ram, sparse.data, sparse.size);
+    ((struct SparseHeader*) ram)->Magic ^= 1;
+    Sparse_Seal(sparse.size);
+    Check_Result("sparse bad magic", Sparse_Rejected(sparse.size, background));
+
+    memcpy(ram, sparse.data, sparse.size - 1);
+    Sparse_Seal(sparse.size - 1);
+    Check_Result("sparse truncated", Sparse_Rejected(sparse.size - 1, background));
+
+    /* The last run starts inside the one before it */
+    memcpy(ram, sparse.data, sparse.size);
+    segments[last].Address = segments[last - 1].Address + segments[last - 1].Size - 1;
+    segments[last].FirstSector = segments[last].Address / MEMORY_SECTOR_SIZE;
+    segments[last].SectorCount = (segments[last].Address + segments[last].Size - 1)
+                                 / MEMORY_SECTOR_SIZE - segments[last].FirstSector + 1;
+    Sparse_Seal(sparse.size);
+    Check_Result("sparse overlapping segments", Sparse_Rejected(sparse.size, background));
+
+    /* The last run ends past the flash, then starts past it */
+    memcpy(ram, sparse.data, sparse.size);
+    segments[last].Address = MEMORY_FLASH_SIZE - segments[last].Size + 1;
+    segments[last].FirstSector = segments[last].Address / MEMORY_SECTOR_SIZE;
+    segments[last].SectorCount = 1 + (segments[last].Address % MEMORY_SECTOR_SIZE
+                                      + segments[last].Size - 1) / MEMORY_SECTOR_SIZE;
+    Sparse_Seal(sparse.size);
+    Check_Result("sparse segment past the flash", Sparse_Rejected(sparse.size, background));
+
+    segments[last].Address = MEMORY_FLASH_SIZE;
+    segments[last].FirstSector = MEMORY_FLASH_SIZE / MEMORY_SECTOR_SIZE;
+    Sparse_Seal(sparse.size);
+    Check_Result("sparse segment beyond the flash", Sparse_Rejected(sparse.size, background));
+
+    memcpy(ram, sparse.data, sparse.size);
+    segments[last].SectorCount++;
+    Sparse_Seal(sparse.size);
+    Check_Result("sparse wrong sector count", Sparse_Rejected(sparse.size, background));
+
+    memcpy(ram, sparse.data, sparse.size);
+    for (i = 0; (i < last) && (segments[i].Type != SPARSE_DATA); i++) {
+    }
+    segments[i].Type = SPARSE_DATA;
+    segments[i].Value = header.DataSize - segments[i].Size + 1;
+    Sparse_Seal(sparse.size);
+    Check_Result("sparse data past the payload", Sparse_Rejected(sparse.size, background));
+
+    free(background);
+    free(expected);
+    free(image.data);
+    free(sparse.data);
+    return failures != 0;
+}
+
+/*
+ * RunBatch(): every operation type with its status, result and cycle
+ * count, then a list whose verify fails: the list stops there, reports
+ * the failing address, and the operations behind it stay pending and
+ * leave the flash alone.
+ */
+#define BATCH_PROGRAM_SIZE  0x1234
+#define BATCH_FILL_SIZE     0x301
+#define BATCH_FILL_PATTERN  0x5AA5C33Cu
+#define BATCH_MISMATCH      0x777
+
+static int
+Check_Batch(int argc, char** argv) {
+    const uint32_t fill = CHECK_ADDRESS + 0x2000;
+    uint8_t data[BATCH_PROGRAM_SIZE + BATCH_FILL_SIZE];
+    uint32_t i, sum = 0, fill_sum = 0, size;
+    uint32_t pattern = BATCH_FILL_PATTERN;
+    const char* reason;
+
+    (void) argc;
+    (void) argv;
+    for (i = 0; i < BATCH_PROGRAM_SIZE; i++) {
+        data[i] = i * 31 + 7;
+        sum += data[i];
+    }
+    for (i = 0; i < BATCH_FILL_SIZE; i++) {
+        data[BATCH_PROGRAM_SIZE + i] = ((uint8_t*) &pattern)[i % 4];
+        fill_sum += data[BATCH_PROGRAM_SIZE + i];
+    }
+
+    {
+        const struct BatchOp ops[] = {
+            { BATCH_OP_ERASE, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, 2 * MEMORY_SECTOR_SIZE, 0,
+              BATCH_STATUS_OK, 0, 0 },
+            { BATCH_OP_PROGRAM, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, BATCH_PROGRAM_SIZE, 0,
+              BATCH_STATUS_OK, 0, 0 },
+            { BATCH_OP_FILL, SIM_WINDOW_ADDRESS + fill, BATCH_FILL_SIZE, BATCH_FILL_PATTERN,
+              BATCH_STATUS_OK, 0, 0 },
+            { BATCH_OP_VERIFY, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, BATCH_PROGRAM_SIZE, 0,
+              BATCH_STATUS_OK, sum, 0 },
+            { BATCH_OP_VERIFY, SIM_WINDOW_ADDRESS + fill, BATCH_FILL_SIZE, BATCH_PROGRAM_SIZE,
+              BATCH_STATUS_OK, fill_sum, 0 },
+            { BATCH_OP_CRC, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, BATCH_PROGRAM_SIZE, 0,
+              BATCH_STATUS_OK, Crc32_Update(CRC32_INIT, data, BATCH_PROGRAM_SIZE), 0 },
+        };
+        const uint32_t count = sizeof(ops) / sizeof(ops[0]);
+
+        /* Programmed data in the area: the erase has to clear it */
+        Check_Reset();
+        memset(storage + CHECK_ADDRESS, 0x00, 2 * MEMORY_SECTOR_SIZE - 0x200);
+        size = Batch_List(ops, count, data, sizeof(data));
+        reason = (RunBatch(ram, size) != LOADER_OK) ? "refused" : Batch_Results(ops, count, count);
+        if (reason == NULL) {
+            reason = Batch_Flash(data, fill);
+        }
+        Check_Result("batch all operations", reason);
+    }
+
+    {
+        /* The flash of the first list, read back in a new session */
+        const struct BatchOp ops[] = {
+            { BATCH_OP_CRC, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, BATCH_PROGRAM_SIZE, 0,
+              BATCH_STATUS_OK, Crc32_Update(CRC32_INIT, data, BATCH_PROGRAM_SIZE), 0 },
+            { BATCH_OP_VERIFY, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, BATCH_PROGRAM_SIZE, 0,
+              BATCH_STATUS_FAIL, SIM_WINDOW_ADDRESS + CHECK_ADDRESS + BATCH_MISMATCH, 0 },
+            { BATCH_OP_ERASE, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, MEMORY_SECTOR_SIZE, 0,
+              BATCH_STATUS_PENDING, 0, 0 },
+            { BATCH_OP_FILL, SIM_WINDOW_ADDRESS + fill, BATCH_FILL_SIZE, 0,
+              BATCH_STATUS_PENDING, 0, 0 },
+        };
+        const uint32_t count = sizeof(ops) / sizeof(ops[0]);
+
+        if (Init() != LOADER_OK) {
+            fprintf(stderr, "check: Init failed\n");
+            return 1;
+        }
+        data[BATCH_MISMATCH] ^= 0x10;
+        size = Batch_List(ops, count, data, sizeof(data));
+        reason = (RunBatch(ram, size) != LOADER_FAIL) ? "accepted" : Batch_Results(ops, count, 1);
+        data[BATCH_MISMATCH] ^= 0x10;
+        if ((reason == NULL) && Batch_Flash(data, fill)) {
+            reason = "ran operations behind the failure";
+        }
+        Check_Result("batch stop on error", reason);
+    }
+
+    {
+        const struct BatchOp ops[] = {
+            { 0x77, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, 0x100, 0, BATCH_STATUS_FAIL, 0, 0 },
+            { BATCH_OP_ERASE, SIM_WINDOW_ADDRESS + CHECK_ADDRESS, 0x100, 0,
+              BATCH_STATUS_PENDING, 0, 0 },
+        };
+
+        size = Batch_List(ops, 2, data, 0);
+        Check_Result("batch unknown operation",
+                     (RunBatch(ram, size) != LOADER_FAIL) ? "accepted" : Batch_Results(ops, 2, 0));
+
+        size = Batch_List(ops + 1, 1, data, 0);
+        ((struct BatchHeader*) ram)->Magic ^= 1;
+        Check_Result("batch bad magic",
+                     (RunBatch(ram, size) != LOADER_FAIL) ? "accepted"
+                     : (((struct BatchOp*) (ram + sizeof(struct BatchHeader)))->Status != 0xFFFFFFFF)
+                     ? "ran the list" : NULL);
+    }
+
+    return failures != 0;
+}
+
+/*
+ * Write(): every call is on flash when it returns, since the tool may never
+ * call again. A page split between two buffers is programmed in two parts,
+ * the bytes of the other part still erased each time.
+ */
+#define WRITE_SIZE          0x3456
+#define WRITE_CHUNK         0x1000
+
+static int
+Check_Write(int argc, char** argv) {
+    uint8_t data[WRITE_SIZE];
+    const char* reason;
+    uint32_t i;
+
+    (void) argc;
+    (void) argv;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = i * 31 + 7;
+    }
+
+    Check_Reset();
+    memcpy(ram, data, 0x80);
+    reason = (Write(SIM_WINDOW_ADDRESS + CHECK_ADDRESS, 0x80, ram) != LOADER_OK) ? "refused"
+             : Check_Flash(CHECK_ADDRESS, data, 0x80);
+    Check_Result("write partial page", reason);
+
+    Check_Reset();
+    Check_Result("write buffers across pages", Write_Buffers(data, 3 * WRITE_CHUNK, WRITE_CHUNK));
+
+    Check_Reset();
+    Check_Result("write shorter last buffer", Write_Buffers(data, WRITE_SIZE, WRITE_CHUNK));
+
+    return failures != 0;
+}
+
+/*
+ * A page program the part never finishes within the queue timeout: Write()
+ * fails with the peripheral stopped and back in indirect mode, and once
+ * the part is done a new session programs normally.
+ */
+static int
+Check_Timeout(int argc, char** argv) {
+    const Flash_TimingTypeDef* timing = sim_flash[CHECK_ADDRESS / FLASH_MODEL_SIZE].timing;
+    Flash_TimingTypeDef stuck = *timing;
+    uint32_t page = CHECK_ADDRESS & ~(MEMORY_PAGE_SIZE - 1);
+    uint8_t data[MEMORY_PAGE_SIZE];
+    const char* reason;
+    uint32_t i;
+
+    (void) argc;
+    (void) argv;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = i ^ 0x3C;
+    }
+
+    Check_Reset();
+    stuck.page_program_base = 10000000000ULL;
+    sim_flash[page / FLASH_MODEL_SIZE].timing = &stuck;
+    memcpy(ram, data, sizeof(data));
+    reason = (Write(SIM_WINDOW_ADDRESS + page, sizeof(data), ram) != LOADER_FAIL) ? "accepted"
+             : (hqspi.State != HAL_QSPI_STATE_READY) ? "peripheral left busy"
+             : (CSP_QSPI_GetMode() != QSPI_MODE_INDIRECT) ? "not back in indirect mode" : NULL;
+    sim_flash[page / FLASH_MODEL_SIZE].timing = timing;
+    Check_Result("timeout state", reason);
+
+    Sim_Advance(stuck.page_program_base);
+    Check_Reset();
+    Check_Result("timeout next session",
+                 (Write(SIM_WINDOW_ADDRESS + page, sizeof(data), ram) != LOADER_OK)
+                 ? "refused" : Check_Flash(page, data, sizeof(data)));
+
+    return failures != 0;
+}
+
+/*
+ * Verify() after Init(), as the tool calls it: a range read back when it
+ * was written is not read again for the buffer it was written from, but a
+ * buffer differing from it, or a range written in other pieces, is
+ * compared with the flash and a difference reported at its address. The
+ * sum it takes first leaves the interrupts as it found them.
+ */
+#define VERIFY_SIZE         0x8000
+#define VERIFY_MISMATCH     0x1234
+
+static int
+Check_Verify(int argc, char** argv) {
+    const uint32_t address = CHECK_ADDRESS & ~(MEMORY_PAGE_SIZE - 1);
+    uint64_t mapped;
+    uint32_t i;
+
+    (void) argc;
+    (void) argv;
+    for (i = 0; i < VERIFY_SIZE; i++) {
+        ram[i] = i * 31 + 7;
+    }
+
+    Check_Reset();
+    if ((Write(SIM_WINDOW_ADDRESS + address, VERIFY_SIZE, ram) != LOADER_OK) || (Init() != LOADER_OK)) {
+        fprintf(stderr, "check: Write failed\n");
+        return 1;
+    }
+    mapped = sim_stats.mapped_bytes;
+    Check_Result("verify written buffer",
+                 ((uint32_t) Verify(SIM_WINDOW_ADDRESS + address, SIM_RAM_ADDRESS, VERIFY_SIZE / 4, 0) != 0)
+                 ? "mismatch reported"
+                 : (sim_stats.mapped_bytes != mapped) ? "flash read again" : NULL);
+
+    ram[VERIFY_MISMATCH] ^= 0x10;
+    Check_Result("verify other buffer",
+                 ((uint32_t) Verify(SIM_WINDOW_ADDRESS + address, SIM_RAM_ADDRESS, VERIFY_SIZE / 4, 0)
+                  != SIM_WINDOW_ADDRESS + address + VERIFY_MISMATCH) ? "mismatch not reported" : NULL);
+    ram[VERIFY_MISMATCH] ^= 0x10;
+
+    /* Verify() sums with the interrupts on and compares right after */
+    __set_PRIMASK(0);
+    CheckSum(SIM_WINDOW_ADDRESS + address, VERIFY_SIZE, 0);
+    Check_Result("verify checksum keeps interrupts", __get_PRIMASK() ? "masked on return" : NULL);
+    __set_PRIMASK(1);
+
+    /* Two halves read back, the whole range never written in one piece */
+    Check_Reset();
+    if ((Write(SIM_WINDOW_ADDRESS + address, VERIFY_SIZE / 2, ram) != LOADER_OK)
+        || (Write(SIM_WINDOW_ADDRESS + address + VERIFY_SIZE / 2, VERIFY_SIZE / 2, ram + VERIFY_SIZE / 2)
+            != LOADER_OK)) {
+        fprintf(stderr, "check: Write failed\n");
+        return 1;
+    }
+    storage[address + VERIFY_MISMATCH] ^= 0x10;
+    Check_Result("verify range written in pieces",
+                 ((uint32_t) Verify(SIM_WINDOW_ADDRESS + address, SIM_RAM_ADDRESS, VERIFY_SIZE / 4, 0)
+                  != SIM_WINDOW_ADDRESS + address + VERIFY_MISMATCH) ? "mismatch not reported" : NULL);
+
+    return failures != 0;
+}
+
+#if LOADER_JOURNAL
+/*
+ * Journal: a session stopped half way through a sector, for the next one
+ * after Init() and JournalOpen() of the same image, resumes each stage at
+ * the first sector it did not complete; another image starts over. At the
+ * end of the device area the marks stop short of the journal sector, so a
+ * mass erase resumes at the journal address and not back at sector 0.
+ */
+#define JOURNAL_IMAGE_ID    0x4A0C8E51u
+
+static int
+Check_Journal(int argc, char** argv) {
+    const uint32_t last = JOURNAL_ADDRESS - MEMORY_SECTOR_SIZE;
+    const uint8_t* bitmap = storage + JOURNAL_ADDRESS + (1 + JOURNAL_PROGRAMMED) * MEMORY_PAGE_SIZE;
+    const uint32_t bit = (JOURNAL_SECTORS - 1) % 8;
+    uint8_t* data = malloc(3 * MEMORY_SECTOR_SIZE);
+    const char* reason;
+    uint32_t i;
+
+    (void) argc;
+    (void) argv;
+    for (i = 0; i < 3 * MEMORY_SECTOR_SIZE; i++) {
+        data[i] = i * 31 + 7;
+    }
+
+    /* Programmed sectors and no journal yet */
+    memset(storage, 0x00, 3 * MEMORY_SECTOR_SIZE);
+    memset(storage + JOURNAL_ADDRESS, 0xFF, MEMORY_SECTOR_SIZE);
+    reason = ((Init() != LOADER_OK) || (JournalOpen(JOURNAL_IMAGE_ID) != LOADER_OK)) ? "open failed"
+             : Journal_Resumes(0, 0, 0);
+    if (reason == NULL) {
+        reason = Journal_Session(data, 0, 3 * MEMORY_SECTOR_SIZE,
+                                 2 * MEMORY_SECTOR_SIZE + MEMORY_SECTOR_SIZE / 2, MEMORY_SECTOR_SIZE);
+    }
+    Check_Result("journal new image", reason);
+
+    /* Stopped inside sector 2: a new session reads the marks back */
+    reason = ((Init() != LOADER_OK) || (JournalOpen(JOURNAL_IMAGE_ID) != LOADER_OK)) ? "open failed"
+             : Journal_Resumes(3 * MEMORY_SECTOR_SIZE, 2 * MEMORY_SECTOR_SIZE, MEMORY_SECTOR_SIZE);
+    Check_Result("journal resume after Init", reason);
+
+    /* Each stage redone from its resume point */
+    reason = Journal_Session(data + 2 * MEMORY_SECTOR_SIZE, 2 * MEMORY_SECTOR_SIZE, MEMORY_SECTOR_SIZE,
+                             MEMORY_SECTOR_SIZE, 0);
+    if (reason == NULL) {
+        reason = Journal_Session(data + MEMORY_SECTOR_SIZE, MEMORY_SECTOR_SIZE, 0, 0, 2 * MEMORY_SECTOR_SIZE);
+    }
+    if (reason == NULL) {
+        reason = memcmp(storage, data, 3 * MEMORY_SECTOR_SIZE) ? "flash differs from the image"
+                 : Journal_Resumes(3 * MEMORY_SECTOR_SIZE, 3 * MEMORY_SECTOR_SIZE, 3 * MEMORY_SECTOR_SIZE);
+    }
+    Check_Result("journal resumed session", reason);
+
+    reason = ((Init() != LOADER_OK) || (JournalOpen(JOURNAL_IMAGE_ID + 1) != LOADER_OK)) ? "open failed"
+             : Journal_Resumes(0, 0, 0);
+    if ((reason == NULL) && (JournalOpen(JOURNAL_IMAGE_ID) == LOADER_OK)) {
+        reason = Journal_Resumes(0, 0, 0);
+    }
+    Check_Result("journal other image", reason);
+
+    /* The last sector of the device area, written up to the journal */
+    reason = Journal_Session(data, last, MEMORY_SECTOR_SIZE, MEMORY_SECTOR_SIZE, 0);
+    if (reason == NULL) {
+        reason = ((Init() != LOADER_OK) || (JournalOpen(JOURNAL_IMAGE_ID) != LOADER_OK)) ? "open failed"
+                 : ((bitmap[JOURNAL_BITMAP_SIZE - 1] >> bit) != (0xFFu >> bit) - 1) ? "last sector not marked"
+                 : (*(const uint32_t*) (storage + JOURNAL_ADDRESS) != JOURNAL_MAGIC) ? "header lost"
+                 : memcmp(storage + last, data, MEMORY_SECTOR_SIZE) ? "flash differs from the image"
+                 : Journal_Resumes(0, 0, 0);
+    }
+    Check_Result("journal last sector", reason);
+
+    reason = (MassErase() != LOADER_OK) ? "mass erase failed"
+             : Journal_Resumes(JOURNAL_ADDRESS, 0, 0);
+    if (reason == NULL) {
+        reason = ((Init() != LOADER_OK) || (JournalOpen(JOURNAL_IMAGE_ID) != LOADER_OK)) ? "open failed"
+                 : Journal_Resumes(JOURNAL_ADDRESS, 0, 0);
+    }
+    Check_Result("journal end of device", reason);
+
+    reason = (JournalClose() != LOADER_OK) ? "close failed"
+             : Check_Erased(JOURNAL_ADDRESS, MEMORY_SECTOR_SIZE) ? "journal left on flash"
+             : (JournalResume(JOURNAL_ERASED) != 0) ? "still open" : NULL;
+    if ((reason == NULL) && Sim_FlashStats().violations) {
+        reason = "protocol violations";
+    }
+    Check_Result("journal close", reason);
+
+    free(data);
+    return failures != 0;
+}
+#endif
+
+/*Erase the area the cases program and start a new session on it*/
+static void
+Check_Reset(void) {
+    memset(storage + (CHECK_ADDRESS & ~(CHECK_AREA - 1)), 0xFF, CHECK_AREA);
+    if (Init() != LOADER_OK) {
+        fprintf(stderr, "check: Init failed\n");
+        exit(1);
+    }
+}
+
+static void
+Check_Result(const char* name, const char* reason) {
+    printf("%-32s %s\n", name, reason ? reason : "ok");
+    failures += reason != NULL;
+}
+
+/*NULL if the model holds expected at address, and nothing else was programmed*/
+static const char*
+Check_Flash(uint32_t address, const uint8_t* expected, uint32_t size) {
+    uint32_t base = address & ~(CHECK_AREA - 1);
+
+    if (memcmp(storage + address, expected, size)) {
+        return "flash differs from the image";
+    }
+    if (Check_Erased(base, address - base)
+        || Check_Erased(address + size, base + CHECK_AREA - address - size)) {
+        return "programmed outside the image";
+    }
+    if (Sim_FlashStats().violations) {
+        return "protocol violations";
+    }
+    return NULL;
+}
+
+static const char*
+Check_Erased(uint32_t address, uint32_t size) {
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        if (storage[address + i] != 0xFF) {
+            return "programmed where it should be erased";
+        }
+    }
+    return NULL;
+}
+
+static Check_File
+Check_Load(const char* path) {
+    Check_File file = { NULL, 0 };
+    FILE* f = fopen(path, "rb");
+    long size;
+
+    if ((f == NULL) || fseek(f, 0, SEEK_END) || ((size = ftell(f)) <= 0)) {
+        fprintf(stderr, "check: cannot read %s\n", path);
+        exit(2);
+    }
+    rewind(f);
+    file.size = size;
+    file.data = malloc(size);
+    if ((file.data == NULL) || (fread(file.data, 1, size, f) != (size_t) size)) {
+        fprintf(stderr, "check: cannot read %s\n", path);
+        exit(2);
+    }
+    fclose(f);
+    return file;
+}
+
+/*NULL if Fill() programs the pattern over the range and nothing else*/
+static const char*
+Fill_Range(uint32_t address, uint32_t size, const uint8_t* pattern, uint32_t pattern_len) {
+    uint8_t* expected = malloc(size);
+    const char* reason;
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        expected[i] = pattern[i % pattern_len];
+    }
+    Check_Reset();
+    memcpy(ram, pattern, pattern_len);
+    reason = (Fill(SIM_WINDOW_ADDRESS + address, size, ram, pattern_len) != LOADER_OK)
+             ? "refused" : Check_Flash(address, expected, size);
+    free(expected);
+    return reason;
+}
+
+/*Write an operation list to RAM, outputs poisoned; returns its size*/
+static uint32_t
+Batch_List(const struct BatchOp* ops, uint32_t count, const uint8_t* data, uint32_t data_size) {
+    struct BatchHeader header = { BATCH_MAGIC, count, 0xFFFFFFFF, 0xFFFFFFFF };
+    struct BatchOp* list = (struct BatchOp*) (ram + sizeof(header));
+    uint32_t i;
+
+    memcpy(ram, &header, sizeof(header));
+    for (i = 0; i < count; i++) {
+        list[i] = ops[i];
+        list[i].Status = 0xFFFFFFFF;
+        list[i].Result = 0xFFFFFFFF;
+        list[i].Cycles = 0xFFFFFFFF;
+    }
+    memcpy(&list[count], data, data_size);
+    return sizeof(header) + count * sizeof(*list) + data_size;
+}
+
+/*NULL if the list in RAM reports the expected status and result of each
+ *operation, cycles for those that ran and the completed count*/
+static const char*
+Batch_Results(const struct BatchOp* expected, uint32_t count, uint32_t completed) {
+    const struct BatchHeader* header = (const struct BatchHeader*) ram;
+    const struct BatchOp* list = (const struct BatchOp*) (ram + sizeof(*header));
+    uint64_t cycles = 0;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (list[i].Status != expected[i].Status) {
+            return "wrong status";
+        }
+        if (list[i].Status == BATCH_STATUS_PENDING) {
+            continue;
+        }
+        if ((list[i].Result != expected[i].Result) && (expected[i].Op != BATCH_OP_ERASE)
+            && (expected[i].Op != BATCH_OP_PROGRAM) && (expected[i].Op != BATCH_OP_FILL)) {
+            return "wrong result";
+        }
+        /* The clock only moves with bus and flash time: reads of the
+         * window already fetched take none */
+        if ((list[i].Cycles == 0xFFFFFFFF)
+            || ((list[i].Cycles == 0) && (list[i].Status == BATCH_STATUS_OK)
+                && (list[i].Op != BATCH_OP_VERIFY) && (list[i].Op != BATCH_OP_CRC))) {
+            return "no cycle count";
+        }
+        cycles += list[i].Cycles;
+    }
+    if (header->Completed != completed) {
+        return "wrong completed count";
+    }
+    if ((header->Cycles == 0xFFFFFFFF) || (header->Cycles < cycles)) {
+        return "batch cycles below the operations";
+    }
+    return NULL;
+}
+
+/*NULL if the area holds the programmed and the filled range of the first
+ *list, and is erased everywhere else*/
+static const char*
+Batch_Flash(const uint8_t* data, uint32_t fill) {
+    uint32_t base = CHECK_ADDRESS & ~(CHECK_AREA - 1);
+    uint32_t end = CHECK_ADDRESS + BATCH_PROGRAM_SIZE;
+
+    if (memcmp(storage + CHECK_ADDRESS, data, BATCH_PROGRAM_SIZE)
+        || memcmp(storage + fill, data + BATCH_PROGRAM_SIZE, BATCH_FILL_SIZE)) {
+        return "flash differs from the list";
+    }
+    return (Check_Erased(base, CHECK_ADDRESS - base) || Check_Erased(end, fill - end)
+            || Check_Erased(fill + BATCH_FILL_SIZE, base + CHECK_AREA - fill - BATCH_FILL_SIZE))
+           ? "programmed outside the list" : NULL;
+}
+
+/*Write() size bytes of data at CHECK_ADDRESS in chunk sized buffers; NULL
+ *if each call leaves the data so far on flash and nothing else*/
+static const char*
+Write_Buffers(const uint8_t* data, uint32_t size, uint32_t chunk) {
+    const char* reason;
+    uint32_t offset, length;
+
+    for (offset = 0; offset < size; offset += length) {
+        length = (size - offset < chunk) ? size - offset : chunk;
+        memcpy(ram, data + offset, length);
+        if (Write(SIM_WINDOW_ADDRESS + CHECK_ADDRESS + offset, length, ram) != LOADER_OK) {
+            return "refused";
+        }
+        if ((reason = Check_Flash(CHECK_ADDRESS, data, offset + length)) != NULL) {
+            return reason;
+        }
+    }
+    return NULL;
+}
+
+/*Recompute the CRC of the descriptor in RAM after editing it*/
+static void
+Sparse_Seal(uint32_t size) {
+    struct SparseHeader* header = (struct SparseHeader*) ram;
+
+    header->Crc = Crc32_Update(CRC32_INIT, ram + sizeof(*header), size - sizeof(*header));
+}
+
+/*NULL if WriteSparse() refuses the descriptor in RAM without erasing or
+ *programming anything*/
+static const char*
+Sparse_Rejected(uint32_t size, const uint8_t* background) {
+    uint32_t base = CHECK_ADDRESS & ~(CHECK_AREA - 1);
+    Flash_StatsTypeDef before;
+
+    Check_Reset();
+    memcpy(storage + base, background, CHECK_AREA);
+    before = Sim_FlashStats();
+    if (WriteSparse(ram, size) != LOADER_FAIL) {
+        return "accepted";
+    }
+    if ((Sim_FlashStats().erases != before.erases) || (Sim_FlashStats().programs != before.programs)
+        || memcmp(storage + base, background, CHECK_AREA)) {
+        return "flash changed";
+    }
+    return NULL;
+}
+
+/*Wrap an LZ4 block into a frame at the start of frame; returns the frame size*/
+static uint32_t
+Lz4_Frame(uint8_t* frame, const uint8_t* block, uint32_t size, uint32_t raw_size) {
+    struct LZ4_FrameHeader header = { LZ4_FRAME_MAGIC, raw_size, size, 0 };
+
+    memmove(frame + sizeof(header), block, size);
+    header.Crc = Crc32_Update(CRC32_INIT, frame + sizeof(header), size);
+    memcpy(frame, &header, sizeof(header));
+    return sizeof(header) + size;
+}
+
+/*NULL if WriteCompressed() refuses the stream in RAM after programming
+ *the first programmed bytes of the image, and nothing else*/
+static const char*
+Lz4_Rejected(uint32_t size, uint32_t programmed, const uint8_t* image) {
+    Check_Reset();
+    if (WriteCompressed(SIM_WINDOW_ADDRESS + CHECK_ADDRESS, size, ram) != LOADER_FAIL) {
+        return "accepted";
+    }
+    return Check_Flash(CHECK_ADDRESS, image, programmed);
+}
+
+#if LOADER_JOURNAL
+/*Erase, Write() and Verify() the given sizes of data at address, in the
+ *tool's buffer size; NULL if every call succeeds*/
+static const char*
+Journal_Session(const uint8_t* data, uint32_t address, uint32_t erase_size,
+                uint32_t write_size, uint32_t verify_size) {
+    uint32_t offset, length;
+
+    if (erase_size && (SectorErase(SIM_WINDOW_ADDRESS + address,
+                                   SIM_WINDOW_ADDRESS + address + erase_size - 1) != LOADER_OK)) {
+        return "erase failed";
+    }
+    for (offset = 0; offset < write_size; offset += length) {
+        length = (write_size - offset < WRITE_CHUNK) ? write_size - offset : WRITE_CHUNK;
+        memcpy(ram, data + offset, length);
+        if (Write(SIM_WINDOW_ADDRESS + address + offset, length, ram) != LOADER_OK) {
+            return "write failed";
+        }
+    }
+    for (offset = 0; offset < verify_size; offset += length) {
+        length = (verify_size - offset < WRITE_CHUNK) ? verify_size - offset : WRITE_CHUNK;
+        memcpy(ram, data + offset, length);
+        if ((uint32_t) Verify(SIM_WINDOW_ADDRESS + address + offset, SIM_RAM_ADDRESS, length / 4, 0)) {
+            return "verify failed";
+        }
+    }
+    return NULL;
+}
+
+/*NULL if JournalResume() of each stage returns the given flash offset*/
+static const char*
+Journal_Resumes(uint32_t erased, uint32_t programmed, uint32_t verified) {
+    if (JournalResume(JOURNAL_ERASED) != SIM_WINDOW_ADDRESS + erased) {
+        return "wrong erase resume";
+    }
+    if (JournalResume(JOURNAL_PROGRAMMED) != SIM_WINDOW_ADDRESS + programmed) {
+        return "wrong program resume";
+    }
+    if (JournalResume(JOURNAL_VERIFIED) != SIM_WINDOW_ADDRESS + verified) {
+        return "wrong verify resume";
+    }
+    return NULL;
+}
+#endif
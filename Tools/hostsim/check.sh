@@ -0,0 +1,50 @@
+#!/bin/sh
+# Build the host simulator and run check on inputs made by the tools in
+# Tools/ from a generated image: random data, runs of a repeated phrase
+# and long erased (0xFF) and zero runs, not a multiple of any block size.
+#
+#   Tools/hostsim/check.sh [output directory] [extra gcc flags]
+
+set -e
+cd "$(dirname "$0")/../.."
+
+OUT=${1:-Tools/hostsim}
+[ $# -gt 0 ] && shift
+
+Tools/hostsim/build.sh "$OUT" "$@"
+
+python3 - "$OUT/check_image.bin" <<'PY'
+import random
+import sys
+
+rng = random.Random(1)
+image = bytearray()
+while len(image) < 0x30000:
+    kind = rng.randrange(4)
+    size = rng.randrange(0x100, 0x3000)
+    if kind == 0:
+        image += bytes(rng.randrange(256) for _ in range(size))
+    elif kind == 1:
+        image += (b"QUADSPI loader check %u " % rng.randrange(100)) * (size // 24)
+    else:
+        image += (b"\xff" if kind == 2 else b"\x00") * size
+image += b"\xa5" * 0x123
+with open(sys.argv[1], "wb") as f:
+    f.write(image)
+PY
+
+python3 Tools/lz4_frames.py "$OUT/check_image.bin" "$OUT/check_image.lz4f" > /dev/null
+"$OUT/check" lz4 "$OUT/check_image.bin" "$OUT/check_image.lz4f"
+"$OUT/check" fill
+
+python3 Tools/sparse_pack.py --base 0x90120123 --check \
+    "$OUT/check_image.bin" "$OUT/check_image.sprs" > /dev/null
+"$OUT/check" sparse "$OUT/check_image.bin" "$OUT/check_image.sprs" 0x120123
+"$OUT/check" batch
+"$OUT/check" write
+"$OUT/check" timeout
+"$OUT/check" verify
+
+mkdir -p "$OUT/journal"
+Tools/hostsim/build.sh "$OUT/journal" "$@" -DLOADER_JOURNAL=1
+"$OUT/journal/check" journal
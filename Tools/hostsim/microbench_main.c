@@ -0,0 +1,69 @@
+/*
+ * microbench_main.c
+ *
+ * Host runner of Core/Src/microbench.c: sweeps the kernels up to 64 MB
+ * and writes the CSV records to stdout or a file, for
+ * Tools/microbench_compare.py.
+ *
+ *   microbench [-o results.csv] [-m max_size]
+ */
+#include "microbench.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <getopt.h>
+
+#define MICROBENCH_HOST_CAPACITY    (0x4000000 + 64)
+
+static Microbench_ResultTypeDef results[MICROBENCH_MAX_RESULTS];
+
+int
+main(int argc, char** argv) {
+    uint32_t capacity = MICROBENCH_HOST_CAPACITY, count, i;
+    FILE* out = stdout;
+    uint8_t *a, *b;
+    char line[96];
+    int option;
+
+    while ((option = getopt(argc, argv, "o:m:")) != -1) {
+        switch (option) {
+            case 'o':
+                if ((out = fopen(optarg, "w")) == NULL) {
+                    perror(optarg);
+                    return 2;
+                }
+                break;
+            case 'm':
+                capacity = strtoul(optarg, NULL, 0) + 64;
+                if (capacity > MICROBENCH_HOST_CAPACITY) {
+                    capacity = MICROBENCH_HOST_CAPACITY;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-o results.csv] [-m max_size]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    /* The statistics hooks in CheckSum() read the DWT cycle counter; map
+     * the fixed regions before the buffers can take their place */
+    Sim_Init(&flash_timing_typical);
+
+    /* CheckSum() takes its address as uint32_t: keep the buffers below 2 GB */
+    a = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    b = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if ((a == MAP_FAILED) || (b == MAP_FAILED)) {
+        perror("mmap");
+        return 1;
+    }
+
+    count = Microbench_Run(a, b, capacity, results, MICROBENCH_MAX_RESULTS);
+
+    fputs(MICROBENCH_CSV_HEADER, out);
+    for (i = 0; i < count; i++) {
+        Microbench_Format(&results[i], line, sizeof(line));
+        fputs(line, out);
+    }
+    return (out != stdout) && fclose(out) ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * mt25ql512.c
+ *
+ */
+#include "mt25ql512.h"
+#include <string.h>
+
+/* MT25QL512ABB datasheet, tPP 0.12/1.8 ms for a full page, tSSE 50/400 ms,
+ * tSE 0.15/1 s, tBE 153/460 s. Partial pages scale linearly above a fixed
+ * setup time. */
+const Flash_TimingTypeDef flash_timing_typical = {
+    .page_program_base = 20000,
+    .page_program_per_byte = 390,
+    .subsector_erase = 50000000ULL,
+    .sector_erase = 150000000ULL,
+    .bulk_erase = 153000000000ULL,
+};
+
+const Flash_TimingTypeDef flash_timing_max = {
+    .page_program_base = 300000,
+    .page_program_per_byte = 5860,
+    .subsector_erase = 400000000ULL,
+    .sector_erase = 1000000000ULL,
+    .bulk_erase = 460000000000ULL,
+};
+
+#define SR_WIP          0x01
+#define SR_WEL          0x02
+#define FSR_READY       0x80
+#define FSR_ERASE_ERR   0x20
+#define FSR_PROGRAM_ERR 0x10
+#define FSR_4BYTE       0x01
+
+static int Flash_Covers(const Flash_ModelTypeDef* flash, uint32_t start, uint32_t size);
+static void Flash_Erase(Flash_ModelTypeDef* flash, uint32_t start, uint32_t size,
+                        uint64_t duration, uint64_t now);
+
+void
+Flash_Init(Flash_ModelTypeDef* flash, uint8_t* storage, const Flash_TimingTypeDef* timing) {
+    memset(flash, 0, sizeof(*flash));
+    flash->storage = storage;
+    flash->timing = timing;
+    flash->vcr = 0xFB;
+    flash->fail_address = 0xFFFFFFFF;
+    flash->fail_erase = 1;
+}
+
+/*Status register (0x05), flag status register (0x70) or volatile configuration (0x85)*/
+uint8_t
+Flash_ReadRegister(Flash_ModelTypeDef* flash, uint8_t instruction, uint64_t now) {
+    uint8_t busy = now < flash->busy_until;
+
+    switch (instruction) {
+        case 0x05:
+            return (busy ? SR_WIP : 0) | (flash->wel ? SR_WEL : 0);
+        case 0x70:
+            return (busy ? 0 : FSR_READY) | flash->fsr_errors
+                   | (flash->four_byte ? FSR_4BYTE : 0);
+        case 0x85:
+            return flash->vcr;
+        default:
+            return 0xFF;
+    }
+}
+
+/*Execute one command; data is read from or written to depending on the opcode*/
+void
+Flash_Execute(Flash_ModelTypeDef* flash, uint8_t instruction,
+              uint32_t address_bytes, uint32_t address,
+              uint8_t* data, uint32_t length, uint64_t now) {
+    uint32_t i, page, offset;
+
+    flash->stats.commands++;
+
+    /* Only status reads and reset are accepted while busy */
+    if ((now < flash->busy_until) && (instruction != 0x05) && (instruction != 0x70)
+        && (instruction != 0x66) && (instruction != 0x99)) {
+        flash->stats.violations++;
+        return;
+    }
+    if ((address_bytes != 0) && (address_bytes != (flash->four_byte ? 4u : 3u))) {
+        flash->stats.violations++;
+    }
+    if (address_bytes == 3) {
+        address &= 0xFFFFFF;
+    }
+    address &= FLASH_MODEL_SIZE - 1;
+
+    if (instruction != 0x99) {
+        flash->reset_enabled = 0;
+    }
+
+    switch (instruction) {
+        case 0x06:  /* WRITE ENABLE */
+            flash->wel = 1;
+            break;
+
+        case 0x04:  /* WRITE DISABLE */
+            flash->wel = 0;
+            break;
+
+        case 0x05:  /* READ STATUS REGISTER */
+        case 0x70:  /* READ FLAG STATUS REGISTER */
+        case 0x85:  /* READ VOLATILE CONFIGURATION REGISTER */
+            memset(data, Flash_ReadRegister(flash, instruction, now), length);
+            break;
+
+        case 0x50:  /* CLEAR FLAG STATUS REGISTER */
+            flash->fsr_errors = 0;
+            break;
+
+        case 0xB7:  /* ENTER 4-BYTE ADDRESS MODE */
+            flash->four_byte = 1;
+            break;
+
+        case 0xE9:  /* EXIT 4-BYTE ADDRESS MODE */
+            flash->four_byte = 0;
+            break;
+
+        case 0x81:  /* WRITE VOLATILE CONFIGURATION REGISTER */
+            if (!flash->wel) {
+                flash->stats.violations++;
+                break;
+            }
+            if (length != 0) {
+                flash->vcr = data[0];
+            }
+            flash->wel = 0;
+            break;
+
+        case 0x66:  /* RESET ENABLE */
+            flash->reset_enabled = 1;
+            break;
+
+        case 0x99:  /* RESET MEMORY */
+            if (flash->reset_enabled) {
+                flash->busy_until = now;
+                flash->wel = 0;
+                flash->four_byte = 0;
+                flash->vcr = 0xFB;
+                flash->fsr_errors = 0;
+            }
+            flash->reset_enabled = 0;
+            break;
+
+        case 0x03:  /* READ */
+        case 0x0B:  /* FAST READ */
+        case 0x6B:  /* QUAD OUTPUT FAST READ */
+        case 0xEB:  /* QUAD INPUT/OUTPUT FAST READ */
+        case 0x6D:  /* DTR QUAD OUTPUT FAST READ */
+        case 0xED:  /* DTR QUAD INPUT/OUTPUT FAST READ */
+            for (i = 0; i < length; i++) {
+                data[i] = flash->storage[(address + i) & (FLASH_MODEL_SIZE - 1)];
+            }
+            break;
+
+        case 0x02:  /* PAGE PROGRAM */
+        case 0x32:  /* QUAD INPUT FAST PROGRAM */
+        case 0x38:  /* QUAD INPUT EXTENDED FAST PROGRAM */
+            if (!flash->wel) {
+                flash->stats.violations++;
+                break;
+            }
+            flash->wel = 0;
+            flash->stats.programs++;
+            flash->stats.programmed_bytes += length;
+
+            /* Beyond 256 bytes only the last page worth is latched */
+            page = address & ~(FLASH_MODEL_PAGE - 1);
+            offset = address & (FLASH_MODEL_PAGE - 1);
+            if (length > FLASH_MODEL_PAGE) {
+                offset = (offset + length - FLASH_MODEL_PAGE) & (FLASH_MODEL_PAGE - 1);
+                data += length - FLASH_MODEL_PAGE;
+                length = FLASH_MODEL_PAGE;
+            }
+            flash->busy_until = now + flash->timing->page_program_base
+                                + flash->timing->page_program_per_byte * length;
+            flash->stats.busy_ns += flash->busy_until - now;
+
+            if (Flash_Covers(flash, page, FLASH_MODEL_PAGE)) {
+                flash->fsr_errors |= FSR_PROGRAM_ERR;
+                break;
+            }
+            /* Bits only go from 1 to 0, addresses wrap inside the page */
+            for (i = 0; i < length; i++) {
+                flash->storage[page + ((offset + i) & (FLASH_MODEL_PAGE - 1))] &= data[i];
+            }
+            break;
+
+        case 0x20:  /* 4 KB SUBSECTOR ERASE */
+            Flash_Erase(flash, address & ~(FLASH_MODEL_SUBSECTOR - 1), FLASH_MODEL_SUBSECTOR,
+                        flash->timing->subsector_erase, now);
+            break;
+
+        case 0xD8:  /* SECTOR ERASE */
+            Flash_Erase(flash, address & ~(FLASH_MODEL_SECTOR - 1), FLASH_MODEL_SECTOR,
+                        flash->timing->sector_erase, now);
+            break;
+
+        case 0xC7:  /* BULK ERASE */
+        case 0x60:
+            Flash_Erase(flash, 0, FLASH_MODEL_SIZE, flash->timing->bulk_erase, now);
+            break;
+
+        default:
+            flash->stats.violations++;
+            break;
+    }
+}
+
+static int
+Flash_Covers(const Flash_ModelTypeDef* flash, uint32_t start, uint32_t size) {
+    return (flash->fail_address >= start) && (flash->fail_address - start < size);
+}
+
+static void
+Flash_Erase(Flash_ModelTypeDef* flash, uint32_t start, uint32_t size,
+            uint64_t duration, uint64_t now) {
+    if (!flash->wel) {
+        flash->stats.violations++;
+        return;
+    }
+    flash->wel = 0;
+    flash->stats.erases++;
+    flash->busy_until = now + duration;
+    flash->stats.busy_ns += duration;
+
+    if (flash->fail_erase && Flash_Covers(flash, start, size)) {
+        flash->fsr_errors |= FSR_ERASE_ERR;
+        return;
+    }
+    memset(flash->storage + start, 0xFF, size);
+}
@@ -0,0 +1,62 @@
+/*
+ * mt25ql512.h
+ *
+ * Behavioral model of the MT25QL512 as seen from the QUADSPI bus: status
+ * and flag status registers, write enable latch, 3/4-byte addressing,
+ * page wrap on program, sector/subsector/bulk erase granularity and the
+ * datasheet program/erase times on a virtual clock. Commands arriving
+ * while the device is busy, without WEL, or with the wrong address width
+ * are counted as protocol violations, since the real part ignores them.
+ */
+#ifndef MT25QL512_H_
+#define MT25QL512_H_
+
+#include <stdint.h>
+
+#define FLASH_MODEL_SIZE        0x4000000
+#define FLASH_MODEL_PAGE        0x100
+#define FLASH_MODEL_SUBSECTOR   0x1000
+#define FLASH_MODEL_SECTOR      0x10000
+
+/*Datasheet timings, in nanoseconds*/
+typedef struct {
+    uint64_t page_program_base;     /* program time = base + per_byte * n */
+    uint64_t page_program_per_byte;
+    uint64_t subsector_erase;       /* 4 KB */
+    uint64_t sector_erase;          /* 64 KB */
+    uint64_t bulk_erase;            /* whole device */
+} Flash_TimingTypeDef;
+
+extern const Flash_TimingTypeDef flash_timing_typical;
+extern const Flash_TimingTypeDef flash_timing_max;
+
+typedef struct {
+    uint32_t commands;              /* commands executed */
+    uint32_t programs;              /* page programs */
+    uint32_t erases;                /* sector, subsector and bulk erases */
+    uint32_t violations;            /* commands the part would ignore */
+    uint64_t busy_ns;               /* total program/erase time */
+    uint64_t programmed_bytes;
+} Flash_StatsTypeDef;
+
+typedef struct {
+    uint8_t* storage;               /* FLASH_MODEL_SIZE bytes */
+    const Flash_TimingTypeDef* timing;
+    uint64_t busy_until;            /* virtual time the current operation ends */
+    uint8_t wel;
+    uint8_t four_byte;
+    uint8_t reset_enabled;
+    uint8_t vcr;                    /* volatile configuration register */
+    uint8_t fsr_errors;             /* sticky error bits of the flag status register */
+    uint32_t fail_address;          /* program/erase covering it fails, 0xFFFFFFFF for none */
+    uint8_t fail_erase;             /* 0: only programs of fail_address fail */
+    Flash_StatsTypeDef stats;
+} Flash_ModelTypeDef;
+
+void Flash_Init(Flash_ModelTypeDef* flash, uint8_t* storage, const Flash_TimingTypeDef* timing);
+uint8_t Flash_ReadRegister(Flash_ModelTypeDef* flash, uint8_t instruction, uint64_t now);
+void Flash_Execute(Flash_ModelTypeDef* flash, uint8_t instruction,
+                   uint32_t address_bytes, uint32_t address,
+                   uint8_t* data, uint32_t length, uint64_t now);
+
+#endif /* MT25QL512_H_ */
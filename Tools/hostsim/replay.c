@@ -0,0 +1,321 @@
+/*
+ * replay.c
+ *
+ * Replays a programmer session, one loader call per line, against the
+ * simulator and splits the session time into what the flash spends busy,
+ * what the QUADSPI bus spends moving data, the loader's own CPU time and
+ * the debugger link: one or more round trips per call plus the RAM
+ * buffer transfers at the link's bandwidth.
+ *
+ *   replay [-i image.bin] [-o origin] [-r rtt_us] [-n trips] [-w bytes_per_s]
+ *          [-k cpu_scale] [-t typ|max] session.txt
+ *
+ * Session lines (numbers in C notation, '#' starts a comment):
+ *
+ *   load <bytes>               download of the loader itself
+ *   init
+ *   sector_erase <start> <end>
+ *   mass_erase
+ *   write <address> <size>
+ *   verify <address> <size> [missalignement]
+ *   checksum <address> <size> [initval]
+ *
+ * Data for write and verify comes from the image placed at origin, or a
+ * fixed pattern without one. CPU time is measured on the host around
+ * each call and multiplied by cpu_scale; calibrate it with the DWT
+ * numbers of the statistics table from a real session.
+ */
+#include "Loader_Src.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#define REPLAY_LINE_MAX     256
+
+typedef enum {
+    CALL_LOAD = 0,
+    CALL_INIT,
+    CALL_SECTOR_ERASE,
+    CALL_MASS_ERASE,
+    CALL_WRITE,
+    CALL_VERIFY,
+    CALL_CHECKSUM,
+    CALL_COUNT,
+} CallKind;
+
+static const char* const call_names[CALL_COUNT] = {
+    "load", "init", "sector_erase", "mass_erase", "write", "verify", "checksum",
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t failures;
+    uint64_t bytes;
+    uint64_t device_ns;         /* virtual time inside the call */
+    uint64_t busy_ns;           /* of which waiting for the flash */
+    uint64_t bus_ns;            /* of which QUADSPI transfers */
+    uint64_t cpu_ns;            /* loader CPU, host time times cpu_scale */
+    uint64_t link_ns;           /* debugger round trips and transfers */
+} CallTotals;
+
+typedef struct {
+    uint8_t* image;
+    uint32_t image_size;
+    uint32_t origin;
+    double rtt_ns;
+    uint32_t trips;
+    double link_bytes_per_s;
+    double cpu_scale;
+} ReplayConfig;
+
+static CallTotals totals[CALL_COUNT];
+
+static uint8_t Replay_Call(const ReplayConfig* cfg, CallKind kind, uint32_t* arg, uint32_t args);
+static void Replay_Fill(const ReplayConfig* cfg, uint8_t* buffer, uint32_t address, uint32_t size);
+static uint64_t Replay_CpuNs(void);
+static void Replay_Report(void);
+static uint8_t* Replay_ReadFile(const char* path, uint32_t* size);
+
+int
+main(int argc, char** argv) {
+    const Flash_TimingTypeDef* timing = &flash_timing_typical;
+    ReplayConfig cfg = {
+        .origin = SIM_WINDOW_ADDRESS,
+        .rtt_ns = 1000000.0,            /* USB full speed frame of an ST-LINK/V2 */
+        .trips = 3,                     /* registers and run, halt poll, result read */
+        .link_bytes_per_s = 400000.0,   /* SWD at 4 MHz including protocol overhead */
+        .cpu_scale = 1.0,
+    };
+    char line[REPLAY_LINE_MAX], name[32];
+    uint32_t arg[3], number = 0;
+    int option, args, kind, failures = 0;
+    FILE* session;
+
+    while ((option = getopt(argc, argv, "i:o:r:n:w:k:t:")) != -1) {
+        switch (option) {
+            case 'i':
+                cfg.image = Replay_ReadFile(optarg, &cfg.image_size);
+                break;
+            case 'o':
+                cfg.origin = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                cfg.rtt_ns = strtod(optarg, NULL) * 1e3;
+                break;
+            case 'n':
+                cfg.trips = strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                cfg.link_bytes_per_s = strtod(optarg, NULL);
+                break;
+            case 'k':
+                cfg.cpu_scale = strtod(optarg, NULL);
+                break;
+            case 't':
+                timing = strcmp(optarg, "max") ? &flash_timing_typical : &flash_timing_max;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if ((optind != argc - 1) || (cfg.link_bytes_per_s <= 0)) {
+        fprintf(stderr, "usage: %s [-i image.bin] [-o origin] [-r rtt_us] [-n trips] "
+                "[-w bytes_per_s] [-k cpu_scale] [-t typ|max] session.txt\n", argv[0]);
+        return 2;
+    }
+    if ((session = fopen(argv[optind], "r")) == NULL) {
+        perror(argv[optind]);
+        return 2;
+    }
+
+    Sim_Init(timing);
+
+    while (fgets(line, sizeof(line), session) != NULL) {
+        number++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        args = sscanf(line, "%31s %i %i %i", name, (int*) &arg[0], (int*) &arg[1], (int*) &arg[2]);
+        if (args <= 0) {
+            continue;
+        }
+        for (kind = 0; (kind < CALL_COUNT) && strcmp(name, call_names[kind]); kind++) {
+        }
+        if (kind == CALL_COUNT) {
+            fprintf(stderr, "%s:%u: unknown call '%s'\n", argv[optind], number, name);
+            return 2;
+        }
+        if (!Replay_Call(&cfg, (CallKind) kind, arg, args - 1)) {
+            fprintf(stderr, "%s:%u: %s failed\n", argv[optind], number, name);
+            failures++;
+        }
+    }
+    fclose(session);
+
+    Replay_Report();
+    printf("\nQUADSPI clock %.2f MHz, %s timings, link %.0f us x %u per call at %.0f KB/s, "
+           "CPU x%.2f, %u protocol violations\n",
+           Sim_QspiHz() / 1e6, timing == &flash_timing_max ? "max" : "typical",
+           cfg.rtt_ns / 1e3, cfg.trips, cfg.link_bytes_per_s / 1e3, cfg.cpu_scale,
+           Sim_FlashStats().violations);
+    return (failures || Sim_FlashStats().violations) ? 1 : 0;
+}
+
+/*Run one call and charge its time; returns 0 if the loader reports failure*/
+static uint8_t
+Replay_Call(const ReplayConfig* cfg, CallKind kind, uint32_t* arg, uint32_t args) {
+    CallTotals* total = &totals[kind];
+    uint8_t* buffer = (uint8_t*) (uintptr_t) SIM_RAM_ADDRESS;
+    uint64_t start = Sim_Now(), cpu, result;
+    uint64_t busy = sim_stats.poll_ns, bus = sim_stats.bus_ns + sim_stats.mapped_ns;
+    uint32_t transfer = 0, required[CALL_COUNT] = { 1, 0, 2, 0, 2, 2, 2 };
+    uint8_t ok = 1;
+
+    if (args < required[kind]) {
+        return 0;
+    }
+    if (((kind == CALL_WRITE) || (kind == CALL_VERIFY)) && (arg[1] > SIM_RAM_SIZE - 4)) {
+        fprintf(stderr, "replay: %s of 0x%X bytes exceeds the RAM buffer\n",
+                call_names[kind], arg[1]);
+        return 0;
+    }
+
+    /* The tool downloads the buffer before it starts the call */
+    if ((kind == CALL_WRITE) || (kind == CALL_VERIFY)) {
+        Replay_Fill(cfg, buffer, arg[0], arg[1]);
+        transfer = arg[1];
+    }
+
+    cpu = Replay_CpuNs();
+    switch (kind) {
+        case CALL_LOAD:
+            transfer = arg[0];
+            break;
+        case CALL_INIT:
+            ok = Init() == LOADER_OK;
+            break;
+        case CALL_SECTOR_ERASE:
+            ok = SectorErase(arg[0], arg[1]) == LOADER_OK;
+            break;
+        case CALL_MASS_ERASE:
+            ok = MassErase() == LOADER_OK;
+            break;
+        case CALL_WRITE:
+            ok = Write(arg[0], arg[1], buffer) == LOADER_OK;
+            break;
+        case CALL_VERIFY:
+            /* Size in words; the RAM buffer past the data reads as erased */
+            memset(buffer + arg[1], 0xFF, 3);
+            result = Verify(arg[0], SIM_RAM_ADDRESS, (arg[1] + 3) / 4, (args > 2) ? arg[2] : 0);
+            ok = (uint32_t) result == 0;
+            break;
+        case CALL_CHECKSUM:
+            (void) CheckSum(arg[0], arg[1], (args > 2) ? arg[2] : 0);
+            break;
+        default:
+            break;
+    }
+    cpu = Replay_CpuNs() - cpu;
+
+    total->count++;
+    total->failures += !ok;
+    total->bytes += (kind >= CALL_WRITE) ? arg[1] : 0;
+    total->device_ns += Sim_Now() - start;
+    total->busy_ns += sim_stats.poll_ns - busy;
+    total->bus_ns += sim_stats.bus_ns + sim_stats.mapped_ns - bus;
+    total->cpu_ns += (uint64_t) (cpu * cfg->cpu_scale);
+    total->link_ns += (uint64_t) (cfg->trips * cfg->rtt_ns
+                                  + transfer * 1e9 / cfg->link_bytes_per_s);
+    return ok;
+}
+
+static void
+Replay_Fill(const ReplayConfig* cfg, uint8_t* buffer, uint32_t address, uint32_t size) {
+    uint32_t i, offset, x;
+
+    for (i = 0; i < size; i++) {
+        offset = address + i - cfg->origin;
+        if (cfg->image != NULL) {
+            buffer[i] = (offset < cfg->image_size) ? cfg->image[offset] : 0xFF;
+        } else {
+            x = offset * 2654435761u;
+            buffer[i] = (x ^ (x >> 13)) >> 7;
+        }
+    }
+}
+
+static uint64_t
+Replay_CpuNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+Replay_Report(void) {
+    CallTotals sum = { 0 };
+    uint64_t session;
+    int kind;
+
+    printf("%-13s %6s %10s %11s %11s %10s %10s %10s %11s %5s\n", "call", "count", "bytes",
+           "device_ms", "busy_ms", "bus_ms", "other_ms", "cpu_ms", "link_ms", "fail");
+    for (kind = 0; kind <= CALL_COUNT; kind++) {
+        const CallTotals* total = (kind < CALL_COUNT) ? &totals[kind] : &sum;
+
+        if (kind == CALL_COUNT) {
+            printf("\n");
+        } else if (total->count == 0) {
+            continue;
+        }
+        printf("%-13s %6u %10llu %11.3f %11.3f %10.3f %10.3f %10.3f %11.3f %5u\n",
+               (kind < CALL_COUNT) ? call_names[kind] : "total", total->count,
+               (unsigned long long) total->bytes, total->device_ns / 1e6, total->busy_ns / 1e6,
+               total->bus_ns / 1e6, (total->device_ns - total->busy_ns - total->bus_ns) / 1e6,
+               total->cpu_ns / 1e6, total->link_ns / 1e6, total->failures);
+
+        if (kind < CALL_COUNT) {
+            sum.count += total->count;
+            sum.failures += total->failures;
+            sum.bytes += total->bytes;
+            sum.device_ns += total->device_ns;
+            sum.busy_ns += total->busy_ns;
+            sum.bus_ns += total->bus_ns;
+            sum.cpu_ns += total->cpu_ns;
+            sum.link_ns += total->link_ns;
+        }
+    }
+
+    session = sum.device_ns + sum.cpu_ns + sum.link_ns;
+    if (session == 0) {
+        return;
+    }
+    printf("\nsession %.3f s: flash busy %.1f%%, QSPI bus %.1f%%, other device %.1f%%, "
+           "loader CPU %.1f%%, debugger link %.1f%%\n", session / 1e9,
+           100.0 * sum.busy_ns / session, 100.0 * sum.bus_ns / session,
+           100.0 * (sum.device_ns - sum.busy_ns - sum.bus_ns) / session,
+           100.0 * sum.cpu_ns / session, 100.0 * sum.link_ns / session);
+}
+
+static uint8_t*
+Replay_ReadFile(const char* path, uint32_t* size) {
+    FILE* file = fopen(path, "rb");
+    uint8_t* data;
+    long length;
+
+    if ((file == NULL) || fseek(file, 0, SEEK_END) || ((length = ftell(file)) < 0)) {
+        perror(path);
+        exit(2);
+    }
+    rewind(file);
+    data = malloc(length ? length : 1);
+    if ((data == NULL) || (fread(data, 1, length, file) != (size_t) length)) {
+        perror(path);
+        exit(2);
+    }
+    fclose(file);
+    *size = (uint32_t) length;
+    return data;
+}
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Write a programmer session for Tools/hostsim/replay from an image.
+
+The session follows the call sequence of an STM32CubeProgrammer download:
+loader download, Init, erase of the covered sectors, the image in RAM
+buffer sized Write calls, then Verify over the same chunks. Match the
+buffer size and the Init-per-call behaviour to a verbose (-vb 3) log of
+the session being modelled.
+
+    session_gen.py --base 0x90000000 firmware.bin firmware.session
+    session_gen.py --size 0x200000 synthetic.session
+    replay -i firmware.bin firmware.session
+"""
+
+import argparse
+import os
+import sys
+
+FLASH_BASE = 0x90000000
+FLASH_SIZE = 0x4000000
+SECTOR_SIZE = 0x10000
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("image", nargs="?", help="raw binary; omit with --size")
+    parser.add_argument("session", help="session file to write")
+    parser.add_argument("--base", type=lambda v: int(v, 0), default=FLASH_BASE,
+                        help="flash address of the image (default 0x%08X)" % FLASH_BASE)
+    parser.add_argument("--size", type=lambda v: int(v, 0),
+                        help="image size, for a session without an image file")
+    parser.add_argument("--chunk", type=lambda v: int(v, 0), default=0x8000,
+                        help="RAM buffer per Write/Verify call (default 0x8000)")
+    parser.add_argument("--loader-size", type=lambda v: int(v, 0), default=0xC000,
+                        help="bytes downloaded for the loader itself (default 0xC000)")
+    parser.add_argument("--init-per-call", action="store_true",
+                        help="call Init before every Write and Verify")
+    parser.add_argument("--erase-per-sector", action="store_true",
+                        help="one SectorErase call per 64 KB sector")
+    parser.add_argument("--mass-erase", action="store_true", help="MassErase instead")
+    parser.add_argument("--checksum", action="store_true",
+                        help="add a CheckSum call per chunk after Verify")
+    parser.add_argument("--no-verify", action="store_true", help="skip the Verify pass")
+    args = parser.parse_args()
+
+    if args.image is not None and args.size is None:
+        size = os.path.getsize(args.image)
+    elif args.image is None and args.size is not None:
+        size = args.size
+    else:
+        parser.error("give either an image or --size")
+    if size == 0 or args.base < FLASH_BASE or args.base + size > FLASH_BASE + FLASH_SIZE:
+        sys.exit("image does not fit the flash")
+    if args.chunk <= 0 or args.chunk % 4:
+        sys.exit("chunk must be a positive multiple of 4")
+
+    end = args.base + size
+    lines = ["# %d bytes at 0x%08X, %d byte buffers" % (size, args.base, args.chunk),
+             "load 0x%X" % args.loader_size,
+             "init"]
+
+    if args.mass_erase:
+        lines.append("mass_erase")
+    elif args.erase_per_sector:
+        sector = args.base - args.base % SECTOR_SIZE
+        while sector < end:
+            lines.append("sector_erase 0x%08X 0x%08X" % (sector, sector + SECTOR_SIZE - 1))
+            sector += SECTOR_SIZE
+    else:
+        lines.append("sector_erase 0x%08X 0x%08X" % (args.base, end - 1))
+
+    chunks = [(address, min(args.chunk, end - address))
+              for address in range(args.base, end, args.chunk)]
+    for address, length in chunks:
+        if args.init_per_call:
+            lines.append("init")
+        lines.append("write 0x%08X 0x%X" % (address, length))
+    if not args.no_verify:
+        for address, length in chunks:
+            if args.init_per_call:
+                lines.append("init")
+            lines.append("verify 0x%08X 0x%X" % (address, length))
+            if args.checksum:
+                lines.append("checksum 0x%08X 0x%X" % (address, length))
+
+    with open(args.session, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+/*
+ * sim.h
+ *
+ * Host simulation of the loader's environment: the HAL QSPI/MDMA calls
+ * the loader makes, the MT25QL512 behind them (two with QSPI_CONCAT, one
+ * per bank), the memory-mapped window at 0x90000000 and a virtual clock
+ * that DWT->CYCCNT and HAL_GetTick() follow. Bus time comes from the command phases, line counts and the
+ * QUADSPI clock the firmware configures; flash busy time comes from the
+ * datasheet timings in mt25ql512.c. sim_uart.c adds USART1 and its receive
+ * DMA on a host descriptor.
+ */
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include "mt25ql512.h"
+
+#define SIM_CPU_HZ          480000000u  /* SYSCLK set by SystemClock_Config() */
+#define SIM_WINDOW_ADDRESS  0x90000000u
+#define SIM_RAM_ADDRESS     0x24000000u /* AXI SRAM, also the debugger buffers */
+#define SIM_RAM_SIZE        0x80000u
+#define SIM_MAPPED_BURST    0x1000u     /* bytes fetched per first touch of the window */
+
+#ifndef QSPI_CONCAT
+#define QSPI_CONCAT         0
+#endif
+#define SIM_CHIPS           (QSPI_CONCAT ? 2 : 1)   /* one model per bank the loader drives */
+#define SIM_FLASH_SIZE      (FLASH_MODEL_SIZE * SIM_CHIPS)
+
+typedef struct {
+    uint64_t bus_ns;            /* QUADSPI bus busy with a command */
+    uint64_t poll_ns;           /* waiting in auto-polling for the flash */
+    uint64_t mapped_ns;         /* memory-mapped fetches */
+    uint64_t mapped_bytes;
+    uint32_t commands;          /* commands issued on the bus */
+    uint32_t interrupts;        /* completion callbacks delivered */
+    uint32_t timeouts;          /* blocking polls that gave up */
+} Sim_StatsTypeDef;
+
+typedef struct {
+    uint64_t rx_bytes;          /* delivered to the receiver */
+    uint64_t tx_bytes;
+    uint64_t dropped;           /* arrived with no reception running */
+    uint32_t starved_ms;        /* CPU idle with nothing on the line */
+} Sim_UartStatsTypeDef;
+
+extern Flash_ModelTypeDef sim_flash[SIM_CHIPS];
+extern Sim_StatsTypeDef sim_stats;
+extern Sim_UartStatsTypeDef sim_uart_stats;
+
+/*Map the fixed regions and reset the virtual clock and the flash model*/
+void Sim_Init(const Flash_TimingTypeDef* timing);
+
+uint64_t Sim_Now(void);
+void Sim_Advance(uint64_t ns);
+uint32_t Sim_QspiHz(void);
+
+/*Flash contents as seen by the model, bypassing the window, chip after chip*/
+uint8_t* Sim_FlashStorage(void);
+
+/*Statistics of all chips together*/
+Flash_StatsTypeDef Sim_FlashStats(void);
+
+void Sim_ResetStats(void);
+
+/*Called at the end of every HAL_GetTick(), idle when the CPU spun a whole
+ *millisecond with nothing scheduled: how sim_uart.c feeds the receiver*/
+void Sim_SetTickHook(void (*hook)(uint8_t idle));
+
+/*Connect the UART to a non-blocking descriptor, receiving at baud*/
+void Sim_UartAttach(int fd, uint32_t baud);
+
+#endif /* SIM_H_ */
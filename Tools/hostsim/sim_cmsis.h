@@ -0,0 +1,44 @@
+/*
+ * sim_cmsis.h
+ *
+ * Host replacement for cmsis_gcc.h, force-included by build.sh. It
+ * claims the cmsis_gcc.h include guard so that core_cm7.h and the HAL
+ * headers compile for the host; the few intrinsics the loader uses are
+ * routed to the simulator, which owns PRIMASK and the interrupt source.
+ */
+#ifndef SIM_CMSIS_H_
+#define SIM_CMSIS_H_
+
+#define __CMSIS_GCC_H
+
+#include <stdint.h>
+
+#define __ASM                   __asm
+#define __INLINE                inline
+#define __STATIC_INLINE         static inline
+#define __STATIC_FORCEINLINE    static inline
+#define __NO_RETURN             __attribute__((__noreturn__))
+#define __USED                  __attribute__((used))
+#define __WEAK                  __attribute__((weak))
+#define __PACKED                __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT         struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION          union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)            __attribute__((aligned(x)))
+#define __RESTRICT              __restrict
+#define __COMPILER_BARRIER()    __asm volatile("" ::: "memory")
+
+#define __NOP()                 __COMPILER_BARRIER()
+#define __DSB()                 __COMPILER_BARRIER()
+#define __ISB()                 __COMPILER_BARRIER()
+#define __DMB()                 __COMPILER_BARRIER()
+#define __CLZ(value)            ((uint8_t) ((value) ? __builtin_clz(value) : 32))
+
+uint32_t Sim_GetPrimask(void);
+void Sim_SetPrimask(uint32_t primask);
+
+#define __get_PRIMASK()         Sim_GetPrimask()
+#define __set_PRIMASK(primask)  Sim_SetPrimask(primask)
+#define __disable_irq()         Sim_SetPrimask(1)
+#define __enable_irq()          Sim_SetPrimask(0)
+
+#endif /* SIM_CMSIS_H_ */
@@ -0,0 +1,664 @@
+/*
+ * sim_hal.c
+ *
+ * The HAL entry points the loader links against, implemented on top of
+ * the MT25QL512 model and a virtual clock. Blocking calls advance the
+ * clock by their bus (and polling) time; the _IT variants schedule their
+ * completion, which is delivered as the matching HAL callback once the
+ * CPU spins in HAL_GetTick() with PRIMASK clear, like the real interrupt.
+ * The flash storage is a memfd mapped twice: read/write for the model and
+ * at 0x90000000 for the loader, where it stays inaccessible outside
+ * memory-mapped mode and every first touch of a 4 KB block is charged as
+ * a quad read burst. With two chips, the FSEL bit picks the model that
+ * commands go to and the half of the memfd the window shows.
+ */
+#include "stm32h7xx_hal.h"
+#include "sim.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define SIM_CORE_ADDRESS        0xE0000000u
+#define SIM_CORE_SIZE           0x100000u
+#define SIM_PERIPH_ADDRESS      0x40000000u
+#define SIM_PERIPH_SIZE         0x20000000u
+#define SIM_CS_HIGH_CYCLES      2           /* ChipSelectHighTime after each command */
+#define SIM_NS_PER_MS           1000000ull
+
+typedef enum {
+    SIM_EVENT_NONE = 0,
+    SIM_EVENT_CMD,
+    SIM_EVENT_TX,
+    SIM_EVENT_MATCH,
+} Sim_EventTypeDef;
+
+Flash_ModelTypeDef sim_flash[SIM_CHIPS];
+Sim_StatsTypeDef sim_stats;
+uint32_t SystemCoreClock = 64000000;
+
+static uint64_t now;                        /* virtual time, ns */
+static uint32_t primask;
+static uint8_t in_handler;
+static uint32_t activity, tick_activity;    /* tells a spinning HAL_GetTick() apart */
+static void (*tick_hook)(uint8_t idle);
+
+static QSPI_HandleTypeDef* qspi_handle;
+static uint32_t qspi_kernel_hz = 240000000; /* rcc_hclk3 unless PLL2 is selected */
+static uint32_t qspi_hz;
+static QSPI_CommandTypeDef pending;         /* command waiting for its data phase */
+static uint8_t pending_data;
+static QSPI_CommandTypeDef mapped_command;
+static uint8_t mapped;
+
+static Sim_EventTypeDef event;
+static uint64_t event_time;
+
+static uint8_t* storage;
+static int storage_fd;
+static uint32_t chip;                       /* chip selected by FSEL */
+
+static void Sim_Sync(void);
+static void Sim_Deliver(void);
+static void Sim_Schedule(Sim_EventTypeDef kind, uint64_t time);
+static uint64_t Sim_CommandNs(const QSPI_CommandTypeDef* cmd, uint32_t length);
+static uint64_t Sim_Execute(const QSPI_CommandTypeDef* cmd, uint8_t* data, uint32_t length);
+static uint8_t Sim_PollMatch(const QSPI_CommandTypeDef* cmd, const QSPI_AutoPollingTypeDef* cfg,
+                             uint64_t* match);
+static void Sim_Fault(int sig, siginfo_t* info, void* context);
+static void* Sim_Map(uintptr_t address, size_t size, int prot, int flags, int fd);
+static void Sim_SelectChip(uint32_t FlashID);
+
+void
+Sim_Init(const Flash_TimingTypeDef* timing) {
+    struct sigaction action;
+    uint32_t i;
+    int fd;
+
+    Sim_Map(SIM_PERIPH_ADDRESS, SIM_PERIPH_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1);
+    Sim_Map(SIM_CORE_ADDRESS, SIM_CORE_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1);
+    Sim_Map(SIM_RAM_ADDRESS, SIM_RAM_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1);
+
+    fd = memfd_create("mt25ql512", 0);
+    if ((fd < 0) || (ftruncate(fd, SIM_FLASH_SIZE) != 0)) {
+        perror("memfd");
+        exit(1);
+    }
+    storage = Sim_Map(0, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd);
+    Sim_Map(SIM_WINDOW_ADDRESS, FLASH_MODEL_SIZE, PROT_NONE, MAP_SHARED, fd);
+    storage_fd = fd;
+    chip = 0;
+    memset(storage, 0xFF, SIM_FLASH_SIZE);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = Sim_Fault;
+    action.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &action, NULL);
+
+    for (i = 0; i < SIM_CHIPS; i++) {
+        Flash_Init(&sim_flash[i], storage + i * FLASH_MODEL_SIZE, timing);
+    }
+    now = 0;
+    event = SIM_EVENT_NONE;
+    Sim_ResetStats();
+    Sim_Sync();
+}
+
+uint64_t
+Sim_Now(void) {
+    return now;
+}
+
+/*Let time pass, delivering the completions that fall into it*/
+void
+Sim_Advance(uint64_t ns) {
+    uint64_t target = now + ns;
+
+    while ((event != SIM_EVENT_NONE) && (event_time <= target) && !primask && !in_handler) {
+        if (event_time > now) {
+            now = event_time;
+        }
+        Sim_Deliver();
+    }
+    now = target;
+    Sim_Sync();
+}
+
+uint32_t
+Sim_QspiHz(void) {
+    return qspi_hz;
+}
+
+uint8_t*
+Sim_FlashStorage(void) {
+    return storage;
+}
+
+Flash_StatsTypeDef
+Sim_FlashStats(void) {
+    Flash_StatsTypeDef total = sim_flash[0].stats;
+    uint32_t i;
+
+    for (i = 1; i < SIM_CHIPS; i++) {
+        total.commands += sim_flash[i].stats.commands;
+        total.programs += sim_flash[i].stats.programs;
+        total.erases += sim_flash[i].stats.erases;
+        total.violations += sim_flash[i].stats.violations;
+        total.busy_ns += sim_flash[i].stats.busy_ns;
+        total.programmed_bytes += sim_flash[i].stats.programmed_bytes;
+    }
+    return total;
+}
+
+void
+Sim_ResetStats(void) {
+    uint32_t i;
+
+    memset(&sim_stats, 0, sizeof(sim_stats));
+    for (i = 0; i < SIM_CHIPS; i++) {
+        memset(&sim_flash[i].stats, 0, sizeof(sim_flash[i].stats));
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Core, clocks and interrupts                                             */
+/* ---------------------------------------------------------------------- */
+
+uint32_t
+Sim_GetPrimask(void) {
+    return primask;
+}
+
+void
+Sim_SetPrimask(uint32_t value) {
+    primask = value & 1;
+    Sim_Deliver();
+}
+
+static void
+Sim_Sync(void) {
+    DWT->CYCCNT = (uint32_t) (now * (SIM_CPU_HZ / 1000000) / 1000);
+}
+
+static void
+Sim_Deliver(void) {
+    Sim_EventTypeDef kind;
+
+    while ((event != SIM_EVENT_NONE) && (event_time <= now) && !primask && !in_handler) {
+        kind = event;
+        event = SIM_EVENT_NONE;
+        qspi_handle->State = HAL_QSPI_STATE_READY;
+        sim_stats.interrupts++;
+        activity++;
+        Sim_Sync();
+
+        in_handler = 1;
+        if (kind == SIM_EVENT_CMD) {
+            HAL_QSPI_CmdCpltCallback(qspi_handle);
+        } else if (kind == SIM_EVENT_TX) {
+            HAL_QSPI_TxCpltCallback(qspi_handle);
+        } else {
+            HAL_QSPI_StatusMatchCallback(qspi_handle);
+        }
+        in_handler = 0;
+    }
+}
+
+static void
+Sim_Schedule(Sim_EventTypeDef kind, uint64_t time) {
+    event = kind;
+    event_time = time;
+}
+
+HAL_StatusTypeDef
+HAL_Init(void) {
+    return HAL_OK;
+}
+
+void
+Sim_SetTickHook(void (*hook)(uint8_t idle)) {
+    tick_hook = hook;
+}
+
+/*A CPU spinning on the tick waits for the next interrupt, or a millisecond*/
+uint32_t
+HAL_GetTick(void) {
+    uint8_t idle = 0;
+
+    Sim_Deliver();
+    if (activity == tick_activity) {
+        if ((event != SIM_EVENT_NONE) && !primask && !in_handler) {
+            Sim_Advance(event_time > now ? event_time - now : 0);
+        } else {
+            Sim_Advance(SIM_NS_PER_MS);
+            idle = 1;
+        }
+    }
+    tick_activity = activity;
+    if (tick_hook != NULL) {
+        tick_hook(idle);
+    }
+    return (uint32_t) (now / SIM_NS_PER_MS);
+}
+
+void
+HAL_Delay(uint32_t Delay) {
+    Sim_Advance(Delay * SIM_NS_PER_MS);
+}
+
+void
+SystemInit(void) {
+}
+
+void
+SystemClock_Config(void) {
+    SystemCoreClock = SIM_CPU_HZ;
+}
+
+void
+MPU_Config(void) {
+}
+
+void
+Error_Handler(void) {
+    fprintf(stderr, "sim: Error_Handler() at %.3f ms\n", now / 1e6);
+    exit(1);
+}
+
+void
+HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+    (void) IRQn;
+    (void) PreemptPriority;
+    (void) SubPriority;
+}
+
+void
+HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+    (void) IRQn;
+}
+
+void
+HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+    (void) IRQn;
+}
+
+void
+HAL_GPIO_Init(GPIO_TypeDef* GPIOx, const GPIO_InitTypeDef* GPIO_Init) {
+    (void) GPIOx;
+    (void) GPIO_Init;
+}
+
+void
+HAL_GPIO_DeInit(GPIO_TypeDef* GPIOx, uint32_t GPIO_Pin) {
+    (void) GPIOx;
+    (void) GPIO_Pin;
+}
+
+/*Only the QUADSPI kernel clock matters here: PLL2R from HSE, or HCLK*/
+HAL_StatusTypeDef
+HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef* PeriphClkInit) {
+    if (PeriphClkInit->PeriphClockSelection & RCC_PERIPHCLK_QSPI) {
+        if (PeriphClkInit->QspiClockSelection == RCC_QSPICLKSOURCE_PLL2) {
+            qspi_kernel_hz = (uint32_t) ((uint64_t) HSE_VALUE / PeriphClkInit->PLL2.PLL2M
+                                         * PeriphClkInit->PLL2.PLL2N / PeriphClkInit->PLL2.PLL2R);
+        } else {
+            qspi_kernel_hz = SIM_CPU_HZ / 2;
+        }
+    }
+    return HAL_OK;
+}
+
+/* ---------------------------------------------------------------------- */
+/* MDMA                                                                    */
+/* ---------------------------------------------------------------------- */
+
+HAL_StatusTypeDef
+HAL_MDMA_Init(MDMA_HandleTypeDef* hmdma) {
+    (void) hmdma;
+    return HAL_OK;
+}
+
+/*Copies at once; reads of the window are charged by the fault handler*/
+HAL_StatusTypeDef
+HAL_MDMA_Start(MDMA_HandleTypeDef* hmdma, uint32_t SrcAddress, uint32_t DstAddress,
+               uint32_t BlockDataLength, uint32_t BlockCount) {
+    (void) hmdma;
+    memcpy((void*) (uintptr_t) DstAddress, (const void*) (uintptr_t) SrcAddress,
+           (size_t) BlockDataLength * BlockCount);
+    activity++;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_MDMA_PollForTransfer(MDMA_HandleTypeDef* hmdma, HAL_MDMA_LevelCompleteTypeDef CompleteLevel,
+                         uint32_t Timeout) {
+    (void) hmdma;
+    (void) CompleteLevel;
+    (void) Timeout;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_MDMA_Abort(MDMA_HandleTypeDef* hmdma) {
+    (void) hmdma;
+    return HAL_OK;
+}
+
+/* ---------------------------------------------------------------------- */
+/* QUADSPI                                                                 */
+/* ---------------------------------------------------------------------- */
+
+HAL_StatusTypeDef
+HAL_QSPI_Init(QSPI_HandleTypeDef* hqspi) {
+    qspi_handle = hqspi;
+    HAL_QSPI_MspInit(hqspi);
+    Sim_SelectChip(hqspi->Init.FlashID);
+    qspi_hz = qspi_kernel_hz / (hqspi->Init.ClockPrescaler + 1);
+    pending_data = 0;
+    event = SIM_EVENT_NONE;
+    hqspi->ErrorCode = HAL_QSPI_ERROR_NONE;
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_DeInit(QSPI_HandleTypeDef* hqspi) {
+    qspi_handle = hqspi;
+    (void) HAL_QSPI_Abort(hqspi);
+    HAL_QSPI_MspDeInit(hqspi);
+    hqspi->State = HAL_QSPI_STATE_RESET;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_Command(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd, uint32_t Timeout) {
+    (void) Timeout;
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    if (cmd->DataMode != QSPI_DATA_NONE) {
+        pending = *cmd;
+        pending_data = 1;
+        return HAL_OK;
+    }
+    Sim_Advance(Sim_Execute(cmd, NULL, 0));
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_Transmit(QSPI_HandleTypeDef* hqspi, uint8_t* pData, uint32_t Timeout) {
+    (void) Timeout;
+    if ((hqspi->State != HAL_QSPI_STATE_READY) || !pending_data) {
+        return HAL_ERROR;
+    }
+    pending_data = 0;
+    Sim_Advance(Sim_Execute(&pending, pData, pending.NbData));
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_Receive(QSPI_HandleTypeDef* hqspi, uint8_t* pData, uint32_t Timeout) {
+    (void) Timeout;
+    if ((hqspi->State != HAL_QSPI_STATE_READY) || !pending_data) {
+        return HAL_ERROR;
+    }
+    pending_data = 0;
+    Sim_Advance(Sim_Execute(&pending, pData, pending.NbData));
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_Command_IT(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd) {
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    if (cmd->DataMode != QSPI_DATA_NONE) {
+        pending = *cmd;
+        pending_data = 1;
+        return HAL_OK;
+    }
+    hqspi->State = HAL_QSPI_STATE_BUSY;
+    Sim_Schedule(SIM_EVENT_CMD, now + Sim_Execute(cmd, NULL, 0));
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_Transmit_IT(QSPI_HandleTypeDef* hqspi, uint8_t* pData) {
+    if ((hqspi->State != HAL_QSPI_STATE_READY) || !pending_data) {
+        return HAL_ERROR;
+    }
+    pending_data = 0;
+    hqspi->State = HAL_QSPI_STATE_BUSY_INDIRECT_TX;
+    Sim_Schedule(SIM_EVENT_TX, now + Sim_Execute(&pending, pData, pending.NbData));
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_AutoPolling(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                     QSPI_AutoPollingTypeDef* cfg, uint32_t Timeout) {
+    uint64_t match;
+
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    sim_stats.commands++;
+    activity++;
+    if (Sim_PollMatch(cmd, cfg, &match) && (match - now <= Timeout * SIM_NS_PER_MS)) {
+        sim_stats.poll_ns += match - now;
+        Sim_Advance(match - now);
+        return HAL_OK;
+    }
+
+    /* HAL_QSPI_AutoPolling() leaves the handle in error on timeout */
+    if (Timeout == HAL_MAX_DELAY) {
+        fprintf(stderr, "sim: endless auto-polling of 0x%02X\n", (unsigned) cmd->Instruction);
+        exit(1);
+    }
+    sim_stats.timeouts++;
+    sim_stats.poll_ns += Timeout * SIM_NS_PER_MS;
+    Sim_Advance(Timeout * SIM_NS_PER_MS);
+    hqspi->ErrorCode |= HAL_QSPI_ERROR_TIMEOUT;
+    hqspi->State = HAL_QSPI_STATE_ERROR;
+    return HAL_ERROR;
+}
+
+/*Without a match the handle stays busy until the caller aborts it*/
+HAL_StatusTypeDef
+HAL_QSPI_AutoPolling_IT(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                        QSPI_AutoPollingTypeDef* cfg) {
+    uint64_t match;
+
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    sim_stats.commands++;
+    activity++;
+    hqspi->State = HAL_QSPI_STATE_BUSY_AUTO_POLLING;
+    if (Sim_PollMatch(cmd, cfg, &match)) {
+        sim_stats.poll_ns += match - now;
+        Sim_Schedule(SIM_EVENT_MATCH, match);
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_MemoryMapped(QSPI_HandleTypeDef* hqspi, QSPI_CommandTypeDef* cmd,
+                      QSPI_MemoryMappedTypeDef* cfg) {
+    (void) cfg;
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    activity++;
+    mapped_command = *cmd;
+    mapped = 1;
+    hqspi->State = HAL_QSPI_STATE_BUSY_MEM_MAPPED;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_QSPI_SetFlashID(QSPI_HandleTypeDef* hqspi, uint32_t FlashID) {
+    if (hqspi->State != HAL_QSPI_STATE_READY) {
+        return HAL_BUSY;
+    }
+    hqspi->Init.FlashID = FlashID;
+    Sim_SelectChip(FlashID);
+    return HAL_OK;
+}
+
+/*Drops any pending completion; an operation running in the flash goes on*/
+HAL_StatusTypeDef
+HAL_QSPI_Abort(QSPI_HandleTypeDef* hqspi) {
+    activity++;
+    if (mapped) {
+        mprotect((void*) (uintptr_t) SIM_WINDOW_ADDRESS, FLASH_MODEL_SIZE, PROT_NONE);
+        mapped = 0;
+    }
+    event = SIM_EVENT_NONE;
+    pending_data = 0;
+    hqspi->State = HAL_QSPI_STATE_READY;
+    return HAL_OK;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Bus model                                                               */
+/* ---------------------------------------------------------------------- */
+
+/*Lines of a phase from its CCR mode field: none, 1, 2 or 4*/
+#define SIM_LINES(mode, pos)    ((1u << (((mode) >> (pos)) & 3)) >> 1)
+
+static uint64_t
+Sim_CommandNs(const QSPI_CommandTypeDef* cmd, uint32_t length) {
+    uint32_t lines;
+    uint64_t cycles = SIM_CS_HIGH_CYCLES + cmd->DummyCycles, edges = 0;
+
+    if ((lines = SIM_LINES(cmd->InstructionMode, QUADSPI_CCR_IMODE_Pos)) != 0) {
+        cycles += 8 / lines;
+    }
+    /* Address, alternate bytes and data move on both edges in DDR mode */
+    if ((lines = SIM_LINES(cmd->AddressMode, QUADSPI_CCR_ADMODE_Pos)) != 0) {
+        edges += (((cmd->AddressSize >> QUADSPI_CCR_ADSIZE_Pos) + 1) * 8) / lines;
+    }
+    if ((lines = SIM_LINES(cmd->AlternateByteMode, QUADSPI_CCR_ABMODE_Pos)) != 0) {
+        edges += (((cmd->AlternateBytesSize >> QUADSPI_CCR_ABSIZE_Pos) + 1) * 8) / lines;
+    }
+    if ((lines = SIM_LINES(cmd->DataMode, QUADSPI_CCR_DMODE_Pos)) != 0) {
+        edges += ((uint64_t) length * 8 + lines - 1) / lines;
+    }
+    if (cmd->DdrMode != QSPI_DDR_MODE_DISABLE) {
+        edges = (edges + 1) / 2;
+    }
+    return (cycles + edges) * 1000000000ull / qspi_hz;
+}
+
+/*Run one command through the flash at the end of its bus time*/
+static uint64_t
+Sim_Execute(const QSPI_CommandTypeDef* cmd, uint8_t* data, uint32_t length) {
+    uint64_t duration = Sim_CommandNs(cmd, length);
+    uint32_t address_bytes = 0;
+
+    if (cmd->AddressMode != QSPI_ADDRESS_NONE) {
+        address_bytes = (cmd->AddressSize >> QUADSPI_CCR_ADSIZE_Pos) + 1;
+    }
+    Flash_Execute(&sim_flash[chip], (uint8_t) cmd->Instruction, address_bytes, cmd->Address,
+                  data, length, now + duration);
+    sim_stats.commands++;
+    sim_stats.bus_ns += duration;
+    activity++;
+    return duration;
+}
+
+/*
+ * Time of the first status read that matches. Registers only change when
+ * the running operation ends, so a read before and one after that point
+ * decide it.
+ */
+static uint8_t
+Sim_PollMatch(const QSPI_CommandTypeDef* cmd, const QSPI_AutoPollingTypeDef* cfg,
+              uint64_t* match) {
+    uint64_t read = Sim_CommandNs(cmd, cfg->StatusBytesSize);
+    uint64_t period = read + (uint64_t) cfg->Interval * 1000000000ull / qspi_hz;
+    uint64_t time = now + read;
+    uint32_t value, i;
+    uint8_t pass;
+
+    for (pass = 0; pass < 2; pass++) {
+        value = 0;
+        for (i = 0; i < cfg->StatusBytesSize; i++) {
+            value |= (uint32_t) Flash_ReadRegister(&sim_flash[chip], (uint8_t) cmd->Instruction,
+                                                   time) << (8 * i);
+        }
+        if ((cfg->MatchMode == QSPI_MATCH_MODE_AND)
+            ? ((value & cfg->Mask) == cfg->Match)
+            : ((~(value ^ cfg->Match) & cfg->Mask) != 0)) {
+            *match = time;
+            return 1;
+        }
+        if (time >= sim_flash[chip].busy_until) {
+            break;
+        }
+        time += (sim_flash[chip].busy_until - time + period - 1) / period * period;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Memory                                                                  */
+/* ---------------------------------------------------------------------- */
+
+static void
+Sim_Fault(int sig, siginfo_t* info, void* context) {
+    static const char message[] = "sim: access outside mapped memory\n";
+    uintptr_t address = (uintptr_t) info->si_addr;
+    uint64_t burst;
+
+    (void) context;
+    if (mapped && (address >= SIM_WINDOW_ADDRESS)
+        && (address < SIM_WINDOW_ADDRESS + FLASH_MODEL_SIZE)) {
+        address &= ~(uintptr_t) (SIM_MAPPED_BURST - 1);
+        mprotect((void*) address, SIM_MAPPED_BURST, PROT_READ);
+        burst = Sim_CommandNs(&mapped_command, SIM_MAPPED_BURST);
+        sim_stats.mapped_ns += burst;
+        sim_stats.mapped_bytes += SIM_MAPPED_BURST;
+        now += burst;
+        Sim_Sync();
+        return;
+    }
+    write(STDERR_FILENO, message, sizeof(message) - 1);
+    signal(sig, SIG_DFL);
+}
+
+/*Route commands to the chip FSEL selects and show its storage in the window*/
+static void
+Sim_SelectChip(uint32_t FlashID) {
+    uint32_t selected = (FlashID == QSPI_FLASH_ID_2) ? 1 : 0;
+
+    if ((selected >= SIM_CHIPS) || (selected == chip)) {
+        return;
+    }
+    chip = selected;
+    if (mmap((void*) (uintptr_t) SIM_WINDOW_ADDRESS, FLASH_MODEL_SIZE, PROT_NONE,
+             MAP_SHARED | MAP_FIXED, storage_fd, (off_t) chip * FLASH_MODEL_SIZE) == MAP_FAILED) {
+        perror("sim: window");
+        exit(1);
+    }
+}
+
+static void*
+Sim_Map(uintptr_t address, size_t size, int prot, int flags, int fd) {
+    void* base;
+
+    if (address != 0) {
+        flags |= MAP_FIXED_NOREPLACE;
+    }
+    base = mmap((void*) address, size, prot, flags, fd, 0);
+    if ((base == MAP_FAILED) || ((address != 0) && ((uintptr_t) base != address))) {
+        fprintf(stderr, "sim: cannot map 0x%08lX\n", (unsigned long) address);
+        exit(1);
+    }
+    return base;
+}
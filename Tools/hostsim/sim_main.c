@@ -0,0 +1,259 @@
+/*
+ * sim_main.c
+ *
+ * Runs an erase/program/verify/read session through the loader exports
+ * on the simulator and prints the virtual time of each phase next to the
+ * bus, polling and flash busy time behind it. The result is
+ * deterministic, so two builds of the loader can be compared directly.
+ *
+ *   sim [-s size] [-c chunk] [-a address] [-t typ|max] [-f|-p fail_address] [-m]
+ *
+ * -f makes erases and programs covering the address fail, -p programs only;
+ * the flag status register reports it and the loader has to notice.
+ * The sparse phase reads the image and the erased space behind it back
+ * with ReadSparse() and prints how much of the range it transferred.
+ */
+#include "Loader_Src.h"
+#include "sim.h"
+#include "sparse_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define SIM_DEFAULT_SIZE    0x100000
+#define SIM_DEFAULT_CHUNK   0x8000
+#define SIM_SPARSE_TAIL     0x100000    /* erased space read behind the image */
+
+typedef struct {
+    const char* name;
+    uint64_t start;
+    Sim_StatsTypeDef sim;
+    Flash_StatsTypeDef flash;
+} Phase;
+
+static void Phase_Begin(Phase* phase, const char* name);
+static void Phase_End(Phase* phase, uint32_t bytes);
+static uint32_t Image_Byte(uint32_t offset);
+static uint32_t Sparse_Check(const uint8_t* image, uint32_t address, uint32_t size,
+                             const uint8_t* storage, uint32_t* packed);
+
+int
+main(int argc, char** argv) {
+    const Flash_TimingTypeDef* timing = &flash_timing_typical;
+    uint32_t address = 0, size = SIM_DEFAULT_SIZE, chunk = SIM_DEFAULT_CHUNK;
+    uint32_t fail_address = 0xFFFFFFFF, offset, length, i, mismatches = 0;
+    uint32_t span, packed = 0, transferred = 0;
+    uint8_t* buffer = (uint8_t*) (uintptr_t) SIM_RAM_ADDRESS;
+    uint8_t* storage;
+    int mass_erase = 0, fail_erase = 1, status = 0, option;
+    uint64_t result;
+    Phase phase;
+
+    while ((option = getopt(argc, argv, "s:c:a:t:f:p:m")) != -1) {
+        switch (option) {
+            case 's':
+                size = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                chunk = strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                address = strtoul(optarg, NULL, 0) & (SIM_FLASH_SIZE - 1);
+                break;
+            case 't':
+                timing = strcmp(optarg, "max") ? &flash_timing_typical : &flash_timing_max;
+                break;
+            case 'f':
+            case 'p':
+                fail_address = strtoul(optarg, NULL, 0) & (SIM_FLASH_SIZE - 1);
+                fail_erase = option == 'f';
+                break;
+            case 'm':
+                mass_erase = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s size] [-c chunk] [-a address] "
+                        "[-t typ|max] [-f|-p fail_address] [-m]\n", argv[0]);
+                return 2;
+        }
+    }
+    if ((chunk == 0) || (chunk > SIM_RAM_SIZE - 4) || (chunk % 4)
+        || (size == 0) || (size > SIM_FLASH_SIZE - address)) {
+        fprintf(stderr, "sim: bad size, chunk or address\n");
+        return 2;
+    }
+
+    Sim_Init(timing);
+    if (fail_address != 0xFFFFFFFF) {
+        sim_flash[fail_address / FLASH_MODEL_SIZE].fail_address = fail_address % FLASH_MODEL_SIZE;
+        sim_flash[fail_address / FLASH_MODEL_SIZE].fail_erase = fail_erase;
+    }
+
+    Phase_Begin(&phase, "init");
+    if (Init() != LOADER_OK) {
+        fprintf(stderr, "sim: Init failed\n");
+        return 1;
+    }
+    printf("%-8s %12s %10s %10s %10s %10s %8s %6s\n", "phase", "time_ms", "MB/s",
+           "bus_ms", "poll_ms", "busy_ms", "cmds", "viol");
+    Phase_End(&phase, 0);
+
+    Phase_Begin(&phase, "erase");
+    if (mass_erase) {
+        status |= MassErase() != LOADER_OK;
+    } else {
+        status |= SectorErase(SIM_WINDOW_ADDRESS + address,
+                              SIM_WINDOW_ADDRESS + address + size - 1) != LOADER_OK;
+    }
+    if (status) {
+        fprintf(stderr, "sim: erase failed\n");
+    }
+    Phase_End(&phase, size);
+
+    /* The tool hands over one RAM buffer at a time */
+    Phase_Begin(&phase, "write");
+    for (offset = 0; (offset < size) && !status; offset += length) {
+        length = (size - offset < chunk) ? size - offset : chunk;
+        for (i = 0; i < length; i++) {
+            buffer[i] = Image_Byte(offset + i);
+        }
+        if (Write(SIM_WINDOW_ADDRESS + address + offset, length, buffer) != LOADER_OK) {
+            fprintf(stderr, "sim: Write failed at 0x%08X\n", SIM_WINDOW_ADDRESS + address + offset);
+            status = 1;
+        }
+    }
+    Phase_End(&phase, size);
+
+    Phase_Begin(&phase, "verify");
+    for (offset = 0; (offset < size) && !status; offset += length) {
+        length = (size - offset < chunk) ? size - offset : chunk;
+        for (i = 0; i < length; i++) {
+            buffer[i] = Image_Byte(offset + i);
+        }
+        /* Whole words are compared; past the image the flash is erased */
+        memset(buffer + length, 0xFF, 3);
+        result = Verify(SIM_WINDOW_ADDRESS + address + offset, SIM_RAM_ADDRESS,
+                        (length + 3) / 4, 0);
+        if ((uint32_t) result != 0) {
+            fprintf(stderr, "sim: Verify reports a mismatch at 0x%08X\n", (uint32_t) result);
+            status = 1;
+        }
+    }
+    Phase_End(&phase, size);
+
+    Phase_Begin(&phase, "read");
+    for (offset = 0; (offset < size) && !status; offset += length) {
+        length = (size - offset < chunk) ? size - offset : chunk;
+        if (Read(SIM_WINDOW_ADDRESS + address + offset, length, buffer) != LOADER_OK) {
+            fprintf(stderr, "sim: Read failed at 0x%08X\n", SIM_WINDOW_ADDRESS + address + offset);
+            status = 1;
+        }
+        for (i = 0; (i < length) && !status; i++) {
+            if (buffer[i] != (uint8_t) Image_Byte(offset + i)) {
+                fprintf(stderr, "sim: Read returns wrong data at 0x%08X\n",
+                        SIM_WINDOW_ADDRESS + address + offset + i);
+                status = 1;
+            }
+        }
+    }
+    Phase_End(&phase, size);
+
+    /* Independent of the loader: compare the model's storage */
+    storage = Sim_FlashStorage();
+
+    span = (SIM_FLASH_SIZE - address - size < SIM_SPARSE_TAIL)
+           ? SIM_FLASH_SIZE - address : size + SIM_SPARSE_TAIL;
+    Phase_Begin(&phase, "sparse");
+    for (offset = 0; (offset < span) && !status; offset += length) {
+        length = (span - offset < chunk) ? span - offset : chunk;
+        while (SPARSE_READ_BOUND(length) > SIM_RAM_SIZE) {
+            length /= 2;
+        }
+        if ((ReadSparse(SIM_WINDOW_ADDRESS + address + offset, length, buffer) != LOADER_OK)
+            || (Sparse_Check(buffer, address + offset, length, storage, &packed) != 0)) {
+            fprintf(stderr, "sim: ReadSparse wrong at 0x%08X\n", SIM_WINDOW_ADDRESS + address + offset);
+            status = 1;
+        }
+        transferred += packed;
+    }
+    Phase_End(&phase, span);
+
+    for (offset = 0; offset < size; offset++) {
+        if (storage[address + offset] != (uint8_t) Image_Byte(offset)) {
+            if (mismatches++ == 0) {
+                fprintf(stderr, "sim: flash differs from the image at 0x%08X\n",
+                        SIM_WINDOW_ADDRESS + address + offset);
+            }
+        }
+    }
+
+    printf("\nQUADSPI clock %.2f MHz, %s timings, %u protocol violations, %u mismatches\n",
+           Sim_QspiHz() / 1e6, timing == &flash_timing_max ? "max" : "typical",
+           Sim_FlashStats().violations, mismatches);
+    printf("sparse read of %u bytes transfers %u (%.1f%%)\n", span, transferred,
+           span ? 100.0 * transferred / span : 0.0);
+    return (status || mismatches || Sim_FlashStats().violations) ? 1 : 0;
+}
+
+static void
+Phase_Begin(Phase* phase, const char* name) {
+    phase->name = name;
+    phase->start = Sim_Now();
+    phase->sim = sim_stats;
+    phase->flash = Sim_FlashStats();
+}
+
+static void
+Phase_End(Phase* phase, uint32_t bytes) {
+    double ms = (Sim_Now() - phase->start) / 1e6;
+    Flash_StatsTypeDef flash = Sim_FlashStats();
+
+    printf("%-8s %12.3f %10.3f %10.3f %10.3f %10.3f %8u %6u\n", phase->name, ms,
+           (bytes && ms > 0) ? bytes / 1048576.0 / (ms / 1e3) : 0.0,
+           (sim_stats.bus_ns - phase->sim.bus_ns + sim_stats.mapped_ns - phase->sim.mapped_ns) / 1e6,
+           (sim_stats.poll_ns - phase->sim.poll_ns) / 1e6,
+           (flash.busy_ns - phase->flash.busy_ns) / 1e6,
+           sim_stats.commands - phase->sim.commands,
+           flash.violations - phase->flash.violations);
+}
+
+/*Deterministic test image*/
+static uint32_t
+Image_Byte(uint32_t offset) {
+    uint32_t x = offset * 2654435761u;
+
+    return (x ^ (x >> 13)) >> 7;
+}
+
+/*Check a ReadSparse() descriptor against the model; returns 0 if it matches*/
+static uint32_t
+Sparse_Check(const uint8_t* image, uint32_t address, uint32_t size,
+             const uint8_t* storage, uint32_t* packed) {
+    struct SparseHeader header;
+    struct SparseSegment segment;
+    const uint8_t* data;
+    uint32_t i, j, next = address;
+
+    memcpy(&header, image, sizeof(header));
+    data = image + sizeof(header) + header.SegmentCount * sizeof(segment);
+    *packed = sizeof(header) + header.SegmentCount * sizeof(segment) + header.DataSize;
+    if (header.Magic != SPARSE_MAGIC) {
+        return 1;
+    }
+
+    for (i = 0; i < header.SegmentCount; i++) {
+        memcpy(&segment, image + sizeof(header) + i * sizeof(segment), sizeof(segment));
+        if (segment.Address != next) {
+            return 1;
+        }
+        for (j = 0; j < segment.Size; j++) {
+            if (storage[segment.Address + j]
+                != ((segment.Type == SPARSE_DATA) ? data[segment.Value + j] : 0xFF)) {
+                return 1;
+            }
+        }
+        next += segment.Size;
+    }
+    return next != address + size;
+}
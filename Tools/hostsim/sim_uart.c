@@ -0,0 +1,191 @@
+/*
+ * sim_uart.c
+ *
+ * The HAL UART calls of uart_stream.c on top of a host file descriptor,
+ * normally the master side of a pseudo-terminal. Bytes read from it queue
+ * on a host-side wire and reach the circular receive DMA at the modeled
+ * baud rate in virtual time, counting down the stream's NDTR as the DMA
+ * would; the receiver runs on through the flash's busy time like the
+ * real one. Transmits are written out at once and charged their line
+ * time. The wire is fed from the HAL_GetTick() hook, which also holds the
+ * virtual clock back to real time: the sender runs in real time, and a
+ * device racing through its flash operations would otherwise find the
+ * line empty for want of a sender that could not keep up.
+ */
+#include "stm32h7xx_hal.h"
+#include "sim.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_UART_WIRE_SIZE      0x100000u   /* bytes read ahead of the receiver */
+#define SIM_UART_BITS           10          /* start, 8 data, stop */
+#define SIM_UART_WAIT_MS        1           /* transmit retry */
+#define SIM_UART_AHEAD_NS       1000000ull  /* virtual time allowed ahead of real time */
+
+Sim_UartStatsTypeDef sim_uart_stats;
+
+static int link_fd = -1;
+static uint64_t byte_ns;
+static uint8_t wire[SIM_UART_WIRE_SIZE];
+static uint32_t wire_first, wire_count;
+static uint64_t wire_time;                  /* virtual time the last byte delivered ended */
+static uint64_t real_start, virtual_start;
+
+static UART_HandleTypeDef* rx_handle;
+static uint8_t* rx_buffer;
+static uint32_t rx_size, rx_position;
+
+static void Sim_UartPump(uint8_t idle);
+static void Sim_UartFill(void);
+static uint64_t Sim_UartRealNs(void);
+
+void
+Sim_UartAttach(int fd, uint32_t baud) {
+    link_fd = fd;
+    byte_ns = 1000000000ull * SIM_UART_BITS / baud;
+    wire_first = 0;
+    wire_count = 0;
+    rx_handle = NULL;
+    memset(&sim_uart_stats, 0, sizeof(sim_uart_stats));
+    real_start = Sim_UartRealNs();
+    virtual_start = Sim_Now();
+    Sim_SetTickHook(Sim_UartPump);
+}
+
+static uint64_t
+Sim_UartRealNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*Read what the sender has written so far onto the wire*/
+static void
+Sim_UartFill(void) {
+    uint32_t last, space;
+    ssize_t got;
+
+    if (wire_count == 0) {
+        wire_time = Sim_Now();
+    }
+    while (wire_count < SIM_UART_WIRE_SIZE) {
+        last = (wire_first + wire_count) % SIM_UART_WIRE_SIZE;
+        space = (last >= wire_first) ? SIM_UART_WIRE_SIZE - last : wire_first - last;
+        got = read(link_fd, &wire[last], space);
+        if (got <= 0) {
+            break;
+        }
+        wire_count += got;
+    }
+}
+
+static void
+Sim_UartPump(uint8_t idle) {
+    DMA_Stream_TypeDef* stream;
+    uint64_t now = Sim_Now(), real;
+    uint32_t count, first;
+
+    if (link_fd < 0) {
+        return;
+    }
+
+    real = Sim_UartRealNs() - real_start;
+    if (now - virtual_start > real + SIM_UART_AHEAD_NS) {
+        usleep((now - virtual_start - real) / 1000);
+    }
+
+    Sim_UartFill();
+    if (wire_count == 0) {
+        sim_uart_stats.starved_ms += idle;
+        return;
+    }
+
+    /* Bytes whose stop bit has passed by now */
+    count = (uint32_t) ((now - wire_time) / byte_ns);
+    if (count > wire_count) {
+        count = wire_count;
+    }
+    wire_time += count * byte_ns;
+    sim_uart_stats.rx_bytes += count;
+
+    if (rx_handle == NULL) {
+        /* Nobody receiving: the line is lost */
+        sim_uart_stats.dropped += count;
+        wire_first = (wire_first + count) % SIM_UART_WIRE_SIZE;
+        wire_count -= count;
+        return;
+    }
+
+    stream = (DMA_Stream_TypeDef*) rx_handle->hdmarx->Instance;
+    while (count > 0) {
+        first = count;
+        if (first > SIM_UART_WIRE_SIZE - wire_first) {
+            first = SIM_UART_WIRE_SIZE - wire_first;
+        }
+        if (first > rx_size - rx_position) {
+            first = rx_size - rx_position;
+        }
+        memcpy(&rx_buffer[rx_position], &wire[wire_first], first);
+        rx_position = (rx_position + first) % rx_size;
+        wire_first = (wire_first + first) % SIM_UART_WIRE_SIZE;
+        wire_count -= first;
+        count -= first;
+    }
+    stream->NDTR = rx_size - rx_position;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Receive_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size) {
+    if ((huart->hdmarx == NULL) || (pData == NULL) || (Size == 0)) {
+        return HAL_ERROR;
+    }
+
+    rx_handle = huart;
+    rx_buffer = pData;
+    rx_size = Size;
+    rx_position = 0;
+    ((DMA_Stream_TypeDef*) huart->hdmarx->Instance)->NDTR = Size;
+    huart->RxState = HAL_UART_STATE_BUSY_RX;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_DMAStop(UART_HandleTypeDef* huart) {
+    if (huart == rx_handle) {
+        rx_handle = NULL;
+    }
+    huart->RxState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Transmit(UART_HandleTypeDef* huart, const uint8_t* pData, uint16_t Size,
+                  uint32_t Timeout) {
+    struct pollfd pfd;
+    uint32_t done = 0;
+    ssize_t put;
+
+    (void) huart;
+    (void) Timeout;
+    while ((link_fd >= 0) && (done < Size)) {
+        put = write(link_fd, pData + done, Size - done);
+        if (put > 0) {
+            done += put;
+        } else if ((put < 0) && (errno == EAGAIN)) {
+            pfd.fd = link_fd;
+            pfd.events = POLLOUT;
+            (void) poll(&pfd, 1, SIM_UART_WAIT_MS);
+        } else {
+            break;
+        }
+    }
+
+    sim_uart_stats.tx_bytes += Size;
+    Sim_Advance(Size * byte_ns);
+    return HAL_OK;
+}
@@ -0,0 +1,176 @@
+/*
+ * uart_dev.c
+ *
+ * Runs Core/Src/uart_stream.c on the simulator behind a pseudo-terminal,
+ * standing in for a fixture on USART1: Tools/uart_stream.py talks to the
+ * path printed on startup as it would to the serial port. After every
+ * session it prints the status, the virtual time from OPEN to DONE, how
+ * much of it the link was receiving and the flash busy time within it.
+ *
+ *   uart_dev [-b baud] [-l link] [-n sessions] [-o dump] [-t typ|max]
+ *
+ * -l also makes the terminal reachable under a fixed name (a symlink),
+ * -o writes the flash range of each image to a file once it is done.
+ */
+#include "uart_stream.h"
+#include "Loader_Src.h"
+#include "sim.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+
+#define UART_DEV_DRAIN_MS   1000
+
+static const char* const status_names[] = {
+    "ok", "resend", "range", "flash", "mismatch", "timeout",
+};
+
+static UART_HandleTypeDef huart1;
+static DMA_HandleTypeDef hdma_usart1_rx;
+
+/*Master side of a raw terminal; the slave stays open so that the master
+ *keeps working while no sender is attached*/
+static int
+Link_Open(const char* link, int* slave) {
+    struct termios tio;
+    const char* name;
+    int master;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0)
+        || ((name = ptsname(master)) == NULL)) {
+        perror("pty");
+        return -1;
+    }
+
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if ((*slave < 0) || (tcgetattr(*slave, &tio) != 0)) {
+        perror(name);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    if (link != NULL) {
+        unlink(link);
+        if (symlink(name, link) != 0) {
+            perror(link);
+            return -1;
+        }
+        name = link;
+    }
+    printf("%s\n", name);
+    fflush(stdout);
+    return master;
+}
+
+static int
+Dump(const char* path) {
+    const UartStream_SessionTypeDef* session = &uart_stream_session;
+    FILE* out = fopen(path, "wb");
+
+    if ((out == NULL)
+        || (fwrite(Sim_FlashStorage() + session->address, 1, session->size, out) != session->size)
+        || fclose(out)) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char** argv) {
+    const Flash_TimingTypeDef* timing = &flash_timing_typical;
+    const UartStream_SessionTypeDef* session = &uart_stream_session;
+    const char *link = NULL, *dump = NULL;
+    uint32_t baud = UART_STREAM_BAUD, sessions = 0, served, ms;
+    Flash_StatsTypeDef flash;
+    int fd, slave, option, pending, i, failed = 0;
+
+    while ((option = getopt(argc, argv, "b:l:n:o:t:")) != -1) {
+        switch (option) {
+            case 'b':
+                baud = strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                link = optarg;
+                break;
+            case 'n':
+                sessions = strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                dump = optarg;
+                break;
+            case 't':
+                timing = strcmp(optarg, "max") ? &flash_timing_typical : &flash_timing_max;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b baud] [-l link] [-n sessions] [-o dump] "
+                        "[-t typ|max]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (baud == 0) {
+        fprintf(stderr, "uart_dev: bad baud rate\n");
+        return 2;
+    }
+
+    Sim_Init(timing);
+    if (Init() != LOADER_OK) {
+        fprintf(stderr, "uart_dev: Init failed\n");
+        return 1;
+    }
+    /* The application runs with interrupts enabled */
+    __set_PRIMASK(0);
+
+    if ((fd = Link_Open(link, &slave)) < 0) {
+        return 1;
+    }
+    Sim_UartAttach(fd, baud);
+
+    huart1.Instance = USART1;
+    huart1.Init.BaudRate = baud;
+    hdma_usart1_rx.Instance = DMA1_Stream0;
+    huart1.hdmarx = &hdma_usart1_rx;
+
+    for (served = 0; (sessions == 0) || (served < sessions); served++) {
+        Sim_ResetStats();
+        sim_uart_stats.rx_bytes = 0;
+        sim_uart_stats.starved_ms = 0;
+        failed |= UartStream_Run(&huart1) != HAL_OK;
+
+        flash = Sim_FlashStats();
+        ms = session->end_tick - session->start_tick;
+        printf("session %lu: %s, 0x%08lX+0x%lX, %lu ms, %.3f MB/s, link busy %.0f%%, "
+               "flash busy %.1f ms, line idle %lu ms, erases %lu, resends %lu, bad frames %lu, viol %lu\n",
+               (unsigned long) served,
+               status_names[session->status % (sizeof(status_names) / sizeof(status_names[0]))],
+               (unsigned long) session->address, (unsigned long) session->size,
+               (unsigned long) ms, ms ? session->programmed / 1048.576 / ms : 0.0,
+               ms ? sim_uart_stats.rx_bytes * 10e5 / baud / ms : 0.0, flash.busy_ns / 1e6,
+               (unsigned long) sim_uart_stats.starved_ms,
+               (unsigned long) session->erases, (unsigned long) session->resends,
+               (unsigned long) session->bad_frames, (unsigned long) flash.violations);
+        fflush(stdout);
+
+        if ((dump != NULL) && (session->status == UART_STREAM_OK)) {
+            failed |= Dump(dump);
+        }
+    }
+
+    /* Let the sender read the last reply before the terminal hangs up */
+    for (i = 0; (i < UART_DEV_DRAIN_MS) && (ioctl(slave, TIOCINQ, &pending) == 0) && pending; i++) {
+        usleep(1000);
+    }
+    close(slave);
+    if (link != NULL) {
+        unlink(link);
+    }
+    return failed;
+}
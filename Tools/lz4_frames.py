@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Pack a binary image into the frame stream accepted by WriteCompressed().
+
+Each frame is a 16-byte little-endian header (magic, raw size, compressed
+size, CRC-32 of the compressed block) followed by an independent LZ4 block
+of at most LZ4_BLOCK_MAX_SIZE decoded bytes, see Core/Inc/lz4_stream.h.
+The compressor is a plain greedy LZ4 encoder, so no extra package is needed.
+
+    lz4_frames.py image.bin image.lz4f
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+LZ4_FRAME_MAGIC = 0x46345A4C
+LZ4_BLOCK_MAX_SIZE = 0x4000
+
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MF_LIMIT = 12
+MAX_OFFSET = 0xFFFF
+
+
+def _write_length(out, value):
+    while value >= 255:
+        out.append(255)
+        value -= 255
+    out.append(value)
+
+
+def _sequence(out, literals, offset=0, match_length=0):
+    literal_length = len(literals)
+    match_code = match_length - MIN_MATCH if offset else 0
+    out.append((min(literal_length, 15) << 4) | min(match_code, 15))
+    if literal_length >= 15:
+        _write_length(out, literal_length - 15)
+    out += literals
+    if offset:
+        out += struct.pack("<H", offset)
+        if match_code >= 15:
+            _write_length(out, match_code - 15)
+
+
+def compress_block(src):
+    """Greedy LZ4 block compression honouring the end-of-block rules."""
+    out = bytearray()
+    table = {}
+    anchor = 0
+    pos = 0
+    end = len(src)
+
+    while pos + MF_LIMIT <= end:
+        key = src[pos:pos + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = pos
+        if candidate is not None and pos - candidate <= MAX_OFFSET:
+            length = MIN_MATCH
+            limit = end - LAST_LITERALS - pos
+            while length < limit and src[candidate + length] == src[pos + length]:
+                length += 1
+            if length <= limit:
+                _sequence(out, src[anchor:pos], pos - candidate, length)
+                pos += length
+                anchor = pos
+                continue
+        pos += 1
+
+    _sequence(out, src[anchor:])
+    return bytes(out)
+
+
+def decompress_block(src, capacity):
+    """Reference decoder, mirrors LZ4_DecodeBlock()."""
+    out = bytearray()
+    pos = 0
+    while pos < len(src):
+        token = src[pos]
+        pos += 1
+        length = token >> 4
+        if length == 15:
+            while True:
+                byte = src[pos]
+                pos += 1
+                length += byte
+                if byte != 255:
+                    break
+        out += src[pos:pos + length]
+        pos += length
+        if pos == len(src):
+            break
+        offset = src[pos] | (src[pos + 1] << 8)
+        pos += 2
+        length = token & 0x0F
+        if length == 15:
+            while True:
+                byte = src[pos]
+                pos += 1
+                length += byte
+                if byte != 255:
+                    break
+        length += MIN_MATCH
+        for _ in range(length):
+            out.append(out[-offset])
+    if len(out) > capacity:
+        raise ValueError("block exceeds capacity")
+    return bytes(out)
+
+
+def pack(image):
+    stream = bytearray()
+    for start in range(0, len(image), LZ4_BLOCK_MAX_SIZE):
+        raw = image[start:start + LZ4_BLOCK_MAX_SIZE]
+        block = compress_block(raw)
+        stream += struct.pack("<4I", LZ4_FRAME_MAGIC, len(raw), len(block),
+                              zlib.crc32(block))
+        stream += block
+    return bytes(stream)
+
+
+def unpack(stream):
+    image = bytearray()
+    pos = 0
+    while pos < len(stream):
+        magic, raw_size, size, crc = struct.unpack_from("<4I", stream, pos)
+        pos += 16
+        block = stream[pos:pos + size]
+        if magic != LZ4_FRAME_MAGIC or zlib.crc32(block) != crc:
+            raise ValueError("corrupt frame at offset %d" % (pos - 16))
+        raw = decompress_block(block, LZ4_BLOCK_MAX_SIZE)
+        if len(raw) != raw_size:
+            raise ValueError("size mismatch at offset %d" % (pos - 16))
+        image += raw
+        pos += size
+    return bytes(image)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="raw binary image")
+    parser.add_argument("output", help="frame stream for WriteCompressed()")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        image = f.read()
+    stream = pack(image)
+    if unpack(stream) != image:
+        sys.exit("round-trip check failed")
+    with open(args.output, "wb") as f:
+        f.write(stream)
+    print("%d -> %d bytes (%.2fx)" % (len(image), len(stream),
+                                      len(image) / max(len(stream), 1)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compare kernel microbenchmark results against a baseline.
+
+Both files hold the CSV records of Core/Src/microbench.c, written by
+Tools/hostsim/microbench on the host or captured from USART1 on the
+target; other lines of a capture are ignored. Points are matched on
+kernel, alignment and size and compared in time per byte. Sizes below
+--min-size are listed but do not fail the check, since timer resolution
+dominates them.
+
+    microbench_compare.py Tools/hostsim/microbench_baseline.csv results.csv
+    microbench_compare.py --tolerance 0.1 baseline.csv target_capture.txt
+"""
+
+import argparse
+import csv
+import sys
+
+FIELDS = ["kernel", "align", "size", "repeats", "ticks", "ticks_hz"]
+
+
+def load(path):
+    points = {}
+    with open(path, newline="") as f:
+        for row in csv.reader(f):
+            if len(row) != len(FIELDS) or row[0] == "kernel":
+                continue
+            try:
+                kernel, align, size, repeats, ticks, hz = row[0], *map(int, row[1:])
+            except ValueError:
+                continue
+            points[(kernel, align, size)] = ticks * 1e9 / hz / size if hz else 0.0
+    if not points:
+        sys.exit("%s: no microbenchmark records" % path)
+    return points
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("results")
+    parser.add_argument("--tolerance", type=float, default=0.3,
+                        help="allowed slowdown as a fraction (default 0.3)")
+    parser.add_argument("--min-size", type=lambda v: int(v, 0), default=0x1000,
+                        help="smallest size that can fail the check (default 0x1000)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    results = load(args.results)
+
+    regressions = 0
+    print("%-9s %5s %10s %12s %12s %8s" % ("kernel", "align", "size", "base_ns/B", "now_ns/B", "ratio"))
+    for key in sorted(results, key=lambda k: (k[0], k[1], k[2])):
+        if key not in baseline:
+            continue
+        base, now = baseline[key], results[key]
+        ratio = now / base if base else float("inf") if now else 1.0
+        flag = ""
+        if ratio > 1 + args.tolerance:
+            if key[2] >= args.min_size:
+                flag = "REGRESSION"
+                regressions += 1
+            else:
+                flag = "(small)"
+        elif ratio < 1 - args.tolerance:
+            flag = "faster"
+        print("%-9s %5d %10d %12.4f %12.4f %8.2f  %s" % (key[0], key[1], key[2], base, now, ratio, flag))
+
+    missing = sorted(set(baseline) - set(results))
+    if missing:
+        print("\n%d baseline points missing from the results" % len(missing))
+    print("\n%d regressions beyond %.0f%%" % (regressions, args.tolerance * 100))
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""Convert an .elf/.bin/.hex image into the descriptor consumed by WriteSparse().
+
+The image is split into runs of data, runs of a constant byte and runs of
+the erased value (0xFF). Only data runs carry payload; the loader erases
+the sectors each run touches and programs fills itself. See
+Core/Inc/sparse_image.h for the layout.
+
+    sparse_pack.py firmware.elf firmware.sprs
+    sparse_pack.py --base 0x90000000 firmware.bin firmware.sprs
+"""
+
+import argparse
+import re
+import struct
+import sys
+import zlib
+
+FLASH_BASE = 0x90000000
+FLASH_SIZE = 0x4000000
+SECTOR_SIZE = 0x10000
+ERASED = 0xFF
+
+SPARSE_MAGIC = 0x53505253
+SPARSE_DATA = 1
+SPARSE_FILL = 2
+SPARSE_ERASED = 3
+
+HEADER = struct.Struct("<4I")
+SEGMENT = struct.Struct("<4I2H")
+
+
+def load_bin(path, base):
+    with open(path, "rb") as f:
+        return [(base, f.read())]
+
+
+def load_hex(path):
+    chunks = []
+    upper = 0
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith(":"):
+                continue
+            record = bytes.fromhex(line[1:])
+            if sum(record) & 0xFF:
+                sys.exit("checksum error in %s: %s" % (path, line))
+            count, address, kind = record[0], (record[1] << 8) | record[2], record[3]
+            payload = record[4:4 + count]
+            if kind == 0x00:
+                chunks.append((upper + address, payload))
+            elif kind == 0x01:
+                break
+            elif kind == 0x02:
+                upper = int.from_bytes(payload, "big") << 4
+            elif kind == 0x04:
+                upper = int.from_bytes(payload, "big") << 16
+    return chunks
+
+
+def load_elf(path):
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        sys.exit("%s: not a 32-bit little-endian ELF file" % path)
+    phoff, = struct.unpack_from("<I", elf, 0x1C)
+    phentsize, phnum = struct.unpack_from("<HH", elf, 0x2A)
+    chunks = []
+    for i in range(phnum):
+        kind, offset, _, paddr, filesz = struct.unpack_from("<5I", elf, phoff + i * phentsize)
+        if kind == 1 and filesz:                    # PT_LOAD, placed at its load address
+            chunks.append((paddr, elf[offset:offset + filesz]))
+    return chunks
+
+
+def merge(chunks):
+    """Clip to the flash window and merge into ascending contiguous blocks."""
+    blocks = []
+    for address, data in sorted(chunks, key=lambda c: c[0]):
+        start = max(address, FLASH_BASE)
+        end = min(address + len(data), FLASH_BASE + FLASH_SIZE)
+        if start >= end:
+            continue
+        data = data[start - address:end - address]
+        if blocks and start <= blocks[-1][0] + len(blocks[-1][1]):
+            prev_start, prev = blocks[-1]
+            merged = bytearray(prev)
+            merged[start - prev_start:start - prev_start + len(data)] = data
+            blocks[-1] = (prev_start, bytes(merged))
+        else:
+            blocks.append((start, bytes(data)))
+    return blocks
+
+
+def runs(blocks, min_fill):
+    """Yield (type, flash offset, data) runs."""
+    pattern = re.compile(b"(.)\\1{%d,}" % (min_fill - 1), re.S)
+    for start, data in blocks:
+        offset = start - FLASH_BASE
+        position = 0
+        for match in pattern.finditer(data):
+            if match.start() > position:
+                yield SPARSE_DATA, offset + position, data[position:match.start()]
+            value = data[match.start()]
+            yield (SPARSE_ERASED if value == ERASED else SPARSE_FILL,
+                   offset + match.start(), data[match.start():match.end()])
+            position = match.end()
+        if position < len(data):
+            yield SPARSE_DATA, offset + position, data[position:]
+
+
+def pack(blocks, min_fill):
+    segments = bytearray()
+    payload = bytearray()
+    report = []
+    count = 0
+    for kind, address, data in runs(blocks, min_fill):
+        first = address // SECTOR_SIZE
+        sectors = (address + len(data) - 1) // SECTOR_SIZE - first + 1
+        value = 0
+        if kind == SPARSE_DATA:
+            value = len(payload)
+            payload += data
+        elif kind == SPARSE_FILL:
+            value = data[0] * 0x01010101
+        segments += SEGMENT.pack(kind, address, len(data), value, first, sectors)
+        report.append((kind, address, len(data), first, sectors))
+        count += 1
+    body = bytes(segments + payload)
+    header = HEADER.pack(SPARSE_MAGIC, count, len(payload), zlib.crc32(body))
+    return header + body, report
+
+
+def simulate(descriptor):
+    """Run the descriptor against a NOR flash model, as WriteSparse() does."""
+    magic, count, data_size, crc = HEADER.unpack_from(descriptor)
+    body = descriptor[HEADER.size:]
+    if magic != SPARSE_MAGIC or zlib.crc32(body) != crc:
+        raise ValueError("corrupt descriptor")
+    data = body[count * SEGMENT.size:]
+    flash = {}
+    erased = set()
+    for i in range(count):
+        kind, address, size, value, first, sectors = SEGMENT.unpack_from(body, i * SEGMENT.size)
+        for sector in range(first, first + sectors):
+            if sector not in erased:
+                erased.add(sector)
+                flash[sector] = bytearray([ERASED]) * SECTOR_SIZE
+        if kind == SPARSE_DATA:
+            content = data[value:value + size]
+        elif kind == SPARSE_FILL:
+            content = value.to_bytes(4, "little") * (size // 4 + 1)
+        else:
+            content = bytes([ERASED]) * size
+        for i, byte in enumerate(content[:size]):
+            sector, offset = divmod(address + i, SECTOR_SIZE)
+            flash[sector][offset] &= byte
+    return flash
+
+
+def check(blocks, descriptor):
+    flash = simulate(descriptor)
+    for start, data in blocks:
+        for i, byte in enumerate(data):
+            sector, offset = divmod(start - FLASH_BASE + i, SECTOR_SIZE)
+            if flash[sector][offset] != byte:
+                sys.exit("flash model mismatch at 0x%08X" % (start + i))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help=".elf, .hex or .bin image")
+    parser.add_argument("output", help="descriptor for WriteSparse()")
+    parser.add_argument("--base", type=lambda v: int(v, 0), default=FLASH_BASE,
+                        help="load address of a .bin image (default 0x%08X)" % FLASH_BASE)
+    parser.add_argument("--min-fill", type=int, default=32,
+                        help="shortest constant run sent as a fill (default 32)")
+    parser.add_argument("--check", action="store_true",
+                        help="replay the descriptor on a flash model and compare")
+    parser.add_argument("-v", "--verbose", action="store_true", help="list the runs")
+    args = parser.parse_args()
+
+    if args.input.lower().endswith(".elf"):
+        chunks = load_elf(args.input)
+    elif args.input.lower().endswith((".hex", ".ihex")):
+        chunks = load_hex(args.input)
+    else:
+        chunks = load_bin(args.input, args.base)
+
+    blocks = merge(chunks)
+    descriptor, report = pack(blocks, max(args.min_fill, 4))
+    if args.check:
+        check(blocks, descriptor)
+    with open(args.output, "wb") as f:
+        f.write(descriptor)
+
+    names = {SPARSE_DATA: "data", SPARSE_FILL: "fill", SPARSE_ERASED: "erased"}
+    if args.verbose:
+        for kind, address, size, first, sectors in report:
+            print("%-6s 0x%08X %9d  sectors %d-%d" % (names[kind], FLASH_BASE + address,
+                                                     size, first, first + sectors - 1))
+    image = sum(len(data) for _, data in blocks)
+    touched = len({s for _, _, _, first, count in report for s in range(first, first + count)})
+    print("%d bytes in %d runs -> %d bytes descriptor, %d sectors to erase"
+          % (image, len(report), len(descriptor), touched))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Report the footprint of an external loader and compare it with another.
+
+Reads the .stldr (an ELF file) directly: the bytes the programmer downloads
+(PT_LOAD segments with file contents), the RAM the loader occupies once
+running, the size of each allocated section, and the StorageInfo record.
+Given a second loader, prints both side by side and fails when their
+StorageInfo differs, since the programmer must see the same device.
+
+    stldr_size.py stm32h750-external-qspi-flash-loader.stldr
+    stldr_size.py Debug/loader.stldr stm32h750-external-qspi-flash-loader_lean.stldr
+"""
+
+import argparse
+import struct
+import sys
+
+PT_LOAD = 1
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            sys.exit("%s: not a 32-bit little-endian ELF file" % path)
+        (self.phoff, self.shoff, _, _, self.phentsize, self.phnum,
+         self.shentsize, self.shnum, self.shstrndx) = struct.unpack_from("<IIIHHHHHH", self.data, 28)
+        self.segments = [struct.unpack_from("<8I", self.data, self.phoff + i * self.phentsize)
+                         for i in range(self.phnum)]
+        self.sections = [struct.unpack_from("<10I", self.data, self.shoff + i * self.shentsize)
+                         for i in range(self.shnum)]
+        names = self.sections[self.shstrndx]
+        self.names = [self.string(names[4], s[0]) for s in self.sections]
+
+    def string(self, table_offset, index):
+        start = table_offset + index
+        return self.data[start:self.data.index(b"\0", start)].decode()
+
+    def download_bytes(self):
+        return sum(p[4] for p in self.segments if p[0] == PT_LOAD)
+
+    def ram_bytes(self):
+        return sum(p[5] for p in self.segments if p[0] == PT_LOAD)
+
+    def alloc_sections(self):
+        return [(name, s[5], s[1] == SHT_NOBITS) for name, s in zip(self.names, self.sections)
+                if s[2] & SHF_ALLOC and s[5]]
+
+    def symbol(self, wanted):
+        for s in self.sections:
+            if s[1] != SHT_SYMTAB:
+                continue
+            strtab = self.sections[s[6]][4]
+            for i in range(s[5] // 16):
+                name, value, size, _, _, shndx = struct.unpack_from("<IIIBBH", self.data, s[4] + i * 16)
+                if self.string(strtab, name) == wanted:
+                    return value, size
+        return None
+
+    def read(self, address, size):
+        for p in self.segments:
+            if p[0] == PT_LOAD and p[2] <= address and address + size <= p[2] + p[4]:
+                offset = p[1] + address - p[2]
+                return self.data[offset:offset + size]
+        return None
+
+    def storage_info(self):
+        found = self.symbol("StorageInfo")
+        return self.read(*found) if found and found[1] else None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("loaders", nargs="+", metavar="loader.stldr")
+    args = parser.parse_args()
+    if len(args.loaders) > 2:
+        parser.error("at most two loaders")
+
+    elves = [Elf(path) for path in args.loaders]
+    width = 12
+
+    print("%-20s" % "" + "".join("%*s" % (width, chr(ord("A") + i)) for i in range(len(elves))))
+    print("%-20s" % "download" + "".join("%*d" % (width, e.download_bytes()) for e in elves))
+    print("%-20s" % "ram" + "".join("%*d" % (width, e.ram_bytes()) for e in elves))
+    names = []
+    for e in elves:
+        names += [n for n, _, _ in e.alloc_sections() if n not in names]
+    for name in names:
+        sizes = [dict((n, s) for n, s, _ in e.alloc_sections()).get(name, 0) for e in elves]
+        print("  %-18s" % name + "".join("%*d" % (width, s) for s in sizes))
+    if len(elves) == 2:
+        a, b = elves[0].download_bytes(), elves[1].download_bytes()
+        print("\nB downloads %d bytes %s than A (%.1f%%)"
+              % (abs(b - a), "fewer" if b <= a else "more", 100.0 * (b - a) / a if a else 0.0))
+
+    infos = [e.storage_info() for e in elves]
+    for i, info in enumerate(infos):
+        if info is None:
+            sys.exit("%s: no StorageInfo symbol" % args.loaders[i])
+    if len(infos) == 2:
+        if infos[0] != infos[1]:
+            print("StorageInfo differs")
+            sys.exit(1)
+        print("StorageInfo identical (%d bytes)" % len(infos[0]))
+
+
+if __name__ == "__main__":
+    main()
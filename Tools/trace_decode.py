@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""Decode a dump of the loader's QSPI command trace into a timeline.
+
+The ring lives at 0x2001D000 in DTCM (see Core/Inc/loader_trace.h). Dump it after
+a session, e.g. with STM32CubeProgrammer or gdb:
+
+    (gdb) dump binary memory trace.bin 0x2001D000 0x2001F810
+    trace_decode.py trace.bin
+    trace_decode.py --summary trace.bin
+
+The timeline lists every step with its duration and the idle gap before
+it; the summary totals time per opcode and step kind, which is where
+redundant WREN or abort traffic and gaps between operations show up.
+"""
+
+import argparse
+import collections
+import struct
+import sys
+
+TRACE_MAGIC = 0x43525451
+
+HEADER = struct.Struct("<4I")
+ENTRY = struct.Struct("<4B4I")
+
+KINDS = ["CMD", "TX", "RX", "POLL", "MAPPED", "ABORT"]
+LINES = ["-", "1", "2", "4"]
+
+OPCODES = {
+    0x06: "WREN",
+    0x05: "RDSR",
+    0x70: "RDFSR",
+    0x50: "CLFSR",
+    0xB7: "EN4B",
+    0x81: "WRVCR",
+    0x85: "RDVCR",
+    0xD8: "SE",
+    0xC7: "BE",
+    0x32: "QPP",
+    0x6B: "QOFR",
+    0x66: "RSTEN",
+    0x99: "RST",
+}
+
+Step = collections.namedtuple("Step", "opcode kind lines status address length start end")
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        sys.exit("%s: too short for a trace header" % path)
+    magic, cpu_hz, capacity, head = HEADER.unpack_from(data)
+    if magic != TRACE_MAGIC:
+        sys.exit("%s: bad magic 0x%08X" % (path, magic))
+    if len(data) < HEADER.size + capacity * ENTRY.size:
+        sys.exit("%s: dump holds less than %d entries" % (path, capacity))
+
+    # Oldest first; before the first wrap only the first Head entries are valid
+    count = min(head, capacity)
+    first = head - count
+    steps = []
+    for n in range(first, head):
+        fields = ENTRY.unpack_from(data, HEADER.size + (n % capacity) * ENTRY.size)
+        steps.append(Step(*fields))
+    return cpu_hz or 1, head, capacity, steps
+
+
+def name(step):
+    if step.kind == 5:
+        return "ABORT"
+    return OPCODES.get(step.opcode, "0x%02X" % step.opcode)
+
+
+def lines(step):
+    return "%s-%s-%s" % (LINES[step.lines & 3], LINES[(step.lines >> 2) & 3],
+                         LINES[(step.lines >> 4) & 3])
+
+
+def cycles(start, end):
+    return (end - start) & 0xFFFFFFFF
+
+
+def timeline(cpu_hz, steps):
+    us = 1e6 / cpu_hz
+    origin = steps[0].start if steps else 0
+    previous_end = None
+    print("%12s %10s %10s  %-6s %-6s %-5s %10s %6s  %s"
+          % ("time_us", "dur_us", "gap_us", "op", "kind", "lines", "address", "len", "status"))
+    for step in steps:
+        if step.status == 0xFF:
+            duration, status = "-", "open"
+        else:
+            duration = "%.2f" % (cycles(step.start, step.end) * us)
+            status = "ok" if step.status == 0 else "err %d" % step.status
+        gap = "" if previous_end is None else "%.2f" % (cycles(previous_end, step.start) * us)
+        address = "0x%08X" % step.address if (step.lines >> 2) & 3 else ""
+        length = str(step.length) if step.length else ""
+        print("%12.2f %10s %10s  %-6s %-6s %-5s %10s %6s  %s"
+              % (cycles(origin, step.start) * us, duration, gap, name(step),
+                 KINDS[step.kind] if step.kind < len(KINDS) else str(step.kind),
+                 lines(step), address, length, status))
+        if step.status != 0xFF:
+            previous_end = step.end
+
+
+def summary(cpu_hz, steps):
+    us = 1e6 / cpu_hz
+    totals = collections.OrderedDict()
+    gaps = 0
+    previous_end = None
+    for step in steps:
+        if step.status == 0xFF:
+            continue
+        key = (name(step), KINDS[step.kind] if step.kind < len(KINDS) else str(step.kind))
+        count, total, worst = totals.get(key, (0, 0, 0))
+        duration = cycles(step.start, step.end)
+        totals[key] = (count + 1, total + duration, max(worst, duration))
+        if previous_end is not None:
+            gaps += cycles(previous_end, step.start)
+        previous_end = step.end
+
+    print("%-6s %-6s %8s %12s %10s %10s" % ("op", "kind", "count", "total_us", "mean_us", "max_us"))
+    for (op, kind), (count, total, worst) in sorted(totals.items(), key=lambda i: -i[1][1]):
+        print("%-6s %-6s %8d %12.1f %10.2f %10.2f"
+              % (op, kind, count, total * us, total * us / count, worst * us))
+    if steps:
+        span = cycles(steps[0].start, previous_end if previous_end is not None else steps[0].start)
+        print("\nspan %.1f us, between steps %.1f us" % (span * us, gaps * us))
+
+    wren = sum(v[0] for k, v in totals.items() if k == ("WREN", "CMD"))
+    writes = sum(v[0] for k, v in totals.items()
+                 if k in (("QPP", "TX"), ("SE", "CMD"), ("BE", "CMD")))
+    aborts = sum(v[0] for k, v in totals.items() if k[0] == "ABORT")
+    print("WREN %d for %d program/erase commands, %d aborts" % (wren, writes, aborts))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="binary dump of the trace ring")
+    parser.add_argument("--summary", action="store_true",
+                        help="per-opcode totals instead of the timeline")
+    args = parser.parse_args()
+
+    cpu_hz, head, capacity, steps = load(args.dump)
+    if head > capacity:
+        print("ring wrapped, %d oldest steps lost\n" % (head - capacity))
+    if args.summary:
+        summary(cpu_hz, steps)
+    else:
+        timeline(cpu_hz, steps)
+
+
+if __name__ == "__main__":
+    main()
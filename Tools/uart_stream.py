@@ -0,0 +1,225 @@
+#!/usr/bin/env python3
+"""Download a binary image into the QSPI flash over USART1.
+
+Sender side of Core/Src/uart_stream.c (the application built with
+UART_STREAM): opens a session for the image's range, keeps the window of
+data frames the device asked for in flight, goes back on a resend request
+or a silent link, and checks the CRC-32 the device reads back at the end.
+The frame layout is described in Core/Inc/uart_stream.h.
+
+The port is a serial device, or the pseudo-terminal printed by
+Tools/hostsim/uart_dev. pyserial is used when installed; without it, POSIX
+terminals are driven through termios.
+
+    uart_stream.py /dev/ttyUSB0 firmware.bin
+    uart_stream.py --address 0x90100000 --baud 3000000 /dev/ttyACM0 image.bin
+    uart_stream.py --corrupt 0.01 /dev/pts/5 image.bin
+"""
+
+import argparse
+import os
+import random
+import struct
+import sys
+import time
+import zlib
+
+FLASH_BASE = 0x90000000
+BAUD = 3000000
+
+SYNC = 0x5A
+OPEN, DATA, DONE, REPLY = 0x01, 0x02, 0x03, 0x80
+HEADER = struct.Struct("<BBHH")
+TRAILER = struct.Struct("<I")
+STATUS = ["ok", "resend", "range", "flash", "mismatch", "timeout"]
+OK, RESEND = 0, 1
+
+REPLY_TIMEOUT = 1.0     # s, longer than one sector erase at the worst timings
+RETRIES = 5             # silent timeouts in a row before giving up
+
+
+class Port:
+    """Byte link with a read timeout, over pyserial or a raw POSIX terminal."""
+
+    def __init__(self, path, baud):
+        try:
+            import serial
+        except ImportError:
+            serial = None
+        if serial is not None:
+            self.serial = serial.Serial(path, baud, timeout=0.01)
+            self.serial.reset_input_buffer()
+            return
+
+        import termios
+        import tty
+        self.serial = None
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        attrs = termios.tcgetattr(self.fd)
+        speed = getattr(termios, "B%d" % baud, None)
+        if speed is not None:
+            attrs[4] = attrs[5] = speed
+        termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+        termios.tcflush(self.fd, termios.TCIFLUSH)
+
+    def write(self, data):
+        if self.serial is not None:
+            self.serial.write(data)
+            return
+        while data:
+            data = data[os.write(self.fd, data):]
+
+    def read(self, timeout):
+        if self.serial is not None:
+            self.serial.timeout = timeout
+            return self.serial.read(max(1, self.serial.in_waiting))
+        import select
+        if not select.select([self.fd], [], [], timeout)[0]:
+            return b""
+        return os.read(self.fd, 4096)
+
+
+def frame(kind, seq, payload=b""):
+    body = HEADER.pack(SYNC, kind, seq & 0xFFFF, len(payload))[1:] + payload
+    return bytes([SYNC]) + body + TRAILER.pack(zlib.crc32(body))
+
+
+class Link:
+    def __init__(self, port, corrupt):
+        self.port = port
+        self.corrupt = corrupt
+        self.rx = bytearray()
+        self.random = random.Random(1)
+        self.corrupted = 0
+
+    def send(self, kind, seq, payload=b""):
+        data = bytearray(frame(kind, seq, payload))
+        if kind == DATA and self.corrupt and self.random.random() < self.corrupt:
+            data[self.random.randrange(1, len(data))] ^= 0x01
+            self.corrupted += 1
+        self.port.write(bytes(data))
+
+    def receive(self, timeout):
+        """Next valid reply as (type, seq, payload), or None after timeout."""
+        deadline = time.monotonic() + timeout
+        while True:
+            while len(self.rx) >= HEADER.size:
+                if self.rx[0] != SYNC:
+                    del self.rx[0]
+                    continue
+                _, kind, seq, length = HEADER.unpack_from(self.rx)
+                end = HEADER.size + length + TRAILER.size
+                if len(self.rx) < end:
+                    break
+                body = bytes(self.rx[1:HEADER.size + length])
+                if TRAILER.unpack_from(self.rx, end - TRAILER.size)[0] != zlib.crc32(body):
+                    del self.rx[0]
+                    continue
+                del self.rx[:end]
+                return kind, seq, body[HEADER.size - 1:]
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            self.rx += self.port.read(left)
+
+
+def status_name(status):
+    return STATUS[status] if status < len(STATUS) else "status %d" % status
+
+
+def unwrap(seq, base):
+    """Full block number of a 16-bit seq at or after base, None if behind."""
+    delta = (seq - base) & 0xFFFF
+    return None if delta >= 0x8000 else base + delta
+
+
+def download(link, address, image):
+    crc = zlib.crc32(image)
+    for _ in range(RETRIES):
+        link.send(OPEN, 0, struct.pack("<3I", address, len(image), crc))
+        reply = link.receive(REPLY_TIMEOUT)
+        if reply and reply[0] == OPEN | REPLY:
+            break
+    else:
+        sys.exit("no answer to OPEN")
+    status, block, window = struct.unpack_from("<BHH", reply[2])
+    if status != OK:
+        sys.exit("OPEN refused: %s" % status_name(status))
+
+    blocks = (len(image) + block - 1) // block
+    base = sent = resends = silent = 0
+    while base < blocks:
+        while sent < min(blocks, base + window):
+            link.send(DATA, sent, image[sent * block:(sent + 1) * block])
+            sent += 1
+
+        reply = link.receive(REPLY_TIMEOUT)
+        if reply is None:
+            silent += 1
+            if silent == RETRIES:
+                sys.exit("device silent at block %d of %d" % (base, blocks))
+            sent = base
+            resends += 1
+            continue
+        silent = 0
+
+        kind, seq, payload = reply
+        if kind != DATA | REPLY or not payload:
+            continue
+        if payload[0] == OK:
+            acked = unwrap(seq, base)
+            if acked is not None:
+                base = min(acked, blocks)
+        elif payload[0] == RESEND:
+            resend = unwrap(seq, base)
+            if resend is not None and resend < sent:
+                sent = resend
+                resends += 1
+        else:
+            sys.exit("device stopped at block %d: %s" % (base, status_name(payload[0])))
+
+    # Acknowledgements still on the way come before the answer
+    for _ in range(RETRIES):
+        link.send(DONE, blocks)
+        reply = link.receive(REPLY_TIMEOUT * 4)
+        while reply and reply[0] != DONE | REPLY:
+            reply = link.receive(REPLY_TIMEOUT * 4)
+        if reply:
+            break
+    else:
+        sys.exit("no answer to DONE")
+    status, readback = struct.unpack_from("<BI", reply[2])
+    if status != OK:
+        sys.exit("image check failed: %s, read back CRC-32 %08X, expected %08X"
+                 % (status_name(status), readback, crc))
+    return resends
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("image")
+    parser.add_argument("--address", type=lambda v: int(v, 0), default=FLASH_BASE,
+                        help="flash address of the image (default 0x%08X)" % FLASH_BASE)
+    parser.add_argument("--baud", type=int, default=BAUD, help="default %d" % BAUD)
+    parser.add_argument("--corrupt", type=float, default=0.0,
+                        help="fraction of data frames to damage, to exercise recovery")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if not image:
+        sys.exit("%s: empty image" % args.image)
+
+    link = Link(Port(args.port, args.baud), args.corrupt)
+    start = time.monotonic()
+    resends = download(link, args.address, image)
+    elapsed = time.monotonic() - start
+    print("%d bytes at 0x%08X in %.2f s (%.1f KB/s), %d resends, %d frames corrupted"
+          % (len(image), args.address, elapsed, len(image) / 1024 / elapsed, resends,
+             link.corrupted))
+
+
+if __name__ == "__main__":
+    main()